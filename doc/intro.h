@@ -50,4 +50,6 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  *
  * @li @link lha_decoder.h @endlink - routines to decode raw LZH
  *     compressed data.
+ * @li @link lha_encoder.h @endlink - routines to generate raw LZH
+ *     compressed data.
  */
@@ -24,6 +24,20 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // This file is designed to be #included by other source files to
 // make a complete decoder.
 //
+// Compressed data is read from the callback in large blocks into an
+// internal buffer, and bits are loaded from there into a 64-bit
+// accumulator. Most refills can therefore be done with a single
+// 8-byte load, rather than a callback invocation per byte.
+//
+// If the input stream holds its data in memory, a borrow callback can
+// also be set. Bits are then loaded directly from the stream's own
+// memory, and the internal buffer is not used at all.
+//
+
+// Size of the internal buffer used to hold compressed data read from
+// the callback function.
+
+#define BIT_STREAM_BUFFER_SIZE  4096 /* bytes */
 
 typedef struct {
 
@@ -33,11 +47,31 @@ typedef struct {
 	LHADecoderCallback callback;
 	void *callback_data;
 
+	// Optional callback function to borrow data from the input
+	// stream without copying it.
+
+	LHADecoderBorrowCallback borrow;
+	void *borrow_data;
+
 	// Bits from the input stream that are waiting to be read.
+	// The next bit to be read is the top bit of bit_buffer.
 
-	uint32_t bit_buffer;
+	uint64_t bit_buffer;
 	unsigned int bits;
 
+	// Data read from the input stream that has not yet been
+	// loaded into bit_buffer. This points either to buf, or to
+	// data borrowed from the input stream.
+
+	const uint8_t *data;
+	size_t buf_pos, buf_len;
+	uint8_t buf[BIT_STREAM_BUFFER_SIZE];
+
+	// Total number of bytes read from the input stream, used to
+	// find the current position within the stream.
+
+	uint64_t bytes_read;
+
 } BitStreamReader;
 
 // Initialize bit stream reader structure.
@@ -48,9 +82,108 @@ static void bit_stream_reader_init(BitStreamReader *reader,
 {
 	reader->callback = callback;
 	reader->callback_data = callback_data;
+	reader->borrow = NULL;
+	reader->borrow_data = NULL;
 
 	reader->bits = 0;
 	reader->bit_buffer = 0;
+
+	reader->data = reader->buf;
+	reader->buf_pos = 0;
+	reader->buf_len = 0;
+	reader->bytes_read = 0;
+}
+
+// Set a callback function to use to borrow data from the input stream.
+
+static void bit_stream_reader_set_borrow(BitStreamReader *reader,
+                                         LHADecoderBorrowCallback borrow,
+                                         void *borrow_data)
+{
+	reader->borrow = borrow;
+	reader->borrow_data = borrow_data;
+}
+
+// Read more data from the input stream, once all the data already read
+// has been consumed. Returns zero for end of file.
+
+static int fill_buffer(BitStreamReader *reader)
+{
+	const uint8_t *borrowed;
+	size_t bytes;
+
+	reader->buf_pos = 0;
+
+	// Borrow the stream's data if possible. If there is none, fall
+	// back to the read callback, which might still provide more
+	// (eg. padding at the end of the stream).
+
+	if (reader->borrow != NULL) {
+		bytes = reader->borrow(&borrowed, SIZE_MAX,
+		                       reader->borrow_data);
+
+		if (bytes > 0) {
+			reader->data = borrowed;
+			reader->buf_len = bytes;
+			reader->bytes_read += bytes;
+			return 1;
+		}
+	}
+
+	bytes = reader->callback(reader->buf, BIT_STREAM_BUFFER_SIZE,
+	                         reader->callback_data);
+
+	reader->data = reader->buf;
+	reader->buf_len = bytes;
+	reader->bytes_read += bytes;
+
+	return bytes > 0;
+}
+
+// Top up bit_buffer from the internal buffer, so that it contains at
+// least 57 bits unless the end of the input stream has been reached.
+
+static void refill_bits(BitStreamReader *reader)
+{
+	const uint8_t *p;
+
+	// Fast path: if there are at least eight bytes waiting in the
+	// buffer, load them all at once. Only the whole bytes that fit
+	// are counted as consumed; the bits from the partial byte at the
+	// end are loaded again on the next refill, and are identical,
+	// so ORing them in a second time is harmless.
+
+	if (reader->buf_len - reader->buf_pos >= 8) {
+		p = reader->data + reader->buf_pos;
+
+		reader->bit_buffer |= ((uint64_t) p[0] << 56
+		                     | (uint64_t) p[1] << 48
+		                     | (uint64_t) p[2] << 40
+		                     | (uint64_t) p[3] << 32
+		                     | (uint64_t) p[4] << 24
+		                     | (uint64_t) p[5] << 16
+		                     | (uint64_t) p[6] << 8
+		                     | (uint64_t) p[7]) >> reader->bits;
+
+		reader->buf_pos += (63 - reader->bits) / 8;
+		reader->bits |= 56;
+		return;
+	}
+
+	// Slow path, near the end of the buffer: load a byte at a time,
+	// reading more from the input stream as necessary.
+
+	while (reader->bits <= 56) {
+		if (reader->buf_pos >= reader->buf_len
+		 && !fill_buffer(reader)) {
+			break;
+		}
+
+		reader->bit_buffer |= (uint64_t) reader->data[reader->buf_pos]
+		                   << (56 - reader->bits);
+		++reader->buf_pos;
+		reader->bits += 8;
+	}
 }
 
 // Return the next n bits waiting to be read from the input stream,
@@ -59,9 +192,6 @@ static void bit_stream_reader_init(BitStreamReader *reader,
 static int peek_bits(BitStreamReader *reader,
                      unsigned int n)
 {
-	uint8_t buf[4];
-	size_t bytes, i;
-
 	if (n == 0) {
 		return 0;
 	}
@@ -69,31 +199,27 @@ static int peek_bits(BitStreamReader *reader,
 	// If there are not enough bits in the buffer to satisfy this
 	// request, we need to fill up the buffer with more bits.
 
-	while (reader->bits < n) {
-
-		// Maximum number of bytes we can fill?
-
-		const unsigned int fill_bytes = (32 - reader->bits) / 8;
-
-		// Read from input and fill bit_buffer.
-
-		bytes = reader->callback(buf, fill_bytes,
-		                         reader->callback_data);
+	if (reader->bits < n) {
+		refill_bits(reader);
 
 		// End of file?
 
-		if (bytes == 0) {
+		if (reader->bits < n) {
 			return -1;
 		}
-
-		for (i = 0; i < bytes; i++) {
-			reader->bit_buffer |=
-				(uint32_t) buf[i] << (24 - reader->bits);
-			reader->bits += 8;
-		}
 	}
 
-	return (signed int) (reader->bit_buffer >> (32 - n));
+	return (signed int) (reader->bit_buffer >> (64 - n));
+}
+
+// Discard n bits from the input stream, that have already been
+// examined using peek_bits().
+
+static void skip_bits(BitStreamReader *reader,
+                      unsigned int n)
+{
+	reader->bit_buffer <<= n;
+	reader->bits -= n;
 }
 
 // Read a bit from the input stream.
@@ -107,8 +233,7 @@ static int read_bits(BitStreamReader *reader,
 	result = peek_bits(reader, n);
 
 	if (result >= 0) {
-		reader->bit_buffer <<= n;
-		reader->bits -= n;
+		skip_bits(reader, n);
 	}
 
 	return result;
@@ -122,3 +247,25 @@ static int read_bit(BitStreamReader *reader)
 {
 	return read_bits(reader, 1);
 }
+
+// Get the position in the input stream of the next bit to be read.
+// Data in the buffers has been read from the input stream, but not
+// yet used.
+
+static uint64_t bit_stream_reader_position(BitStreamReader *reader)
+{
+	return (reader->bytes_read - (reader->buf_len - reader->buf_pos)) * 8
+	     - reader->bits;
+}
+
+// Continue reading from a position returned by
+// bit_stream_reader_position(), after the reader has been initialized
+// with a callback that reads from the byte containing that position.
+// Returns zero for failure.
+
+static int bit_stream_reader_restore(BitStreamReader *reader, uint64_t pos)
+{
+	reader->bytes_read = pos / 8;
+
+	return read_bits(reader, (unsigned int) (pos % 8)) >= 0;
+}
@@ -0,0 +1,129 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Data structure used to write bits to an output buffer as a stream.
+//
+// This file is designed to be #included by other source files to
+// make a complete encoder.
+//
+// Bits are written most significant bit first, the order in which
+// they are read back by bit_stream_reader.c. They are collected in a
+// 64-bit accumulator, and stored to the buffer 32 bits at a time.
+//
+
+typedef struct {
+
+	// Bits waiting to be stored to the buffer. The most recently
+	// written bit is the bottom bit of bit_buffer; bits above the
+	// bottom 'bits' bits have already been stored.
+
+	uint64_t bit_buffer;
+	unsigned int bits;
+
+	// Buffer to store the bits to, and the number of bytes stored
+	// to it so far.
+
+	uint8_t *buf;
+	size_t buf_len;
+
+} BitStreamWriter;
+
+// Initialize bit stream writer structure.
+
+static void bit_stream_writer_init(BitStreamWriter *writer)
+{
+	writer->bit_buffer = 0;
+	writer->bits = 0;
+	writer->buf = NULL;
+	writer->buf_len = 0;
+}
+
+// Set the buffer to store bits to. Any bits that have been written but
+// not yet stored are carried over into the new buffer.
+
+static void bit_stream_writer_set_buffer(BitStreamWriter *writer,
+                                         uint8_t *buf)
+{
+	writer->buf = buf;
+	writer->buf_len = 0;
+}
+
+// Write the bottom n bits of value to the stream; the other bits of
+// value must be zero. n must be no more than 32.
+
+static void write_bits(BitStreamWriter *writer,
+                       unsigned int n, uint32_t value)
+{
+	uint8_t *p;
+	uint32_t word;
+
+	writer->bit_buffer = (writer->bit_buffer << n) | value;
+	writer->bits += n;
+
+	if (writer->bits >= 32) {
+		writer->bits -= 32;
+		word = (uint32_t) (writer->bit_buffer >> writer->bits);
+
+		p = writer->buf + writer->buf_len;
+		p[0] = (uint8_t) (word >> 24);
+		p[1] = (uint8_t) (word >> 16);
+		p[2] = (uint8_t) (word >> 8);
+		p[3] = (uint8_t) word;
+		writer->buf_len += 4;
+	}
+}
+
+// Store all the whole bytes written so far to the buffer. Up to seven
+// bits might be left waiting for more to be written.
+
+static void bit_stream_writer_flush(BitStreamWriter *writer)
+{
+	while (writer->bits >= 8) {
+		writer->bits -= 8;
+		writer->buf[writer->buf_len] =
+		    (uint8_t) (writer->bit_buffer >> writer->bits);
+		++writer->buf_len;
+	}
+}
+
+// Store all the bits written so far to the buffer, padding the last
+// byte with zero bits, at the end of the stream. Returns the number of
+// padding bits added.
+
+static unsigned int bit_stream_writer_finish(BitStreamWriter *writer)
+{
+	unsigned int padding;
+
+	bit_stream_writer_flush(writer);
+
+	if (writer->bits == 0) {
+		return 0;
+	}
+
+	padding = 8 - writer->bits;
+	writer->buf[writer->buf_len] =
+	    (uint8_t) (writer->bit_buffer << padding);
+	++writer->buf_len;
+	writer->bits = 0;
+
+	return padding;
+}
+
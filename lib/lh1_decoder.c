@@ -24,6 +24,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <inttypes.h>
 
 #include "lha_decoder.h"
+#include "lha_endian.h"
 
 #include "bit_stream_reader.c"
 
@@ -43,6 +44,10 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define NUM_TREE_NODES       (NUM_CODES * 2 - 1)
 
+// Number of bits examined at once when reading a code.
+
+#define CODE_PEEK_BITS       24
+
 // Number of possible offsets:
 
 #define NUM_OFFSETS          64
@@ -55,36 +60,20 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define COPY_THRESHOLD       3 /* bytes */
 
-// Required size of the output buffer.  At most, a single call to read()
-// might result in a copy of the entire ring buffer.
-
-#define OUTPUT_BUFFER_SIZE   RING_BUFFER_SIZE
-
-typedef struct {
-
-	// If true, this node is a leaf node.
-
-	unsigned int leaf        :1;
-
-	// If this is a leaf node, child_index is the code represented by
-	// this node. Otherwise, nodes[child_index] and nodes[child_index-1]
-	// are the children of this node.
-
-	unsigned int child_index :15;
-
-	// Index of the parent node of this node.
+// Required size of the output buffer: the most data that a single call
+// to read() might output, which is the copy for the largest code.
 
-	uint16_t parent;
+#define OUTPUT_BUFFER_SIZE   (NUM_CODES - 1 - 0x100 + COPY_THRESHOLD)
 
-	// Frequency count for this node - number of times that it has
-	// received a hit.
+// Size of the state saved by lha_lh1_save_state(): the ring buffer and
+// the position within it, and for each node of the tree, its child
+// index and frequency.
 
-	uint16_t freq;
+#define STATE_SIZE           (RING_BUFFER_SIZE + 2 + NUM_TREE_NODES * 4)
 
-	// Group that this node belongs to.
+// Top bit of a child index, set for a leaf node.
 
-	uint16_t group;
-} Node;
+#define LEAF_NODE            0x8000
 
 typedef struct {
 
@@ -97,29 +86,30 @@ typedef struct {
 	uint8_t ringbuf[RING_BUFFER_SIZE];
 	unsigned int ringbuf_pos;
 
-	// Array of tree nodes. nodes[0] is the root node.  The array
-	// is maintained in order by frequency.
+	// The tree nodes. Index 0 is the root node, and the nodes are
+	// kept in order of decreasing frequency. Each field of the
+	// nodes is held in a separate array, as the tree updates mostly
+	// scan along one field of neighbouring nodes.
+	//
+	// For a leaf node, child_index is the code represented by the
+	// node, with LEAF_NODE set. Otherwise, the nodes at child_index
+	// and child_index - 1 are the children of the node.
 
-	Node nodes[NUM_TREE_NODES];
+	uint16_t child_index[NUM_TREE_NODES];
 
-	// Indices of leaf nodes of the tree (map from code to leaf
-	// node index)
+	// Index of the parent node of each node.
 
-	uint16_t leaf_nodes[NUM_CODES];
+	uint16_t parent[NUM_TREE_NODES];
 
-	// Groups list.  Every node belongs to a group.  All nodes within
-	// a group have the same frequency. There can be at most
-	// NUM_TREE_NODES groups (one for each node). num_groups is used
-	// to allocate and deallocate groups as needed.
+	// Frequency count for each node - number of times that it has
+	// received a hit.
 
-	uint16_t groups[NUM_TREE_NODES];
-	unsigned int num_groups;
+	uint16_t freq[NUM_TREE_NODES];
 
-	// Index of the "leader" of a group within the nodes[] array.
-	// The leader is the left-most node within a span of nodes with
-	// the same frequency.
+	// Indices of leaf nodes of the tree (map from code to leaf
+	// node index)
 
-	uint16_t group_leader[NUM_TREE_NODES];
+	uint16_t leaf_nodes[NUM_CODES];
 
 	// Offset lookup table.  Maps from a byte value (sequence of next
 	// 8 bits from input stream) to an offset value.
@@ -142,62 +132,21 @@ static const unsigned int offset_fdist[] = {
 	16,   // 8 bits
 };
 
-// Allocate a group from the free groups array.
-
-static uint16_t alloc_group(LHALH1Decoder *decoder)
-{
-	uint16_t result;
-
-	result = decoder->groups[decoder->num_groups];
-	++decoder->num_groups;
-
-	return result;
-}
-
-// Free a group that is no longer in use.
-
-static void free_group(LHALH1Decoder *decoder, uint16_t group)
-{
-	--decoder->num_groups;
-	decoder->groups[decoder->num_groups] = group;
-}
-
-// Initialize groups array.
-
-static void init_groups(LHALH1Decoder *decoder)
-{
-	unsigned int i;
-
-	for (i = 0; i < NUM_TREE_NODES; ++i) {
-		decoder->groups[i] = (uint16_t) i;
-	}
-
-	decoder->num_groups = 0;
-}
-
 // Initialize the tree with its basic initial configuration.
 
 static void init_tree(LHALH1Decoder *decoder)
 {
 	unsigned int i, child;
 	int node_index;
-	uint16_t leaf_group;
-	Node *node;
 
 	// Leaf nodes are placed at the end of the table.  Start by
 	// initializing these, and working backwards.
 
 	node_index = NUM_TREE_NODES - 1;
-	leaf_group = alloc_group(decoder);
 
 	for (i = 0; i < NUM_CODES; ++i) {
-		node = &decoder->nodes[node_index];
-		node->leaf = 1;
-		node->child_index = (unsigned short) i;
-		node->freq = 1;
-		node->group = leaf_group;
-
-		decoder->group_leader[leaf_group] = (uint16_t) node_index;
+		decoder->child_index[node_index] = (uint16_t) (i | LEAF_NODE);
+		decoder->freq[node_index] = 1;
 		decoder->leaf_nodes[i] = (uint16_t) node_index;
 
 		--node_index;
@@ -209,34 +158,20 @@ static void init_tree(LHALH1Decoder *decoder)
 	child = NUM_TREE_NODES - 1;
 
 	while (node_index >= 0) {
-		node = &decoder->nodes[node_index];
-		node->leaf = 0;
 
 		// Set child pointer and update the parent pointers of the
 		// children.
 
-		node->child_index = child;
-		decoder->nodes[child].parent = (uint16_t) node_index;
-		decoder->nodes[child - 1].parent = (uint16_t) node_index;
+		decoder->child_index[node_index] = (uint16_t) child;
+		decoder->parent[child] = (uint16_t) node_index;
+		decoder->parent[child - 1] = (uint16_t) node_index;
 
 		// The node's frequency is equal to the sum of the frequencies
 		// of its children.
 
-		node->freq = (uint16_t) (decoder->nodes[child].freq
-		                       + decoder->nodes[child - 1].freq);
-
-		// Is the frequency the same as the last node we processed?
-		// if so, we are in the same group. If not, we must
-		// allocate a new group.  Either way, this node is now the
-		// leader of its group.
-
-		if (node->freq == decoder->nodes[node_index + 1].freq) {
-			node->group = decoder->nodes[node_index + 1].group;
-		} else {
-			node->group = alloc_group(decoder);
-		}
-
-		decoder->group_leader[node->group] = (uint16_t) node_index;
+		decoder->freq[node_index]
+		    = (uint16_t) (decoder->freq[child]
+		                + decoder->freq[child - 1]);
 
 		// Process next node.
 
@@ -327,7 +262,6 @@ static int lha_lh1_init(void *data, LHADecoderCallback callback,
 
 	// Initialize data structures.
 
-	init_groups(decoder);
 	init_tree(decoder);
 	init_offset_table(decoder);
 	init_ring_buffer(decoder);
@@ -335,99 +269,56 @@ static int lha_lh1_init(void *data, LHADecoderCallback callback,
 	return 1;
 }
 
-// Make the given node the leader of its group: swap it with the current
-// leader so that it is in the left-most position.  Returns the new index
-// of the node.
+// Set the child index of a node, updating the parent pointers of its
+// children (or leaf_nodes[], for a leaf node) to match.
 
-static uint16_t make_group_leader(LHALH1Decoder *decoder,
-                                  uint16_t node_index)
+static void set_child(LHALH1Decoder *decoder, unsigned int node_index,
+                      unsigned int child)
 {
-	Node *node, *leader;
-	uint16_t group;
-	uint16_t leader_index;
-	unsigned int tmp;
-
-	group = decoder->nodes[node_index].group;
-	leader_index = decoder->group_leader[group];
-
-	// Already the leader?  If so, there is nothing to do.
-
-	if (leader_index == node_index) {
-		return node_index;
-	}
+	decoder->child_index[node_index] = (uint16_t) child;
 
-	node = &decoder->nodes[node_index];
-	leader = &decoder->nodes[leader_index];
-
-	// Swap leaf and child indices in the two nodes:
-
-	tmp = leader->leaf;
-	leader->leaf = node->leaf;
-	node->leaf = tmp;
-
-	tmp = leader->child_index;
-	leader->child_index = node->child_index;
-	node->child_index = tmp;
-
-	if (node->leaf) {
-		decoder->leaf_nodes[node->child_index] = node_index;
-	} else {
-		decoder->nodes[node->child_index].parent = node_index;
-		decoder->nodes[node->child_index - 1].parent = node_index;
-	}
-
-	if (leader->leaf) {
-		decoder->leaf_nodes[leader->child_index] = leader_index;
+	if ((child & LEAF_NODE) != 0) {
+		decoder->leaf_nodes[child & ~LEAF_NODE] = (uint16_t) node_index;
 	} else {
-		decoder->nodes[leader->child_index].parent = leader_index;
-		decoder->nodes[leader->child_index - 1].parent = leader_index;
+		decoder->parent[child] = (uint16_t) node_index;
+		decoder->parent[child - 1] = (uint16_t) node_index;
 	}
-
-	return leader_index;
 }
 
-// Increase the frequency count for a node, rearranging groups as
-// appropriate.
+// Increase the frequency count for a node. To keep the nodes in order
+// of decreasing frequency, the node is first swapped with the left-most
+// node that has the same frequency. Returns the new index of the node.
+//
+// The run of nodes with the same frequency is usually short, so it is
+// faster to scan for the left-most node than to keep track of the runs.
+// The root node is never swapped, so the scan stops at index 1.
 
-static void increment_node_freq(LHALH1Decoder *decoder, uint16_t node_index)
+static unsigned int increment_node_freq(LHALH1Decoder *decoder,
+                                        unsigned int node_index)
 {
-	Node *node, *other;
-
-	node = &decoder->nodes[node_index];
-	other = &decoder->nodes[node_index - 1];
-
-	++node->freq;
-
-	// If the node is part of a group containing other nodes, it
-	// must leave the group.
-
-	if (node_index < NUM_TREE_NODES - 1
-	 && node->group == decoder->nodes[node_index + 1].group) {
+	unsigned int leader_index, child;
+	uint16_t freq;
 
-		// Next node in the group now becomes the leader.
+	freq = decoder->freq[node_index];
+	leader_index = node_index;
 
-		++decoder->group_leader[node->group];
+	while (leader_index > 1 && decoder->freq[leader_index - 1] == freq) {
+		--leader_index;
+	}
 
-		// The node must now either join the group to its
-		// left, or start a new group.
+	// Both nodes have the same frequency, so only the children need
+	// to be swapped.
 
-		if (node->freq == other->freq) {
-			node->group = other->group;
-		} else {
-			node->group = alloc_group(decoder);
-			decoder->group_leader[node->group] = node_index;
-		}
+	if (leader_index != node_index) {
+		child = decoder->child_index[node_index];
+		set_child(decoder, node_index,
+		          decoder->child_index[leader_index]);
+		set_child(decoder, leader_index, child);
+	}
 
-	} else {
-		// The node is in a group of its own (single-node
-		// group).  It might need to join the group of the
-		// node on its left if it has the same frequency.
+	++decoder->freq[leader_index];
 
-		if (node->freq == other->freq) {
-			free_group(decoder, node->group);
-			node->group = other->group;
-		}
-	}
+	return leader_index;
 }
 
 // Reconstruct the code huffman tree to be more evenly distributed.
@@ -435,26 +326,24 @@ static void increment_node_freq(LHALH1Decoder *decoder, uint16_t node_index)
 
 static void reconstruct_tree(LHALH1Decoder *decoder)
 {
-	Node *leaf;
 	unsigned int child;
 	unsigned int freq;
-	unsigned int group;
-	int i;
+	int i, leaf;
 
 	// Gather all leaf nodes at the start of the table.
 
-	leaf = decoder->nodes;
+	leaf = 0;
 
 	for (i = 0; i < NUM_TREE_NODES; ++i) {
-		if (decoder->nodes[i].leaf) {
-			leaf->leaf = 1;
-			leaf->child_index = decoder->nodes[i].child_index;
+		if ((decoder->child_index[i] & LEAF_NODE) != 0) {
+			decoder->child_index[leaf] = decoder->child_index[i];
 
 			// Frequency of the nodes in the new tree is halved,
 			// this acts as a running average each time the
 			// tree is reconstructed.
 
-			leaf->freq = (uint16_t) (decoder->nodes[i].freq + 1) / 2;
+			decoder->freq[leaf] = (uint16_t)
+			    ((decoder->freq[i] + 1) / 2);
 
 			++leaf;
 		}
@@ -467,7 +356,7 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 	// of its children, and must be placed to maintain the ordering
 	// within the table by decreasing frequency.
 
-	leaf = &decoder->nodes[NUM_CODES - 1];
+	leaf = NUM_CODES - 1;
 	child = NUM_TREE_NODES - 1;
 	i = NUM_TREE_NODES - 1;
 
@@ -478,8 +367,9 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 		// then we need to copy some from the leaves.
 
 		while ((int) child - i < 2) {
-			decoder->nodes[i] = *leaf;
-			decoder->leaf_nodes[leaf->child_index] = (uint16_t) i;
+			decoder->freq[i] = decoder->freq[leaf];
+			set_child(decoder, (unsigned int) i,
+			          decoder->child_index[leaf]);
 
 			--i;
 			--leaf;
@@ -489,15 +379,16 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 		// of the new branch node, we can calculate the branch
 		// node's frequency.
 
-		freq = (unsigned int) (decoder->nodes[child].freq
-		                     + decoder->nodes[child - 1].freq);
+		freq = (unsigned int) (decoder->freq[child]
+		                     + decoder->freq[child - 1]);
 
 		// Now copy more leaf nodes until the correct place to
 		// insert the new branch node presents itself.
 
-		while (leaf >= decoder->nodes && freq >= leaf->freq) {
-			decoder->nodes[i] = *leaf;
-			decoder->leaf_nodes[leaf->child_index] = (uint16_t) i;
+		while (leaf >= 0 && freq >= decoder->freq[leaf]) {
+			decoder->freq[i] = decoder->freq[leaf];
+			set_child(decoder, (unsigned int) i,
+			          decoder->child_index[leaf]);
 
 			--i;
 			--leaf;
@@ -505,12 +396,8 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 
 		// The new branch node can now be inserted.
 
-		decoder->nodes[i].leaf = 0;
-		decoder->nodes[i].freq = (uint16_t) freq;
-		decoder->nodes[i].child_index = (uint16_t) child;
-
-		decoder->nodes[child].parent = (uint16_t) i;
-		decoder->nodes[child - 1].parent = (uint16_t) i;
+		decoder->freq[i] = (uint16_t) freq;
+		set_child(decoder, (unsigned int) i, child);
 
 		--i;
 
@@ -518,32 +405,6 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 
 		child -= 2;
 	}
-
-	// Reconstruct the group data.  Start by resetting group data.
-
-	init_groups(decoder);
-
-	// Assign a group to the first node.
-
-	group = alloc_group(decoder);
-	decoder->nodes[0].group = (uint16_t) group;
-	decoder->group_leader[group] = 0;
-
-	// Assign a group number to each node, nodes having the same
-	// group if the have the same frequency, and allocating new
-	// groups when a new frequency is found.
-
-	for (i = 1; i < NUM_TREE_NODES; ++i) {
-		if (decoder->nodes[i].freq == decoder->nodes[i - 1].freq) {
-			decoder->nodes[i].group = decoder->nodes[i - 1].group;
-		} else {
-			group = alloc_group(decoder);
-			decoder->nodes[i].group = (uint16_t) group;
-
-			// First node with a particular frequency is leader.
-			decoder->group_leader[group] = (uint16_t) i;
-		}
-	}
 }
 
 // Increment the counter for the specific code, reordering the tree as
@@ -551,16 +412,16 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 
 static void increment_for_code(LHALH1Decoder *decoder, uint16_t code)
 {
-	uint16_t node_index;
+	unsigned int node_index;
 
 	// When the limit is reached, we must reorder the code tree
 	// to better match the code frequencies:
 
-	if (decoder->nodes[0].freq >= TREE_REORDER_LIMIT) {
+	if (decoder->freq[0] >= TREE_REORDER_LIMIT) {
 		reconstruct_tree(decoder);
 	}
 
-	++decoder->nodes[0].freq;
+	++decoder->freq[0];
 
 	// Dynamically adjust the tree.  Start from the leaf node of
 	// the tree and walk back up, rearranging nodes to the root.
@@ -569,16 +430,14 @@ static void increment_for_code(LHALH1Decoder *decoder, uint16_t code)
 
 	while (node_index != 0) {
 
-		// Shift the node to the left side of its group,
-		// and bump the frequency count.
+		// Shift the node to the left of the nodes with the
+		// same frequency, and bump the frequency count.
 
-		node_index = make_group_leader(decoder, node_index);
-
-		increment_node_freq(decoder, node_index);
+		node_index = increment_node_freq(decoder, node_index);
 
 		// Iterate up to the parent node.
 
-		node_index = decoder->nodes[node_index].parent;
+		node_index = decoder->parent[node_index];
 	}
 }
 
@@ -586,33 +445,51 @@ static void increment_for_code(LHALH1Decoder *decoder, uint16_t code)
 
 static int read_code(LHALH1Decoder *decoder, uint16_t *result)
 {
-	unsigned int node_index;
-	int bit;
+	BitStreamReader *reader = &decoder->bit_stream_reader;
+	unsigned int child, n;
+	int bits;
 
 	// Start from the root node, and traverse down until a leaf is
 	// reached.
 
-	node_index = 0;
+	child = decoder->child_index[0];
 
-	//printf("<root ");
-	while (!decoder->nodes[node_index].leaf) {
-		bit = read_bit(&decoder->bit_stream_reader);
+	while ((child & LEAF_NODE) == 0) {
 
-		if (bit < 0) {
-			return 0;
+		// Codes are rarely longer than CODE_PEEK_BITS, so that
+		// many bits are examined at once, and only the bits used
+		// are skipped. Near the end of the input, there may not
+		// be that many, so read a bit at a time instead.
+
+		bits = peek_bits(reader, CODE_PEEK_BITS);
+
+		if (bits < 0) {
+			bits = read_bit(reader);
+
+			if (bits < 0) {
+				return 0;
+			}
+
+			child = decoder->child_index[child
+			                             - (unsigned int) bits];
+			continue;
 		}
 
-		//printf("<%i>", bit);
+		// Choose one of the two children depending on each
+		// bit in turn.
+
+		n = CODE_PEEK_BITS;
 
-		// Choose one of the two children depending on the
-		// bit that was read.
+		do {
+			--n;
+			child = decoder->child_index[child
+			            - (((unsigned int) bits >> n) & 1)];
+		} while ((child & LEAF_NODE) == 0 && n > 0);
 
-		node_index = decoder->nodes[node_index].child_index
-		           - (unsigned int) bit;
+		skip_bits(reader, CODE_PEEK_BITS - n);
 	}
 
-	*result = decoder->nodes[node_index].child_index;
-	//printf(" -> %i!>\n", *result);
+	*result = (uint16_t) (child & ~LEAF_NODE);
 
 	increment_for_code(decoder, *result);
 
@@ -712,11 +589,152 @@ static size_t lha_lh1_read(void *data, uint8_t *buf)
 	return result;
 }
 
+// Decode as many commands as will fit into the specified buffer.
+
+static size_t lha_lh1_read_bulk(void *data, uint8_t *buf, size_t buf_len)
+{
+	size_t result, bytes;
+
+	result = 0;
+
+	while (buf_len - result >= OUTPUT_BUFFER_SIZE) {
+		bytes = lha_lh1_read(data, buf + result);
+
+		if (bytes == 0) {
+			break;
+		}
+
+		result += bytes;
+	}
+
+	return result;
+}
+
+static uint64_t lha_lh1_save_state(void *data, uint8_t *buf)
+{
+	LHALH1Decoder *decoder = data;
+	unsigned int i;
+	uint8_t *p;
+
+	memcpy(buf, decoder->ringbuf, RING_BUFFER_SIZE);
+	p = buf + RING_BUFFER_SIZE;
+
+	lha_encode_uint16(p, (uint16_t) decoder->ringbuf_pos);
+	p += 2;
+
+	// The other data structures are derived from the tree, so only
+	// the tree itself is saved.
+
+	for (i = 0; i < NUM_TREE_NODES; ++i) {
+		lha_encode_uint16(p, decoder->child_index[i]);
+		lha_encode_uint16(p + 2, decoder->freq[i]);
+		p += 4;
+	}
+
+	return bit_stream_reader_position(&decoder->bit_stream_reader);
+}
+
+// Restore the tree from a saved state, checking that it is a valid tree
+// that contains every code once, and setting the parent pointers and
+// leaf_nodes[] table to match. Returns zero if the tree is not valid.
+
+static int restore_tree(LHALH1Decoder *decoder, uint8_t *buf)
+{
+	uint8_t used[NUM_TREE_NODES];
+	unsigned int i, child;
+
+	memset(used, 0, sizeof(used));
+
+	for (i = 0; i < NUM_TREE_NODES; ++i) {
+		decoder->child_index[i] = lha_decode_uint16(buf + i * 4);
+		decoder->freq[i] = lha_decode_uint16(buf + i * 4 + 2);
+		decoder->parent[i] = 0xffff;
+	}
+
+	// Both children of a node are after it in the array, and no node
+	// can have more than one parent (0xffff marks a node that has no
+	// parent yet). There are exactly enough nodes
+	// for every code to appear once, as a leaf.
+
+	for (i = 0; i < NUM_TREE_NODES; ++i) {
+		child = decoder->child_index[i];
+
+		// Nodes must be in order of decreasing frequency, as
+		// increment_node_freq() and reconstruct_tree() expect.
+
+		if (i > 0 && decoder->freq[i] > decoder->freq[i - 1]) {
+			return 0;
+		}
+
+		if ((child & LEAF_NODE) != 0) {
+			child &= ~LEAF_NODE;
+
+			if (child >= NUM_CODES || used[child]) {
+				return 0;
+			}
+
+			used[child] = 1;
+			decoder->leaf_nodes[child] = (uint16_t) i;
+		} else {
+			if (child <= i + 1 || child >= NUM_TREE_NODES
+			 || decoder->parent[child] != 0xffff
+			 || decoder->parent[child - 1] != 0xffff) {
+				return 0;
+			}
+
+			// The frequency of a node is the sum of the
+			// frequencies of its children.
+
+			if (decoder->freq[i] != decoder->freq[child]
+			                      + decoder->freq[child - 1]) {
+				return 0;
+			}
+
+			decoder->parent[child] = (uint16_t) i;
+			decoder->parent[child - 1] = (uint16_t) i;
+		}
+	}
+
+	return 1;
+}
+
+static int lha_lh1_restore_state(void *data, uint8_t *buf,
+                                 uint64_t input_bits)
+{
+	LHALH1Decoder *decoder = data;
+
+	memcpy(decoder->ringbuf, buf, RING_BUFFER_SIZE);
+	decoder->ringbuf_pos = lha_decode_uint16(buf + RING_BUFFER_SIZE);
+
+	if (decoder->ringbuf_pos >= RING_BUFFER_SIZE
+	 || !restore_tree(decoder, buf + RING_BUFFER_SIZE + 2)) {
+		return 0;
+	}
+
+	return bit_stream_reader_restore(&decoder->bit_stream_reader,
+	                                 input_bits);
+}
+
+static void lha_lh1_set_borrow(void *data, LHADecoderBorrowCallback borrow)
+{
+	LHALH1Decoder *decoder = data;
+
+	bit_stream_reader_set_borrow(&decoder->bit_stream_reader, borrow,
+	                             decoder->bit_stream_reader.callback_data);
+}
+
 LHADecoderType lha_lh1_decoder = {
 	lha_lh1_init,
 	NULL,
 	lha_lh1_read,
 	sizeof(LHALH1Decoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_lh1_set_borrow,
+	lha_lh1_read_bulk,
+	NULL,
+	NULL,
+	STATE_SIZE,
+	lha_lh1_save_state,
+	lha_lh1_restore_state
 };
@@ -0,0 +1,45 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Encoder for the -lh5- algorithm.
+//
+
+// 8 KiB dictionary:
+
+#define HISTORY_BITS    13   /* 2^13 = 8192 */
+
+// Number of bits to encode HISTORY_BITS:
+
+#define OFFSET_BITS     4
+
+// Name of the variable for the encoder:
+
+#define ENCODER_NAME lha_lh5_encoder
+
+// Number of different command codes. 0-255 range are literal byte
+// values, while higher values indicate copy from history.
+
+#define NUM_CODES            510
+
+// The actual algorithm code is contained in lh_new_encoder.c, which
+// acts as a template for -lh5-, -lh6- and -lh7-.
+
+#include "lh_new_encoder.c"
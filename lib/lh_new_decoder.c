@@ -30,12 +30,15 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <inttypes.h>
 
 #include "lha_decoder.h"
+#include "lha_endian.h"
 
 #include "bit_stream_reader.c"
 
-// Include tree decoder.
+// Include tree decoder. Lookup tables are used to decode the code
+// and offset trees, which are read from for every command.
 
 typedef uint16_t TreeElement;
+#define TREE_LOOKUP_BITS     10
 #include "tree_decode.c"
 
 // Threshold for copying. The first copy code starts from here.
@@ -47,10 +50,22 @@ typedef uint16_t TreeElement;
 
 #define RING_BUFFER_SIZE     (1 << HISTORY_BITS)
 
-// Required size of the output buffer.  At most, a single call to read()
-// might result in a copy of the entire ring buffer.
+// Required size of the output buffer: the most data that a single call
+// to read() might output. Codes are at most 9 bits long, so this is the
+// copy for the largest possible code. -lk7- can encode longer copies.
 
-#define OUTPUT_BUFFER_SIZE   RING_BUFFER_SIZE
+#ifdef LHARK
+#define OUTPUT_BUFFER_SIZE   514
+#else
+#define OUTPUT_BUFFER_SIZE   (511 - 256 + COPY_THRESHOLD)
+#endif
+
+// History is stored in a linear window, twice the size of the ring
+// buffer, so that copies never need to wrap around. Decoded data is
+// appended to the end of the window; when it fills up, the most recent
+// RING_BUFFER_SIZE bytes are moved back to the start.
+
+#define WINDOW_SIZE          (RING_BUFFER_SIZE * 2)
 
 // Number of possible codes in the "temporary table" used to encode the
 // codes table. This is a function of the number of bits used to encode
@@ -64,15 +79,30 @@ typedef uint16_t TreeElement;
 
 #define MAX_OFFSET_CODES     ((1 << OFFSET_BITS) - 1)
 
+// Size of the state saved by lha_lh_new_save_state(): the history, the
+// number of commands left in the current block, and the code and offset
+// trees.
+
+#define STATE_SIZE \
+	(RING_BUFFER_SIZE + 4 + (NUM_CODES + MAX_OFFSET_CODES) * 2 * 2)
+
 typedef struct {
 	// Input bit stream.
 
 	BitStreamReader bit_stream_reader;
 
-	// Ring buffer of past data.  Used for position-based copies.
+	// Window of past data.  Used for position-based copies. Data
+	// is decoded into the window at window_pos, and is then copied
+	// out to the output buffer.
+
+	uint8_t window[WINDOW_SIZE];
+	size_t window_pos;
+
+	// If non-zero, the history at the start of the window has been
+	// overwritten, and must be filled in again before the decoder
+	// is reused.
 
-	uint8_t ringbuf[RING_BUFFER_SIZE];
-	unsigned int ringbuf_pos;
+	int window_dirty;
 
 	// Number of commands remaining before we start a new block.
 
@@ -91,18 +121,40 @@ typedef struct {
 	// into the history buffer.
 
 	TreeElement offset_tree[MAX_OFFSET_CODES * 2];
+
+	// Lookup tables for fast decoding of the code and offset trees.
+
+	TreeLookupEntry code_lookup[TREE_LOOKUP_SIZE];
+	TreeLookupEntry offset_lookup[TREE_LOOKUP_SIZE];
 } LHANewDecoder;
 
-// Initialize the history ring buffer.
+// Initialize the history window. The history before the start of the
+// stream is filled with spaces.
 
-static void init_ring_buffer(LHANewDecoder *decoder)
+static void init_window(LHANewDecoder *decoder)
 {
-	memset(decoder->ringbuf, ' ', RING_BUFFER_SIZE);
-	decoder->ringbuf_pos = 0;
+	memset(decoder->window, ' ', RING_BUFFER_SIZE);
+	decoder->window_pos = RING_BUFFER_SIZE;
+	decoder->window_dirty = 0;
 }
 
-static int lha_lh_new_init(void *data, LHADecoderCallback callback,
-                           void *callback_data)
+// If there is not enough space at the end of the window for another
+// command, move the most recent history back to the start.
+
+static void check_window_space(LHANewDecoder *decoder)
+{
+	if (decoder->window_pos > WINDOW_SIZE - OUTPUT_BUFFER_SIZE) {
+		memmove(decoder->window,
+		        decoder->window + decoder->window_pos
+		          - RING_BUFFER_SIZE,
+		        RING_BUFFER_SIZE);
+		decoder->window_pos = RING_BUFFER_SIZE;
+		decoder->window_dirty = 1;
+	}
+}
+
+static int lha_lh_new_reset(void *data, LHADecoderCallback callback,
+                            void *callback_data)
 {
 	LHANewDecoder *decoder = data;
 
@@ -111,9 +163,16 @@ static int lha_lh_new_init(void *data, LHADecoderCallback callback,
 	bit_stream_reader_init(&decoder->bit_stream_reader,
 	                       callback, callback_data);
 
-	// Initialize data structures.
+	// Initialize data structures. Data after the initial history
+	// is always written before it is read, so if the initial history
+	// is intact, the window does not need to be filled again. For
+	// short files, this avoids clearing the whole window each time.
 
-	init_ring_buffer(decoder);
+	if (decoder->window_dirty) {
+		init_window(decoder);
+	} else {
+		decoder->window_pos = RING_BUFFER_SIZE;
+	}
 
 	// First read starts the first block.
 
@@ -125,9 +184,22 @@ static int lha_lh_new_init(void *data, LHADecoderCallback callback,
 	init_tree(decoder->offset_tree, MAX_OFFSET_CODES * 2);
 	init_tree(decoder->temp_tree, MAX_TEMP_CODES * 2);
 
+	build_lookup_table(decoder->code_lookup, decoder->code_tree);
+	build_lookup_table(decoder->offset_lookup, decoder->offset_tree);
+
 	return 1;
 }
 
+static int lha_lh_new_init(void *data, LHADecoderCallback callback,
+                           void *callback_data)
+{
+	LHANewDecoder *decoder = data;
+
+	decoder->window_dirty = 1;
+
+	return lha_lh_new_reset(data, callback, callback_data);
+}
+
 // Read a length value - this is normally a value in the 0-7 range, but
 // sometimes can be longer.
 
@@ -427,6 +499,11 @@ static int start_new_block(LHANewDecoder *decoder)
 		return 0;
 	}
 
+	// Rebuild the lookup tables for the new trees.
+
+	build_lookup_table(decoder->code_lookup, decoder->code_tree);
+	build_lookup_table(decoder->offset_lookup, decoder->offset_tree);
+
 	return 1;
 }
 
@@ -435,7 +512,8 @@ static int start_new_block(LHANewDecoder *decoder)
 
 static int read_code(LHANewDecoder *decoder)
 {
-	return read_from_tree(&decoder->bit_stream_reader, decoder->code_tree);
+	return read_from_lookup_table(&decoder->bit_stream_reader,
+	                              decoder->code_tree, decoder->code_lookup);
 }
 
 #ifdef LHARK
@@ -465,8 +543,9 @@ static int read_offset_code(LHANewDecoder *decoder)
 {
 	int bits;
 
-	bits = read_from_tree(&decoder->bit_stream_reader,
-	                      decoder->offset_tree);
+	bits = read_from_lookup_table(&decoder->bit_stream_reader,
+	                              decoder->offset_tree,
+	                              decoder->offset_lookup);
 
 	if (bits < 0) {
 		return -1;
@@ -504,38 +583,52 @@ static int read_offset_code(LHANewDecoder *decoder)
 #endif
 }
 
-// Add a byte value to the output stream.
+// Read the offset for a copy command from the input stream, returning
+// the distance back into the history to copy from, or zero for failure.
 
-static void output_byte(LHANewDecoder *decoder, uint8_t *buf,
-                        size_t *buf_len, uint8_t b)
+static size_t read_copy_distance(LHANewDecoder *decoder)
 {
-	buf[*buf_len] = b;
-	++*buf_len;
+	int offset;
 
-	decoder->ringbuf[decoder->ringbuf_pos] = b;
-	decoder->ringbuf_pos = (decoder->ringbuf_pos + 1) % RING_BUFFER_SIZE;
+	offset = read_offset_code(decoder);
+
+	if (offset < 0) {
+		return 0;
+	}
+
+	// Offsets are relative to the ring buffer, and wrap around.
+
+	return ((unsigned int) offset & (RING_BUFFER_SIZE - 1)) + 1;
 }
 
-// Copy a block from the history buffer.
+// Copy count bytes from distance bytes back in the history to dst.
 
-static void copy_from_history(LHANewDecoder *decoder, uint8_t *buf,
-                              size_t *buf_len, size_t count)
+static void copy_match(uint8_t *dst, size_t distance, size_t count)
 {
-	int offset;
-	unsigned int i, start;
+	uint8_t *src;
+	size_t chunk;
 
-	offset = read_offset_code(decoder);
+	src = dst - distance;
 
-	if (offset < 0) {
+	if (distance >= count) {
+		memcpy(dst, src, count);
 		return;
 	}
 
-	start = decoder->ringbuf_pos + RING_BUFFER_SIZE
-	      - (unsigned int) offset - 1;
+	// The source overlaps the data being copied, so the last
+	// 'distance' bytes repeat as a pattern. Copy the pattern in
+	// chunks that double in size each time.
+
+	while (count > 0) {
+		chunk = (size_t) (dst - src);
 
-	for (i = 0; i < count; ++i) {
-		output_byte(decoder, buf, buf_len,
-		            decoder->ringbuf[(start + i) % RING_BUFFER_SIZE]);
+		if (chunk > count) {
+			chunk = count;
+		}
+
+		memcpy(dst, src, chunk);
+		dst += chunk;
+		count -= chunk;
 	}
 }
 
@@ -559,27 +652,48 @@ static int lhark_decode_copy_count(LHANewDecoder *decoder, int code)
 }
 #endif
 
-static size_t lha_lh_new_read(void *data, uint8_t *buf)
-{
-	LHANewDecoder *decoder = data;
-	size_t result;
-	int code, copy_count;
+// Read the next command code from the input stream, starting a new
+// block first if necessary. Codes below 256 are literal byte values;
+// the others are copy commands. Returns -1 for failure.
 
+static int read_command(LHANewDecoder *decoder)
+{
 	// Start of new block?
 
 	while (decoder->block_remaining == 0) {
 		if (!start_new_block(decoder)) {
-			return 0;
+			return -1;
 		}
 	}
 
 	--decoder->block_remaining;
 
-	// Read next command from input stream.
+	return read_code(decoder);
+}
 
-	result = 0;
+// Given a copy command code, return the number of bytes to copy, or -1
+// for failure.
+
+static int decode_copy_count(LHANewDecoder *decoder, int code)
+{
+#ifdef LHARK
+	return lhark_decode_copy_count(decoder, code);
+#else
+	(void) decoder;
+
+	return code - 256 + COPY_THRESHOLD;
+#endif
+}
+
+// Decode a single command into the history window. Returns the number
+// of bytes decoded, or zero for failure.
+
+static size_t decode_command(LHANewDecoder *decoder)
+{
+	size_t distance;
+	int code, copy_count;
 
-	code = read_code(decoder);
+	code = read_command(decoder);
 
 	if (code < 0) {
 		return 0;
@@ -588,30 +702,240 @@ static size_t lha_lh_new_read(void *data, uint8_t *buf)
 	// The code may be either a literal byte value or a copy command.
 
 	if (code < 256) {
-		output_byte(decoder, buf, &result, (uint8_t) code);
-	} else {
-#ifdef LHARK
-		copy_count = lhark_decode_copy_count(decoder, code);
-		if (copy_count < 0) {
-			return 0;
+		decoder->window[decoder->window_pos] = (uint8_t) code;
+		++decoder->window_pos;
+		return 1;
+	}
+
+	copy_count = decode_copy_count(decoder, code);
+
+	if (copy_count < 0) {
+		return 0;
+	}
+
+	distance = read_copy_distance(decoder);
+
+	if (distance == 0) {
+		return 0;
+	}
+
+	copy_match(decoder->window + decoder->window_pos, distance,
+	           (size_t) copy_count);
+	decoder->window_pos += (size_t) copy_count;
+
+	return (size_t) copy_count;
+}
+
+static size_t lha_lh_new_read(void *data, uint8_t *buf)
+{
+	LHANewDecoder *decoder = data;
+	size_t start, result;
+
+	check_window_space(decoder);
+
+	start = decoder->window_pos;
+	result = decode_command(decoder);
+	memcpy(buf, decoder->window + start, result);
+
+	return result;
+}
+
+// Decode as many commands as will fit into the specified buffer.
+// Commands are decoded into the window, and then copied out in one go.
+
+static size_t lha_lh_new_read_bulk(void *data, uint8_t *buf, size_t buf_len)
+{
+	LHANewDecoder *decoder = data;
+	size_t result, start, limit;
+	int failed;
+
+	result = 0;
+	failed = 0;
+
+	while (!failed && buf_len - result >= OUTPUT_BUFFER_SIZE) {
+		check_window_space(decoder);
+
+		// Decode commands while there is space for another in
+		// both the window and the output buffer.
+
+		start = decoder->window_pos;
+		limit = start + (buf_len - result - OUTPUT_BUFFER_SIZE);
+
+		if (limit > WINDOW_SIZE - OUTPUT_BUFFER_SIZE) {
+			limit = WINDOW_SIZE - OUTPUT_BUFFER_SIZE;
+		}
+
+		while (decoder->window_pos <= limit) {
+			if (decode_command(decoder) == 0) {
+				failed = 1;
+				break;
+			}
 		}
-#else
-		copy_count = code - 256 + COPY_THRESHOLD;
-#endif
 
-		copy_from_history(decoder, buf, &result, copy_count);
+		memcpy(buf + result, decoder->window + start,
+		       decoder->window_pos - start);
+		result += decoder->window_pos - start;
 	}
 
 	return result;
 }
 
+// Decode commands directly into a buffer holding all output from the
+// start of the stream. Copies read their history from the buffer itself,
+// so the window is not used at all.
+
+static size_t lha_lh_new_read_linear(void *data, uint8_t *buf, size_t pos,
+                                     size_t limit, size_t buf_len)
+{
+	LHANewDecoder *decoder = data;
+	size_t distance, count, i;
+	int code, copy_count;
+
+	while (pos < limit) {
+		code = read_command(decoder);
+
+		if (code < 0) {
+			break;
+		} else if (code < 256) {
+			buf[pos] = (uint8_t) code;
+			++pos;
+			continue;
+		}
+
+		copy_count = decode_copy_count(decoder, code);
+
+		if (copy_count < 0) {
+			break;
+		}
+
+		distance = read_copy_distance(decoder);
+
+		if (distance == 0) {
+			break;
+		}
+
+		// The last copy may run past the end of the stream.
+
+		count = (size_t) copy_count;
+
+		if (count > buf_len - pos) {
+			count = buf_len - pos;
+		}
+
+		// Near the start of the stream, a copy can reach back into
+		// the initial history, which is filled with spaces.
+
+		if (distance <= pos) {
+			copy_match(buf + pos, distance, count);
+		} else {
+			for (i = pos; i < pos + count; ++i) {
+				if (i >= distance) {
+					buf[i] = buf[i - distance];
+				} else {
+					buf[i] = ' ';
+				}
+			}
+		}
+
+		pos += count;
+	}
+
+	return pos;
+}
+
+// Save the state of the decoder. The history is taken from the window,
+// so this cannot be used after decoding with lha_lh_new_read_linear().
+
+static uint64_t lha_lh_new_save_state(void *data, uint8_t *buf)
+{
+	LHANewDecoder *decoder = data;
+	unsigned int i;
+	uint8_t *p;
+
+	memcpy(buf, decoder->window + decoder->window_pos - RING_BUFFER_SIZE,
+	       RING_BUFFER_SIZE);
+	p = buf + RING_BUFFER_SIZE;
+
+	lha_encode_uint32(p, decoder->block_remaining);
+	p += 4;
+
+	for (i = 0; i < NUM_CODES * 2; ++i) {
+		lha_encode_uint16(p, decoder->code_tree[i]);
+		p += 2;
+	}
+
+	for (i = 0; i < MAX_OFFSET_CODES * 2; ++i) {
+		lha_encode_uint16(p, decoder->offset_tree[i]);
+		p += 2;
+	}
+
+	return bit_stream_reader_position(&decoder->bit_stream_reader);
+}
+
+static int lha_lh_new_restore_state(void *data, uint8_t *buf,
+                                    uint64_t input_bits)
+{
+	LHANewDecoder *decoder = data;
+	unsigned int i;
+	uint8_t *p;
+
+	memcpy(decoder->window, buf, RING_BUFFER_SIZE);
+	decoder->window_pos = RING_BUFFER_SIZE;
+	decoder->window_dirty = 1;
+	p = buf + RING_BUFFER_SIZE;
+
+	decoder->block_remaining = lha_decode_uint32(p);
+	p += 4;
+
+	for (i = 0; i < NUM_CODES * 2; ++i) {
+		decoder->code_tree[i] = lha_decode_uint16(p);
+		p += 2;
+	}
+
+	for (i = 0; i < MAX_OFFSET_CODES * 2; ++i) {
+		decoder->offset_tree[i] = lha_decode_uint16(p);
+		p += 2;
+	}
+
+	// Codes are read from 9-bit fields, and offset codes from
+	// OFFSET_BITS-bit fields, so they can be no larger than this.
+
+	if (decoder->block_remaining > 0xffff
+	 || !check_tree(decoder->code_tree, NUM_CODES * 2, 1 << 9)
+	 || !check_tree(decoder->offset_tree, MAX_OFFSET_CODES * 2,
+	                1 << OFFSET_BITS)) {
+		return 0;
+	}
+
+	build_lookup_table(decoder->code_lookup, decoder->code_tree);
+	build_lookup_table(decoder->offset_lookup, decoder->offset_tree);
+
+	return bit_stream_reader_restore(&decoder->bit_stream_reader,
+	                                 input_bits);
+}
+
+static void lha_lh_new_set_borrow(void *data, LHADecoderBorrowCallback borrow)
+{
+	LHANewDecoder *decoder = data;
+
+	bit_stream_reader_set_borrow(&decoder->bit_stream_reader, borrow,
+	                             decoder->bit_stream_reader.callback_data);
+}
+
 LHADecoderType DECODER_NAME = {
 	lha_lh_new_init,
 	NULL,
 	lha_lh_new_read,
 	sizeof(LHANewDecoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE / 2
+	RING_BUFFER_SIZE / 2,
+	lha_lh_new_set_borrow,
+	lha_lh_new_read_bulk,
+	lha_lh_new_reset,
+	lha_lh_new_read_linear,
+	STATE_SIZE,
+	lha_lh_new_save_state,
+	lha_lh_new_restore_state
 };
 
 // This is a hack for -lh4-:
@@ -623,6 +947,13 @@ LHADecoderType DECODER2_NAME = {
 	lha_lh_new_read,
 	sizeof(LHANewDecoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE / 4
+	RING_BUFFER_SIZE / 4,
+	lha_lh_new_set_borrow,
+	lha_lh_new_read_bulk,
+	lha_lh_new_reset,
+	lha_lh_new_read_linear,
+	STATE_SIZE,
+	lha_lh_new_save_state,
+	lha_lh_new_restore_state
 };
 #endif
@@ -0,0 +1,1114 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Encoder for "new-style" LHA algorithms (-lh5-, -lh6-, -lh7-), which
+// generates the data read by lh_new_decoder.c.
+//
+// This file is designed to be a template. It is #included by other
+// files to generate an optimized encoder.
+//
+// Matches are found using hash chains: every position in the window is
+// inserted into a chain of earlier positions that start with the same
+// three bytes, which is searched for the longest match. How much of
+// the chain is searched, and whether a match is deferred in case there
+// is a longer one at the next position ("lazy" matching), depends on
+// the compression level.
+//
+// The commands found are collected into blocks, each with its own set
+// of Huffman codes. Commands are added to a block a segment at a time;
+// if a segment's statistics differ enough from those of the block so
+// far that it would be cheaper to code it separately, the block is
+// ended and a new one is started.
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lha_encoder.h"
+
+#include "bit_stream_writer.c"
+#include "tree_encode.c"
+
+// Threshold for copying. The first copy code starts from here.
+
+#define COPY_THRESHOLD       3 /* bytes */
+
+// Longest possible copy, given by the highest copy code.
+
+#define MAX_MATCH            (NUM_CODES - 1 - 256 + COPY_THRESHOLD)
+
+// Size of the dictionary, ie. how far back copies can reach. The
+// decoder's history is larger than this, but other implementations
+// only keep a history of this size.
+
+#define DICTIONARY_SIZE      (1 << HISTORY_BITS)
+#define MAX_DISTANCE         (DICTIONARY_SIZE - 1)
+
+// Amount of data that must be waiting to be compressed before the next
+// match is searched for, unless the end of the input has been reached:
+// enough for the longest match, at this or the next position.
+
+#define MIN_LOOKAHEAD        (MAX_MATCH + COPY_THRESHOLD + 1)
+
+// Data is read into a linear window. Once the current position reaches
+// the end of the second dictionary-sized half, the window is moved back
+// by DICTIONARY_SIZE bytes, so that the dictionary for the current
+// position is kept, with space after it for more data.
+
+#define WINDOW_SIZE          (DICTIONARY_SIZE * 2 + MIN_LOOKAHEAD)
+
+// Size of the hash table of chains of positions.
+
+#define HASH_BITS            15
+#define HASH_SIZE            (1 << HASH_BITS)
+
+// Position that marks the end of a hash chain.
+
+#define NIL                  0
+
+// Matches of the minimum length are not used if they are further back
+// than this, as the offset takes more bits than the bytes it replaces.
+
+#define TOO_FAR              4096
+
+// Number of offset codes: one for each possible number of bits in an
+// offset, including zero.
+
+#define NUM_OFFSET_CODES     (HISTORY_BITS + 1)
+
+// Number of codes in the "temporary table" used to encode the code
+// table: three codes to skip over unused codes, plus one for each code
+// length. The number is encoded using TEMP_CODE_BITS bits.
+
+#define TEMP_CODE_BITS       5
+#define NUM_TEMP_CODES       (MAX_CODE_LENGTH + 3)
+
+// Number of commands added to a block at a time, and the maximum
+// number of commands in a block.
+
+#define SEGMENT_COMMANDS     4096
+#define MAX_BLOCK_COMMANDS   (SEGMENT_COMMANDS * 8)
+
+// Required size of the output buffer: the most data that a single call
+// to read() might output. This is up to two blocks (when a block is
+// ended early at the end of the input), each with its tables, and
+// commands of at most 47 bits.
+
+#define OUTPUT_BUFFER_SIZE   (MAX_BLOCK_COMMANDS * 6 + 8192)
+
+// Parameters controlling the match search for a compression level.
+
+typedef struct {
+
+	// Once a match of this length has been found, only a quarter
+	// as much of the chain is searched for a better one.
+
+	unsigned int good_length;
+
+	// With lazy matching, matches of at least this length are used
+	// without looking for a longer match at the next position.
+	// Otherwise, matches longer than this are not inserted into the
+	// hash chains.
+
+	unsigned int max_lazy;
+
+	// Searching stops once a match of this length is found.
+
+	unsigned int nice_length;
+
+	// Maximum number of positions in a hash chain to search.
+
+	unsigned int max_chain;
+
+	// If non-zero, use lazy matching.
+
+	int lazy;
+
+} LevelConfig;
+
+static const LevelConfig level_configs[] = {
+	{  4,   4,   8,    4, 0 },  /* 1 */
+	{  4,   5,  16,    8, 0 },  /* 2 */
+	{  4,   6,  32,   32, 0 },  /* 3 */
+	{  4,   4,  16,   16, 1 },  /* 4 */
+	{  8,  16,  32,   32, 1 },  /* 5 */
+	{  8,  16, 128,  128, 1 },  /* 6 */
+	{  8,  32, 128,  256, 1 },  /* 7 */
+	{ 32, 128, 256, 1024, 1 },  /* 8 */
+	{ 32, 256, 256, 4096, 1 },  /* 9 */
+};
+
+typedef struct {
+
+	// Callback function to read data to compress.
+
+	LHAEncoderCallback callback;
+	void *callback_data;
+
+	// Output bit stream.
+
+	BitStreamWriter bit_stream_writer;
+
+	// Match search parameters for the compression level.
+
+	const LevelConfig *config;
+
+	// Window of data read from the input. Data before pos has been
+	// compressed; data from pos up to window_end has not.
+
+	uint8_t window[WINDOW_SIZE];
+	unsigned int pos, window_end;
+
+	// If non-zero, the end of the input has been reached.
+
+	int eof;
+
+	// If non-zero, all the compressed data has been output, and the
+	// number of zero bits added to pad it to a whole byte.
+
+	int finished;
+	unsigned int padding_bits;
+
+	// Hash chains: head contains the most recent position for each
+	// hash value, and prev the previous position with the same hash
+	// value as each position in the dictionary.
+
+	uint32_t head[HASH_SIZE];
+	uint32_t prev[DICTIONARY_SIZE];
+
+	// Longest match found at the previous position, for lazy matching,
+	// and whether the byte at the previous position is waiting to be
+	// output.
+
+	unsigned int match_length, match_start;
+	int match_available;
+
+	// Commands waiting to be written. For each command, the code,
+	// and for copies, the offset. The first block_commands commands
+	// are in the current block; the rest are the current segment.
+
+	uint16_t codes[MAX_BLOCK_COMMANDS];
+	uint16_t offsets[MAX_BLOCK_COMMANDS];
+	unsigned int block_commands, num_commands;
+
+	// Number of times each code and offset code is used in the
+	// current block, and in the current segment.
+
+	unsigned int block_code_freq[NUM_CODES];
+	unsigned int block_offset_freq[NUM_OFFSET_CODES];
+	unsigned int code_freq[NUM_CODES];
+	unsigned int offset_freq[NUM_OFFSET_CODES];
+
+} LHANewEncoder;
+
+static int lha_lh_new_encoder_init(void *data, int level,
+                                   LHAEncoderCallback callback,
+                                   void *callback_data)
+{
+	LHANewEncoder *encoder = data;
+
+	encoder->callback = callback;
+	encoder->callback_data = callback_data;
+	encoder->config = &level_configs[level - LHA_ENCODER_MIN_LEVEL];
+
+	bit_stream_writer_init(&encoder->bit_stream_writer);
+
+	// The window and hash chains start empty. The rest of the
+	// structure has already been zeroed.
+
+	encoder->pos = 0;
+	encoder->window_end = 0;
+	encoder->eof = 0;
+	encoder->finished = 0;
+
+	encoder->match_length = COPY_THRESHOLD - 1;
+	encoder->match_available = 0;
+
+	encoder->block_commands = 0;
+	encoder->num_commands = 0;
+
+	return 1;
+}
+
+// Get the offset code for an offset: the number of bits in the offset.
+
+static unsigned int offset_code(unsigned int offset)
+{
+	unsigned int bits = 0;
+
+	while (offset >= 16) {
+		offset >>= 4;
+		bits += 4;
+	}
+
+	while (offset > 0) {
+		offset >>= 1;
+		++bits;
+	}
+
+	return bits;
+}
+
+// Add a command to output a literal byte to the current segment.
+
+static void add_literal(LHANewEncoder *encoder, unsigned int c)
+{
+	encoder->codes[encoder->num_commands] = (uint16_t) c;
+	++encoder->num_commands;
+	++encoder->code_freq[c];
+}
+
+// Add a command to copy count bytes from distance bytes back to the
+// current segment.
+
+static void add_copy(LHANewEncoder *encoder, unsigned int count,
+                     unsigned int distance)
+{
+	unsigned int code;
+
+	code = 256 + count - COPY_THRESHOLD;
+
+	encoder->codes[encoder->num_commands] = (uint16_t) code;
+	encoder->offsets[encoder->num_commands] = (uint16_t) (distance - 1);
+	++encoder->num_commands;
+	++encoder->code_freq[code];
+	++encoder->offset_freq[offset_code(distance - 1)];
+}
+
+// Move the window back by DICTIONARY_SIZE bytes, adjusting all the
+// positions that point into it.
+
+static void slide_window(LHANewEncoder *encoder)
+{
+	unsigned int i;
+
+	memmove(encoder->window, encoder->window + DICTIONARY_SIZE,
+	        encoder->window_end - DICTIONARY_SIZE);
+	encoder->pos -= DICTIONARY_SIZE;
+	encoder->window_end -= DICTIONARY_SIZE;
+
+	if (encoder->match_start >= DICTIONARY_SIZE) {
+		encoder->match_start -= DICTIONARY_SIZE;
+	} else {
+		encoder->match_start = NIL;
+	}
+
+	// Positions that have been moved out of the window are now too
+	// far back to be used, so they become the end of their chain.
+
+	for (i = 0; i < HASH_SIZE; ++i) {
+		if (encoder->head[i] >= DICTIONARY_SIZE) {
+			encoder->head[i] -= DICTIONARY_SIZE;
+		} else {
+			encoder->head[i] = NIL;
+		}
+	}
+
+	for (i = 0; i < DICTIONARY_SIZE; ++i) {
+		if (encoder->prev[i] >= DICTIONARY_SIZE) {
+			encoder->prev[i] -= DICTIONARY_SIZE;
+		} else {
+			encoder->prev[i] = NIL;
+		}
+	}
+}
+
+// Read more data into the window, moving it back first if necessary,
+// until there is enough data waiting to find the next match.
+
+static void fill_window(LHANewEncoder *encoder)
+{
+	size_t bytes;
+
+	if (encoder->pos >= DICTIONARY_SIZE * 2) {
+		slide_window(encoder);
+	}
+
+	while (!encoder->eof
+	    && encoder->window_end - encoder->pos < MIN_LOOKAHEAD) {
+		bytes = encoder->callback(encoder->window + encoder->window_end,
+		                          WINDOW_SIZE - encoder->window_end,
+		                          encoder->callback_data);
+
+		if (bytes == 0) {
+			encoder->eof = 1;
+		}
+
+		encoder->window_end += (unsigned int) bytes;
+	}
+}
+
+// Insert the string at the specified position into its hash chain.
+// There must be at least COPY_THRESHOLD bytes of data at the position.
+// Returns the previous head of the chain.
+
+static unsigned int insert_string(LHANewEncoder *encoder, unsigned int pos)
+{
+	const uint8_t *p;
+	uint32_t hash;
+	unsigned int result;
+
+	p = encoder->window + pos;
+	hash = ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+	hash = ((hash * 0x9e3779b1U) & 0xffffffffU) >> (32 - HASH_BITS);
+
+	result = encoder->head[hash];
+	encoder->prev[pos & (DICTIONARY_SIZE - 1)] = result;
+	encoder->head[hash] = pos;
+
+	return result;
+}
+
+// Count how many bytes are the same at the start of two strings, up to
+// a maximum of max_len.
+
+static unsigned int common_length(const uint8_t *a, const uint8_t *b,
+                                  unsigned int max_len)
+{
+	uint64_t x, y;
+	unsigned int len;
+
+	len = 0;
+
+	while (len + 8 <= max_len) {
+		memcpy(&x, a + len, 8);
+		memcpy(&y, b + len, 8);
+
+		if (x != y) {
+			break;
+		}
+
+		len += 8;
+	}
+
+	while (len < max_len && a[len] == b[len]) {
+		++len;
+	}
+
+	return len;
+}
+
+// Search the hash chain starting at cur_match for the longest match for
+// the data at the current position, that is longer than best_len.
+// Returns the length of the longest match, or best_len if no longer
+// match was found; match_start is set to the position of the match.
+
+static unsigned int longest_match(LHANewEncoder *encoder,
+                                  unsigned int cur_match,
+                                  unsigned int best_len)
+{
+	const uint8_t *scan, *match;
+	unsigned int chain, limit, max_len, nice_len, len;
+
+	max_len = encoder->window_end - encoder->pos;
+
+	if (max_len > MAX_MATCH) {
+		max_len = MAX_MATCH;
+	}
+
+	if (best_len >= max_len) {
+		return max_len;
+	}
+
+	nice_len = encoder->config->nice_length;
+
+	if (nice_len > max_len) {
+		nice_len = max_len;
+	}
+
+	chain = encoder->config->max_chain;
+
+	if (best_len >= encoder->config->good_length) {
+		chain >>= 2;
+	}
+
+	if (encoder->pos > MAX_DISTANCE) {
+		limit = encoder->pos - MAX_DISTANCE;
+	} else {
+		limit = NIL;
+	}
+
+	scan = encoder->window + encoder->pos;
+
+	do {
+		match = encoder->window + cur_match;
+
+		// Check the bytes that would make this match longer than
+		// the best so far first, as they are the least likely to
+		// match.
+
+		if (match[best_len] != scan[best_len]
+		 || match[best_len - 1] != scan[best_len - 1]
+		 || match[0] != scan[0] || match[1] != scan[1]) {
+			continue;
+		}
+
+		len = common_length(scan, match, max_len);
+
+		if (len > best_len) {
+			encoder->match_start = cur_match;
+			best_len = len;
+
+			if (len >= nice_len) {
+				break;
+			}
+		}
+	} while ((cur_match = encoder->prev[cur_match & (DICTIONARY_SIZE - 1)])
+	           > limit && --chain != 0);
+
+	return best_len;
+}
+
+// Set the data that comes before the data to compress. It is put into
+// the window and hash chains as if it had already been compressed.
+
+static void lha_lh_new_encoder_set_history(void *data, const uint8_t *buf,
+                                           size_t buf_len)
+{
+	LHANewEncoder *encoder = data;
+	unsigned int i;
+
+	if (buf_len > DICTIONARY_SIZE) {
+		buf += buf_len - DICTIONARY_SIZE;
+		buf_len = DICTIONARY_SIZE;
+	}
+
+	memcpy(encoder->window, buf, buf_len);
+	encoder->pos = (unsigned int) buf_len;
+	encoder->window_end = (unsigned int) buf_len;
+
+	for (i = 0; i + COPY_THRESHOLD <= buf_len; ++i) {
+		insert_string(encoder, i);
+	}
+}
+
+// Returns non-zero if the current segment is full.
+
+static int segment_full(LHANewEncoder *encoder)
+{
+	return encoder->num_commands - encoder->block_commands
+	    >= SEGMENT_COMMANDS;
+}
+
+// Find commands to add to the current segment, using greedy matching:
+// the longest match at each position is always used. Stops when the
+// segment is full or the end of the input has been reached.
+
+static void find_commands_greedy(LHANewEncoder *encoder)
+{
+	unsigned int hash_head, len, end, max_insert;
+
+	while (!segment_full(encoder)) {
+		if (encoder->window_end - encoder->pos < MIN_LOOKAHEAD) {
+			fill_window(encoder);
+
+			if (encoder->pos >= encoder->window_end) {
+				break;
+			}
+		}
+
+		len = 0;
+
+		if (encoder->window_end - encoder->pos >= COPY_THRESHOLD) {
+			hash_head = insert_string(encoder, encoder->pos);
+
+			if (hash_head != NIL
+			 && encoder->pos - hash_head <= MAX_DISTANCE) {
+				len = longest_match(encoder, hash_head,
+				                    COPY_THRESHOLD - 1);
+			}
+
+			if (len == COPY_THRESHOLD
+			 && encoder->pos - encoder->match_start > TOO_FAR) {
+				len = 0;
+			}
+		}
+
+		if (len < COPY_THRESHOLD) {
+			add_literal(encoder, encoder->window[encoder->pos]);
+			++encoder->pos;
+			continue;
+		}
+
+		add_copy(encoder, len, encoder->pos - encoder->match_start);
+
+		// Insert the rest of the match into the hash chains, unless
+		// it is long, when it is quicker to skip over it.
+
+		end = encoder->pos + len;
+
+		if (len <= encoder->config->max_lazy) {
+			max_insert = encoder->window_end - COPY_THRESHOLD;
+
+			for (++encoder->pos; encoder->pos < end;
+			     ++encoder->pos) {
+				if (encoder->pos <= max_insert) {
+					insert_string(encoder, encoder->pos);
+				}
+			}
+		}
+
+		encoder->pos = end;
+	}
+}
+
+// Find commands to add to the current segment, using lazy matching:
+// before a match is used, the next position is checked for a longer
+// match, and if there is one, a literal is output instead. Stops when
+// the segment is full or the end of the input has been reached.
+
+static void find_commands_lazy(LHANewEncoder *encoder)
+{
+	unsigned int hash_head, prev_length, prev_match, end, max_insert;
+
+	while (!segment_full(encoder)) {
+		if (encoder->window_end - encoder->pos < MIN_LOOKAHEAD) {
+			fill_window(encoder);
+
+			// At the end of the input, output the last byte if
+			// it is still waiting.
+
+			if (encoder->pos >= encoder->window_end) {
+				if (encoder->match_available) {
+					add_literal(encoder,
+					  encoder->window[encoder->pos - 1]);
+					encoder->match_available = 0;
+				}
+
+				break;
+			}
+		}
+
+		hash_head = NIL;
+
+		if (encoder->window_end - encoder->pos >= COPY_THRESHOLD) {
+			hash_head = insert_string(encoder, encoder->pos);
+		}
+
+		// Look for a match at this position, unless the match at
+		// the previous position is already long enough.
+
+		prev_length = encoder->match_length;
+		prev_match = encoder->match_start;
+		encoder->match_length = COPY_THRESHOLD - 1;
+
+		if (hash_head != NIL && prev_length < encoder->config->max_lazy
+		 && encoder->pos - hash_head <= MAX_DISTANCE) {
+			encoder->match_length =
+			    longest_match(encoder, hash_head, prev_length);
+
+			if (encoder->match_length == COPY_THRESHOLD
+			 && encoder->pos - encoder->match_start > TOO_FAR) {
+				encoder->match_length = COPY_THRESHOLD - 1;
+			}
+		}
+
+		// If the match at the previous position was at least as
+		// long, use it.
+
+		if (prev_length >= COPY_THRESHOLD
+		 && encoder->match_length <= prev_length) {
+			add_copy(encoder, prev_length,
+			         encoder->pos - 1 - prev_match);
+
+			// Insert the rest of the match into the hash
+			// chains. The first two positions have already
+			// been inserted.
+
+			end = encoder->pos - 1 + prev_length;
+			max_insert = encoder->window_end - COPY_THRESHOLD;
+
+			for (++encoder->pos; encoder->pos < end;
+			     ++encoder->pos) {
+				if (encoder->pos <= max_insert) {
+					insert_string(encoder, encoder->pos);
+				}
+			}
+
+			encoder->match_available = 0;
+			encoder->match_length = COPY_THRESHOLD - 1;
+		} else if (encoder->match_available) {
+
+			// No match at the previous position, or there is
+			// a longer one here; output the previous byte.
+
+			add_literal(encoder, encoder->window[encoder->pos - 1]);
+			++encoder->pos;
+		} else {
+			encoder->match_available = 1;
+			++encoder->pos;
+		}
+	}
+}
+
+// Returns non-zero if all of the input has been added to commands.
+
+static int input_finished(LHANewEncoder *encoder)
+{
+	return encoder->eof && encoder->pos >= encoder->window_end
+	    && !encoder->match_available;
+}
+
+// Get the first symbol that is used, given the frequencies of a set of
+// symbols, or zero if none are used.
+
+static unsigned int first_used(const unsigned int *freq,
+                               unsigned int num_symbols)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_symbols; ++i) {
+		if (freq[i] != 0) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+// Estimate the number of bits needed to encode a block, given the
+// frequencies of the codes and offset codes used in it. The extra bits
+// that follow offset codes are not included.
+
+static unsigned long estimate_block_bits(const unsigned int *code_freq,
+                                         const unsigned int *offset_freq)
+{
+	uint8_t code_lengths[NUM_CODES];
+	uint8_t offset_lengths[NUM_OFFSET_CODES];
+	unsigned long result;
+	unsigned int i;
+
+	build_code_lengths(code_freq, NUM_CODES, code_lengths);
+	build_code_lengths(offset_freq, NUM_OFFSET_CODES, offset_lengths);
+
+	// The tables take roughly this many bits, plus a few bits for
+	// each code that is used.
+
+	result = 100;
+
+	for (i = 0; i < NUM_CODES; ++i) {
+		if (code_freq[i] != 0) {
+			result += (unsigned long) code_freq[i]
+			        * code_lengths[i] + 4;
+		}
+	}
+
+	for (i = 0; i < NUM_OFFSET_CODES; ++i) {
+		if (offset_freq[i] != 0) {
+			result += (unsigned long) offset_freq[i]
+			        * offset_lengths[i] + 3;
+		}
+	}
+
+	return result;
+}
+
+// Returns non-zero if the current block should be ended before the
+// current segment, because the block and segment can be encoded in
+// fewer bits as separate blocks than together.
+
+static int should_split_block(LHANewEncoder *encoder)
+{
+	unsigned int code_freq[NUM_CODES];
+	unsigned int offset_freq[NUM_OFFSET_CODES];
+	unsigned long separate;
+	unsigned int i;
+
+	for (i = 0; i < NUM_CODES; ++i) {
+		code_freq[i] = encoder->block_code_freq[i]
+		             + encoder->code_freq[i];
+	}
+
+	for (i = 0; i < NUM_OFFSET_CODES; ++i) {
+		offset_freq[i] = encoder->block_offset_freq[i]
+		               + encoder->offset_freq[i];
+	}
+
+	separate = estimate_block_bits(encoder->block_code_freq,
+	                               encoder->block_offset_freq)
+	         + estimate_block_bits(encoder->code_freq,
+	                               encoder->offset_freq);
+
+	return separate < estimate_block_bits(code_freq, offset_freq);
+}
+
+// Add the commands in the current segment to the current block.
+
+static void add_segment_to_block(LHANewEncoder *encoder)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_CODES; ++i) {
+		encoder->block_code_freq[i] += encoder->code_freq[i];
+		encoder->code_freq[i] = 0;
+	}
+
+	for (i = 0; i < NUM_OFFSET_CODES; ++i) {
+		encoder->block_offset_freq[i] += encoder->offset_freq[i];
+		encoder->offset_freq[i] = 0;
+	}
+
+	encoder->block_commands = encoder->num_commands;
+}
+
+// Write a length value, as read by read_length_value(): a 3-bit value,
+// with lengths of 7 or more extended by a '1' bit for each extra unit,
+// followed by a '0'.
+
+static void write_length_value(BitStreamWriter *writer, unsigned int len)
+{
+	if (len < 7) {
+		write_bits(writer, 3, len);
+	} else {
+		write_bits(writer, 3, 7);
+		write_bits(writer, len - 6, ((1U << (len - 7)) - 1) << 1);
+	}
+}
+
+// Write a table of code lengths in the format read by read_temp_table()
+// and read_offset_table(). For the temp table, there is a 2-bit field
+// after the third length, giving a number of zero lengths to skip.
+
+static void write_length_table(BitStreamWriter *writer,
+                               const uint8_t *lengths,
+                               unsigned int num_codes,
+                               unsigned int count_bits,
+                               int skip_field)
+{
+	unsigned int i, n, skip;
+
+	n = num_codes;
+
+	while (n > 0 && lengths[n - 1] == 0) {
+		--n;
+	}
+
+	write_bits(writer, count_bits, n);
+
+	for (i = 0; i < n; ++i) {
+		write_length_value(writer, lengths[i]);
+
+		if (skip_field && i == 2) {
+			for (skip = 0; skip < 3 && i + 1 < n
+			            && lengths[i + 1] == 0; ++skip) {
+				++i;
+			}
+
+			write_bits(writer, 2, skip);
+		}
+	}
+}
+
+// Get the number of unused codes in a run starting at the specified
+// code, given the code lengths.
+
+static unsigned int unused_run(const uint8_t *code_lengths,
+                               unsigned int start, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = start; i < n && code_lengths[i] == 0; ++i);
+
+	return i - start;
+}
+
+// Get the number of codes in the code table, leaving out unused codes
+// at the end.
+
+static unsigned int code_table_length(const uint8_t *code_lengths)
+{
+	unsigned int n;
+
+	for (n = NUM_CODES; n > 0 && code_lengths[n - 1] == 0; --n);
+
+	return n;
+}
+
+// Count how many times each temp code is used to encode the code
+// table, in the way that write_code_table() does.
+
+static void count_temp_freq(const uint8_t *code_lengths,
+                            unsigned int *temp_freq)
+{
+	unsigned int i, n, run;
+
+	memset(temp_freq, 0, sizeof(unsigned int) * NUM_TEMP_CODES);
+
+	n = code_table_length(code_lengths);
+	i = 0;
+
+	while (i < n) {
+		run = unused_run(code_lengths, i, n);
+
+		if (run == 0) {
+			++temp_freq[code_lengths[i] + 2];
+			++i;
+			continue;
+		}
+
+		if (run <= 2) {
+			temp_freq[0] += run;
+		} else if (run <= 18) {
+			++temp_freq[1];
+		} else if (run == 19) {
+			++temp_freq[0];
+			++temp_freq[1];
+		} else {
+			++temp_freq[2];
+		}
+
+		i += run;
+	}
+}
+
+// Write the code table, in the format read by read_code_table(), with
+// each length encoded using the temp table. Codes 0-2 skip over runs
+// of unused codes (see read_skip_count()).
+
+static void write_code_table(BitStreamWriter *writer,
+                             const uint8_t *code_lengths,
+                             const uint8_t *temp_lengths,
+                             const uint16_t *temp_codes)
+{
+	unsigned int i, n, run, len;
+
+	n = code_table_length(code_lengths);
+	write_bits(writer, 9, n);
+	i = 0;
+
+	while (i < n) {
+		run = unused_run(code_lengths, i, n);
+
+		if (run == 0) {
+			len = code_lengths[i] + 2;
+			write_bits(writer, temp_lengths[len], temp_codes[len]);
+			++i;
+			continue;
+		}
+
+		if (run <= 2) {
+			for (len = 0; len < run; ++len) {
+				write_bits(writer, temp_lengths[0],
+				           temp_codes[0]);
+			}
+		} else if (run <= 18) {
+			write_bits(writer, temp_lengths[1], temp_codes[1]);
+			write_bits(writer, 4, run - 3);
+		} else if (run == 19) {
+			write_bits(writer, temp_lengths[0], temp_codes[0]);
+			write_bits(writer, temp_lengths[1], temp_codes[1]);
+			write_bits(writer, 4, 15);
+		} else {
+			write_bits(writer, temp_lengths[2], temp_codes[2]);
+			write_bits(writer, 9, run - 20);
+		}
+
+		i += run;
+	}
+}
+
+// Write the tables at the start of a block, in the format read by
+// start_new_block(), returning the code lengths for the block.
+
+static void write_tables(LHANewEncoder *encoder, uint8_t *code_lengths,
+                         uint8_t *offset_lengths)
+{
+	BitStreamWriter *writer = &encoder->bit_stream_writer;
+	unsigned int temp_freq[NUM_TEMP_CODES];
+	uint8_t temp_lengths[NUM_TEMP_CODES];
+	uint16_t temp_codes[NUM_TEMP_CODES];
+	unsigned int n;
+
+	n = build_code_lengths(encoder->block_code_freq, NUM_CODES,
+	                       code_lengths);
+
+	// If only one code is used, it is stored in place of the code
+	// table. There must still be a temp table, although it is not
+	// used.
+
+	if (n < 2) {
+		write_bits(writer, TEMP_CODE_BITS, 0);
+		write_bits(writer, TEMP_CODE_BITS, 0);
+		write_bits(writer, 9, 0);
+		write_bits(writer, 9,
+		           first_used(encoder->block_code_freq, NUM_CODES));
+	} else {
+		count_temp_freq(code_lengths, temp_freq);
+		n = build_code_lengths(temp_freq, NUM_TEMP_CODES,
+		                       temp_lengths);
+
+		if (n < 2) {
+			write_bits(writer, TEMP_CODE_BITS, 0);
+			write_bits(writer, TEMP_CODE_BITS,
+			           first_used(temp_freq, NUM_TEMP_CODES));
+		} else {
+			write_length_table(writer, temp_lengths,
+			                   NUM_TEMP_CODES, TEMP_CODE_BITS, 1);
+		}
+
+		build_codes(temp_lengths, NUM_TEMP_CODES, temp_codes);
+		write_code_table(writer, code_lengths,
+		                 temp_lengths, temp_codes);
+	}
+
+	// Offset table. If there are no copies in the block, no offset
+	// codes are used, and any single code can be stored.
+
+	n = build_code_lengths(encoder->block_offset_freq, NUM_OFFSET_CODES,
+	                       offset_lengths);
+
+	if (n < 2) {
+		write_bits(writer, OFFSET_BITS, 0);
+		write_bits(writer, OFFSET_BITS,
+		           first_used(encoder->block_offset_freq,
+		                      NUM_OFFSET_CODES));
+	} else {
+		write_length_table(writer, offset_lengths, NUM_OFFSET_CODES,
+		                   OFFSET_BITS, 0);
+	}
+}
+
+// Write the current block to the output, and start a new block
+// containing the commands in the current segment.
+
+static void write_block(LHANewEncoder *encoder)
+{
+	BitStreamWriter *writer = &encoder->bit_stream_writer;
+	uint8_t code_lengths[NUM_CODES];
+	uint8_t offset_lengths[NUM_OFFSET_CODES];
+	uint16_t code_codes[NUM_CODES];
+	uint16_t offset_codes[NUM_OFFSET_CODES];
+	unsigned int i, code, offset, bits;
+
+	write_bits(writer, 16, encoder->block_commands);
+	write_tables(encoder, code_lengths, offset_lengths);
+
+	build_codes(code_lengths, NUM_CODES, code_codes);
+	build_codes(offset_lengths, NUM_OFFSET_CODES, offset_codes);
+
+	for (i = 0; i < encoder->block_commands; ++i) {
+		code = encoder->codes[i];
+		write_bits(writer, code_lengths[code], code_codes[code]);
+
+		if (code < 256) {
+			continue;
+		}
+
+		// The offset code is the number of bits in the offset;
+		// the bits below the top bit follow it.
+
+		offset = encoder->offsets[i];
+		bits = offset_code(offset);
+		write_bits(writer, offset_lengths[bits], offset_codes[bits]);
+
+		if (bits > 1) {
+			write_bits(writer, bits - 1,
+			           offset - (1U << (bits - 1)));
+		}
+	}
+
+	// Move the current segment to the start of the new block.
+
+	memmove(encoder->codes, encoder->codes + encoder->block_commands,
+	        (encoder->num_commands - encoder->block_commands)
+	          * sizeof(uint16_t));
+	memmove(encoder->offsets, encoder->offsets + encoder->block_commands,
+	        (encoder->num_commands - encoder->block_commands)
+	          * sizeof(uint16_t));
+	encoder->num_commands -= encoder->block_commands;
+	encoder->block_commands = 0;
+
+	memset(encoder->block_code_freq, 0,
+	       sizeof(encoder->block_code_freq));
+	memset(encoder->block_offset_freq, 0,
+	       sizeof(encoder->block_offset_freq));
+}
+
+static size_t lha_lh_new_encoder_read(void *data, uint8_t *buf)
+{
+	LHANewEncoder *encoder = data;
+	BitStreamWriter *writer = &encoder->bit_stream_writer;
+	int end;
+
+	if (encoder->finished) {
+		return 0;
+	}
+
+	bit_stream_writer_set_buffer(writer, buf);
+
+	// Find commands a segment at a time, until there is a block
+	// to output.
+
+	do {
+		if (encoder->config->lazy) {
+			find_commands_lazy(encoder);
+		} else {
+			find_commands_greedy(encoder);
+		}
+
+		end = input_finished(encoder);
+
+		if (encoder->num_commands > encoder->block_commands) {
+			if (encoder->block_commands > 0
+			 && should_split_block(encoder)) {
+				write_block(encoder);
+			}
+
+			add_segment_to_block(encoder);
+		}
+
+		// End the block if another segment will not fit.
+
+		if (encoder->block_commands > 0
+		 && (end || encoder->block_commands + SEGMENT_COMMANDS
+		              > MAX_BLOCK_COMMANDS)) {
+			write_block(encoder);
+		}
+
+		if (end) {
+			encoder->padding_bits =
+			    bit_stream_writer_finish(writer);
+			encoder->finished = 1;
+			break;
+		}
+	} while (writer->buf_len == 0 && writer->bits < 8);
+
+	bit_stream_writer_flush(writer);
+
+	return writer->buf_len;
+}
+
+static unsigned int lha_lh_new_encoder_padding_bits(void *data)
+{
+	LHANewEncoder *encoder = data;
+
+	return encoder->padding_bits;
+}
+
+LHAEncoderType ENCODER_NAME = {
+	lha_lh_new_encoder_init,
+	NULL,
+	lha_lh_new_encoder_read,
+	sizeof(LHANewEncoder),
+	OUTPUT_BUFFER_SIZE,
+	lha_lh_new_encoder_set_history,
+	DICTIONARY_SIZE,
+	lha_lh_new_encoder_padding_bits
+};
@@ -134,6 +134,56 @@ int lha_arch_set_windows_timestamps(char *filename,
 FILE *lha_arch_fopen(char *filename, int unix_uid,
                      int unix_gid, int unix_perms);
 
+/**
+ * Reserve disk space for a file that is about to be written, so that
+ * it can be allocated contiguously. The file length is not changed.
+ * Not all systems support this, so failure is not an error.
+ *
+ * @param fstream     File handle returned by @ref lha_arch_fopen.
+ * @param length      Expected final length of the file, in bytes.
+ * @return            Non-zero if space was reserved.
+ */
+
+int lha_arch_preallocate(FILE *fstream, uint64_t length);
+
+/**
+ * Write data to a file returned by @ref lha_arch_fopen, bypassing the
+ * C library's buffering. Data must not also be written to the file
+ * through stdio functions.
+ *
+ * @param fstream     File handle.
+ * @param buf         Pointer to the data to write.
+ * @param len         Length of the data, in bytes.
+ * @return            Non-zero if all the data was written, or zero
+ *                    for failure.
+ */
+
+int lha_arch_write(FILE *fstream, const void *buf, size_t len);
+
+/**
+ * Move the write position of a file returned by @ref lha_arch_fopen
+ * forwards, without writing anything. If data is later written after
+ * the end of the file, the gap reads as zeros, and on systems that
+ * support sparse files, does not take up any disk space.
+ *
+ * @param fstream     File handle.
+ * @param offset      Number of bytes to skip.
+ * @return            Non-zero for success, or zero for failure.
+ */
+
+int lha_arch_skip(FILE *fstream, uint64_t offset);
+
+/**
+ * Set the length of a file returned by @ref lha_arch_fopen to the
+ * current write position. This is needed after @ref lha_arch_skip
+ * has been used to skip over the end of the file.
+ *
+ * @param fstream     File handle.
+ * @return            Non-zero for success, or zero for failure.
+ */
+
+int lha_arch_truncate(FILE *fstream);
+
 /**
  * Query whether the specified file exists.
  *
@@ -156,4 +206,149 @@ LHAFileType lha_arch_exists(char *filename);
 
 int lha_arch_symlink(char *path, char *target);
 
+/**
+ * Map the contents of a file into memory, for reading.
+ *
+ * @param filename    Path to the file.
+ * @param len         Pointer to a variable in which to store the length
+ *                    of the file, in bytes.
+ * @return            Pointer to the mapped file contents, or NULL if the
+ *                    file could not be mapped.
+ */
+
+void *lha_arch_map_file(char *filename, size_t *len);
+
+/**
+ * Extend a file returned by @ref lha_arch_fopen to the specified
+ * length, and map it into memory for writing. Disk space for the whole
+ * file is allocated first, so that writing to the mapping cannot fail
+ * because the disk is full. Not all systems support this, so failure
+ * is not an error; the file can be written normally instead.
+ *
+ * @param fstream     File handle. Nothing must have been written yet.
+ * @param len         Length of the file, in bytes.
+ * @return            Pointer to the mapped file contents, or NULL if the
+ *                    file could not be mapped.
+ */
+
+void *lha_arch_map_output(FILE *fstream, size_t len);
+
+/**
+ * Unmap a file previously mapped with @ref lha_arch_map_file or
+ * @ref lha_arch_map_output.
+ *
+ * @param data        Pointer to the mapped file contents.
+ * @param len         Length of the file, in bytes.
+ */
+
+void lha_arch_unmap_file(void *data, size_t len);
+
+/**
+ * Get the size and modification time of a file.
+ *
+ * @param filename    Path to the file.
+ * @param size        Pointer to a variable in which to store the size
+ *                    of the file, in bytes.
+ * @param mtime       Pointer to a variable in which to store the
+ *                    modification time of the file. The units are
+ *                    system-specific; the value is only useful for
+ *                    checking whether a file has changed.
+ * @return            Non-zero for success, or zero for failure.
+ */
+
+int lha_arch_file_info(char *filename, uint64_t *size, uint64_t *mtime);
+
+/**
+ * Get the number of CPUs available to the running process.
+ *
+ * @return            Number of CPUs (at least one).
+ */
+
+unsigned int lha_arch_num_cpus(void);
+
+/**
+ * Opaque type representing a running thread.
+ */
+
+typedef struct _LHAArchThread LHAArchThread;
+
+/**
+ * Opaque type representing a mutex with an associated condition
+ * variable, used to wait for a condition set by another thread.
+ */
+
+typedef struct _LHAArchMonitor LHAArchMonitor;
+
+/**
+ * Start a new thread.
+ *
+ * @param callback    Function to run in the new thread.
+ * @param data        Pointer to pass to the function.
+ * @return            Pointer to the new thread, or NULL if it could not
+ *                    be started (including if threads are not
+ *                    supported on this system).
+ */
+
+LHAArchThread *lha_arch_thread_start(void (*callback)(void *data),
+                                     void *data);
+
+/**
+ * Wait for a thread to finish, and free it.
+ *
+ * @param thread      The thread.
+ */
+
+void lha_arch_thread_join(LHAArchThread *thread);
+
+/**
+ * Create a new monitor.
+ *
+ * @return            Pointer to the new monitor, or NULL for failure
+ *                    (including if threads are not supported on this
+ *                    system).
+ */
+
+LHAArchMonitor *lha_arch_monitor_new(void);
+
+/**
+ * Free a monitor.
+ *
+ * @param monitor     The monitor.
+ */
+
+void lha_arch_monitor_free(LHAArchMonitor *monitor);
+
+/**
+ * Lock a monitor's mutex.
+ *
+ * @param monitor     The monitor.
+ */
+
+void lha_arch_monitor_lock(LHAArchMonitor *monitor);
+
+/**
+ * Unlock a monitor's mutex.
+ *
+ * @param monitor     The monitor.
+ */
+
+void lha_arch_monitor_unlock(LHAArchMonitor *monitor);
+
+/**
+ * Wait on a monitor's condition variable. The mutex must be locked;
+ * it is unlocked while waiting, and locked again before returning.
+ *
+ * @param monitor     The monitor.
+ */
+
+void lha_arch_monitor_wait(LHAArchMonitor *monitor);
+
+/**
+ * Wake all threads waiting on a monitor's condition variable.
+ *
+ * @param monitor     The monitor.
+ */
+
+void lha_arch_monitor_notify(LHAArchMonitor *monitor);
+
 #endif /* ifndef LHASA_LHA_ARCH_H */
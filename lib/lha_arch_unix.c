@@ -28,13 +28,21 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #if LHA_ARCH == LHA_ARCH_UNIX
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <utime.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "config.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 // TODO: This file depends on vasprintf(), which is a non-standard
 // function (_GNU_SOURCE above). Most modern Unix systems have an
 // implementation of it, but develop a compatible workaround for
@@ -92,9 +100,10 @@ FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
 	// to the current user.
 	// Use O_EXCL so that symlinks are not followed; this prevents
 	// a malicious symlink from overwriting arbitrary filesystem
-	// locations.
+	// locations. The file is opened for reading as well as writing,
+	// as this is needed to map it (see lha_arch_map_output).
 
-	fileno = open(filename, O_CREAT|O_WRONLY|O_EXCL, 0600);
+	fileno = open(filename, O_CREAT|O_RDWR|O_EXCL, 0600);
 
 	if (fileno < 0) {
 		return NULL;
@@ -144,6 +153,63 @@ FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
 	return fstream;
 }
 
+int lha_arch_preallocate(FILE *fstream, uint64_t length)
+{
+#ifdef __linux__
+	// FALLOC_FL_KEEP_SIZE allocates space without extending the
+	// file, so a failed extract does not leave a file of the full
+	// length behind.
+
+	if (length > 0) {
+		return fallocate(fileno(fstream), FALLOC_FL_KEEP_SIZE,
+		                 0, (off_t) length) == 0;
+	}
+#endif
+
+	return 0;
+}
+
+int lha_arch_write(FILE *fstream, const void *buf, size_t len)
+{
+	const uint8_t *p;
+	ssize_t result;
+	int fd;
+
+	fd = fileno(fstream);
+	p = buf;
+
+	while (len > 0) {
+		result = write(fd, p, len);
+
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return 0;
+		}
+
+		p += result;
+		len -= (size_t) result;
+	}
+
+	return 1;
+}
+
+int lha_arch_skip(FILE *fstream, uint64_t offset)
+{
+	return lseek(fileno(fstream), (off_t) offset, SEEK_CUR) >= 0;
+}
+
+int lha_arch_truncate(FILE *fstream)
+{
+	off_t pos;
+
+	pos = lseek(fileno(fstream), 0, SEEK_CUR);
+
+	return pos >= 0 && ftruncate(fileno(fstream), pos) == 0;
+}
+
 LHAFileType lha_arch_exists(char *filename)
 {
 	struct stat statbuf;
@@ -169,4 +235,232 @@ int lha_arch_symlink(char *path, char *target)
 	return symlink(target, path) == 0;
 }
 
+void *lha_arch_map_file(char *filename, size_t *len)
+{
+	struct stat statbuf;
+	void *result;
+	int fileno;
+
+	fileno = open(filename, O_RDONLY);
+
+	if (fileno < 0) {
+		return NULL;
+	}
+
+	// Empty files cannot be mapped, and are not useful anyway.
+
+	if (fstat(fileno, &statbuf) != 0 || statbuf.st_size <= 0
+	 || (uintmax_t) statbuf.st_size > SIZE_MAX) {
+		close(fileno);
+		return NULL;
+	}
+
+	result = mmap(NULL, (size_t) statbuf.st_size, PROT_READ,
+	              MAP_PRIVATE, fileno, 0);
+
+	// The mapping stays valid after the file descriptor is closed.
+
+	close(fileno);
+
+	if (result == MAP_FAILED) {
+		return NULL;
+	}
+
+	*len = (size_t) statbuf.st_size;
+
+	return result;
+}
+
+void *lha_arch_map_output(FILE *fstream, size_t len)
+{
+#ifdef __linux__
+	void *result;
+
+	// Writing to a mapping of a sparse file raises SIGBUS if the disk
+	// fills up, so only map the file if the space can be allocated.
+
+	if (len == 0 || fallocate(fileno(fstream), 0, 0, (off_t) len) != 0) {
+		return NULL;
+	}
+
+	result = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	              fileno(fstream), 0);
+
+	if (result == MAP_FAILED) {
+		return NULL;
+	}
+
+	return result;
+#else
+	return NULL;
+#endif
+}
+
+void lha_arch_unmap_file(void *data, size_t len)
+{
+	munmap(data, len);
+}
+
+int lha_arch_file_info(char *filename, uint64_t *size, uint64_t *mtime)
+{
+	struct stat statbuf;
+
+	if (stat(filename, &statbuf) != 0) {
+		return 0;
+	}
+
+	*size = (uint64_t) statbuf.st_size;
+	*mtime = (uint64_t) statbuf.st_mtime;
+
+	return 1;
+}
+
+unsigned int lha_arch_num_cpus(void)
+{
+	long result;
+
+	result = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (result < 1) {
+		return 1;
+	}
+
+	return (unsigned int) result;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+struct _LHAArchThread {
+	pthread_t thread;
+	void (*callback)(void *data);
+	void *data;
+};
+
+struct _LHAArchMonitor {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void *thread_main(void *data)
+{
+	LHAArchThread *thread = data;
+
+	thread->callback(thread->data);
+
+	return NULL;
+}
+
+LHAArchThread *lha_arch_thread_start(void (*callback)(void *data),
+                                     void *data)
+{
+	LHAArchThread *thread;
+
+	thread = malloc(sizeof(LHAArchThread));
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->callback = callback;
+	thread->data = data;
+
+	if (pthread_create(&thread->thread, NULL, thread_main, thread) != 0) {
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void lha_arch_thread_join(LHAArchThread *thread)
+{
+	pthread_join(thread->thread, NULL);
+	free(thread);
+}
+
+LHAArchMonitor *lha_arch_monitor_new(void)
+{
+	LHAArchMonitor *monitor;
+
+	monitor = malloc(sizeof(LHAArchMonitor));
+
+	if (monitor == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&monitor->lock, NULL);
+	pthread_cond_init(&monitor->cond, NULL);
+
+	return monitor;
+}
+
+void lha_arch_monitor_free(LHAArchMonitor *monitor)
+{
+	pthread_cond_destroy(&monitor->cond);
+	pthread_mutex_destroy(&monitor->lock);
+	free(monitor);
+}
+
+void lha_arch_monitor_lock(LHAArchMonitor *monitor)
+{
+	pthread_mutex_lock(&monitor->lock);
+}
+
+void lha_arch_monitor_unlock(LHAArchMonitor *monitor)
+{
+	pthread_mutex_unlock(&monitor->lock);
+}
+
+void lha_arch_monitor_wait(LHAArchMonitor *monitor)
+{
+	pthread_cond_wait(&monitor->cond, &monitor->lock);
+}
+
+void lha_arch_monitor_notify(LHAArchMonitor *monitor)
+{
+	pthread_cond_broadcast(&monitor->cond);
+}
+
+#else /* #ifdef HAVE_PTHREAD_H */
+
+// Without pthreads, threads cannot be started, and callers fall back
+// to doing the work in the calling thread instead.
+
+LHAArchThread *lha_arch_thread_start(void (*callback)(void *data),
+                                     void *data)
+{
+	return NULL;
+}
+
+void lha_arch_thread_join(LHAArchThread *thread)
+{
+}
+
+LHAArchMonitor *lha_arch_monitor_new(void)
+{
+	return NULL;
+}
+
+void lha_arch_monitor_free(LHAArchMonitor *monitor)
+{
+}
+
+void lha_arch_monitor_lock(LHAArchMonitor *monitor)
+{
+}
+
+void lha_arch_monitor_unlock(LHAArchMonitor *monitor)
+{
+}
+
+void lha_arch_monitor_wait(LHAArchMonitor *monitor)
+{
+}
+
+void lha_arch_monitor_notify(LHAArchMonitor *monitor)
+{
+}
+
+#endif /* #ifdef HAVE_PTHREAD_H */
+
 #endif /* LHA_ARCH_UNIX */
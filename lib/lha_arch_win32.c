@@ -34,6 +34,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 
 static uint64_t unix_epoch_offset = 0;
 
@@ -171,7 +172,64 @@ int lha_arch_utime(char *filename, unsigned int timestamp)
 
 FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
 {
-	return fopen(filename, "wb");
+	// Open for reading as well, so that the file can be mapped.
+
+	return fopen(filename, "w+b");
+}
+
+int lha_arch_preallocate(FILE *fstream, uint64_t length)
+{
+	FILE_ALLOCATION_INFO info;
+	HANDLE handle;
+
+	handle = (HANDLE) _get_osfhandle(_fileno(fstream));
+
+	if (handle == INVALID_HANDLE_VALUE || length == 0) {
+		return 0;
+	}
+
+	info.AllocationSize.QuadPart = (LONGLONG) length;
+
+	return SetFileInformationByHandle(handle, FileAllocationInfo,
+	                                  &info, sizeof(info)) != 0;
+}
+
+int lha_arch_write(FILE *fstream, const void *buf, size_t len)
+{
+	const uint8_t *p;
+	unsigned int chunk;
+	int fd, result;
+
+	fd = _fileno(fstream);
+	p = buf;
+
+	while (len > 0) {
+		chunk = len > INT_MAX ? INT_MAX : (unsigned int) len;
+		result = _write(fd, p, chunk);
+
+		if (result < 0) {
+			return 0;
+		}
+
+		p += result;
+		len -= (size_t) result;
+	}
+
+	return 1;
+}
+
+int lha_arch_skip(FILE *fstream, uint64_t offset)
+{
+	return _lseeki64(_fileno(fstream), (__int64) offset, SEEK_CUR) >= 0;
+}
+
+int lha_arch_truncate(FILE *fstream)
+{
+	__int64 pos;
+
+	pos = _lseeki64(_fileno(fstream), 0, SEEK_CUR);
+
+	return pos >= 0 && _chsize_s(_fileno(fstream), pos) == 0;
 }
 
 LHAFileType lha_arch_exists(char *filename)
@@ -200,4 +258,199 @@ int lha_arch_symlink(char *path, char *target)
 	return 1;
 }
 
+void *lha_arch_map_file(char *filename, size_t *len)
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER file_size;
+	void *result;
+
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+	                   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	// Empty files cannot be mapped, and are not useful anyway.
+
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0
+	 || (uint64_t) file_size.QuadPart > SIZE_MAX) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (mapping == NULL) {
+		return NULL;
+	}
+
+	// The view stays valid after the mapping handle is closed.
+
+	result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (result == NULL) {
+		return NULL;
+	}
+
+	*len = (size_t) file_size.QuadPart;
+
+	return result;
+}
+
+void *lha_arch_map_output(FILE *fstream, size_t len)
+{
+	HANDLE mapping;
+	void *result;
+
+	// Extending the file allocates the disk space for it.
+
+	if (len == 0 || _chsize_s(_fileno(fstream), (__int64) len) != 0) {
+		return NULL;
+	}
+
+	mapping = CreateFileMappingA((HANDLE) _get_osfhandle(_fileno(fstream)),
+	                             NULL, PAGE_READWRITE, 0, 0, NULL);
+
+	if (mapping == NULL) {
+		return NULL;
+	}
+
+	// The view stays valid after the mapping handle is closed.
+
+	result = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, len);
+	CloseHandle(mapping);
+
+	return result;
+}
+
+void lha_arch_unmap_file(void *data, size_t len)
+{
+	UnmapViewOfFile(data);
+}
+
+int lha_arch_file_info(char *filename, uint64_t *size, uint64_t *mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA file_attr;
+
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard,
+	                          &file_attr)) {
+		return 0;
+	}
+
+	*size = ((uint64_t) file_attr.nFileSizeHigh << 32)
+	      | file_attr.nFileSizeLow;
+	*mtime = ((uint64_t) file_attr.ftLastWriteTime.dwHighDateTime << 32)
+	       | file_attr.ftLastWriteTime.dwLowDateTime;
+
+	return 1;
+}
+
+unsigned int lha_arch_num_cpus(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	if (info.dwNumberOfProcessors < 1) {
+		return 1;
+	}
+
+	return (unsigned int) info.dwNumberOfProcessors;
+}
+
+struct _LHAArchThread {
+	HANDLE handle;
+	void (*callback)(void *data);
+	void *data;
+};
+
+struct _LHAArchMonitor {
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cond;
+};
+
+static DWORD WINAPI thread_main(LPVOID data)
+{
+	LHAArchThread *thread = data;
+
+	thread->callback(thread->data);
+
+	return 0;
+}
+
+LHAArchThread *lha_arch_thread_start(void (*callback)(void *data),
+                                     void *data)
+{
+	LHAArchThread *thread;
+
+	thread = malloc(sizeof(LHAArchThread));
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->callback = callback;
+	thread->data = data;
+	thread->handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
+
+	if (thread->handle == NULL) {
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void lha_arch_thread_join(LHAArchThread *thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+LHAArchMonitor *lha_arch_monitor_new(void)
+{
+	LHAArchMonitor *monitor;
+
+	monitor = malloc(sizeof(LHAArchMonitor));
+
+	if (monitor == NULL) {
+		return NULL;
+	}
+
+	InitializeCriticalSection(&monitor->lock);
+	InitializeConditionVariable(&monitor->cond);
+
+	return monitor;
+}
+
+void lha_arch_monitor_free(LHAArchMonitor *monitor)
+{
+	DeleteCriticalSection(&monitor->lock);
+	free(monitor);
+}
+
+void lha_arch_monitor_lock(LHAArchMonitor *monitor)
+{
+	EnterCriticalSection(&monitor->lock);
+}
+
+void lha_arch_monitor_unlock(LHAArchMonitor *monitor)
+{
+	LeaveCriticalSection(&monitor->lock);
+}
+
+void lha_arch_monitor_wait(LHAArchMonitor *monitor)
+{
+	SleepConditionVariableCS(&monitor->cond, &monitor->lock, INFINITE);
+}
+
+void lha_arch_monitor_notify(LHAArchMonitor *monitor)
+{
+	WakeAllConditionVariable(&monitor->cond);
+}
+
 #endif /* LHA_ARCH_WINDOWS */
@@ -0,0 +1,761 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc16.h"
+#include "lha_arch.h"
+#include "lha_endian.h"
+#include "lha_input_stream.h"
+#include "lha_basic_reader.h"
+#include "public/lha_archive_index.h"
+
+// Layout of an index file. All values are little-endian.
+//
+// The file begins with a header:
+//
+//   0   Magic string (INDEX_MAGIC)
+//   8   Format version (INDEX_VERSION)
+//   12  Number of entries
+//   16  Size of the archive file
+//   24  Modification time of the archive file
+//   32  Checksum of the first and last file headers in the archive
+//   36  Number of slots in the hash table
+//   40  Length of the string table
+//
+// This is followed by the hash table (four bytes per slot), the
+// entries (INDEX_ENTRY_LEN bytes each, with offsets into the string
+// table for strings), and finally the string table itself, which
+// contains NUL-terminated strings.
+
+#define INDEX_MAGIC        "LHAINDEX"
+#define INDEX_VERSION      1
+#define INDEX_HEADER_LEN   64
+#define INDEX_ENTRY_LEN    80
+
+// Value stored in place of a string offset when there is no string.
+
+#define NO_STRING          0xffffffff
+
+struct _LHAArchiveIndex {
+	LHAInputStream *stream;
+
+	// Entries for all files in the archive, in archive order.
+
+	LHAArchiveIndexEntry *entries;
+	unsigned int num_entries, entries_size;
+
+	// Hash table used to look up entries by name. Each slot is a
+	// four byte little-endian value, in the same format as in an
+	// index file. It contains the number of an entry plus one, or
+	// zero if the slot is unused. Collisions are resolved by linear
+	// probing. The table size is always a power of two.
+
+	uint8_t *table;
+	unsigned int table_size;
+
+	// If the index was loaded from an index file, the file contents.
+	// The hash table and strings in the entries point into this.
+
+	uint8_t *mapped;
+	size_t mapped_len;
+};
+
+// Hash function for filenames (FNV-1a).
+
+static unsigned int hash_name(char *name)
+{
+	uint32_t result;
+	unsigned char *p;
+
+	result = 2166136261U;
+
+	for (p = (unsigned char *) name; *p != '\0'; ++p) {
+		result = (result ^ *p) * 16777619U;
+	}
+
+	return result;
+}
+
+// Build the full name of the file described by a header, by joining
+// the path and filename. Returns a newly allocated string, or NULL
+// for failure.
+
+static char *header_name(LHAFileHeader *header)
+{
+	size_t len;
+	char *result;
+
+	len = 0;
+
+	if (header->path != NULL) {
+		len += strlen(header->path);
+	}
+
+	if (header->filename != NULL) {
+		len += strlen(header->filename);
+	}
+
+	result = malloc(len + 1);
+
+	if (result == NULL) {
+		return NULL;
+	}
+
+	result[0] = '\0';
+
+	if (header->path != NULL) {
+		strcat(result, header->path);
+	}
+
+	if (header->filename != NULL) {
+		strcat(result, header->filename);
+	}
+
+	return result;
+}
+
+// Make space for a new entry at the end of the entries array.
+// Returns NULL for failure.
+
+static LHAArchiveIndexEntry *new_entry(LHAArchiveIndex *index)
+{
+	LHAArchiveIndexEntry *new_entries;
+	unsigned int new_size;
+
+	if (index->num_entries >= index->entries_size) {
+		new_size = index->entries_size * 2;
+
+		if (new_size == 0) {
+			new_size = 16;
+		}
+
+		new_entries = realloc(index->entries,
+		                      new_size * sizeof(LHAArchiveIndexEntry));
+
+		if (new_entries == NULL) {
+			return NULL;
+		}
+
+		index->entries = new_entries;
+		index->entries_size = new_size;
+	}
+
+	return &index->entries[index->num_entries];
+}
+
+// Add an entry for the current file of the specified reader.
+
+static int add_entry(LHAArchiveIndex *index, LHABasicReader *reader,
+                     LHAFileHeader *header)
+{
+	LHAArchiveIndexEntry *entry;
+
+	entry = new_entry(index);
+
+	if (entry == NULL) {
+		return 0;
+	}
+
+	entry->name = header_name(header);
+	entry->symlink_target = NULL;
+
+	if (entry->name == NULL) {
+		return 0;
+	}
+
+	if (header->symlink_target != NULL) {
+		entry->symlink_target = strdup(header->symlink_target);
+
+		if (entry->symlink_target == NULL) {
+			free(entry->name);
+			return 0;
+		}
+	}
+
+	// The header has just been read, so the stream is positioned at
+	// the start of the compressed data.
+
+	entry->header_offset = lha_basic_reader_curr_file_offset(reader);
+	entry->data_offset = lha_input_stream_tell(index->stream);
+	entry->compressed_length = header->compressed_length;
+	entry->length = header->length;
+	memcpy(entry->compress_method, header->compress_method,
+	       sizeof(entry->compress_method));
+	entry->crc = header->crc;
+	entry->timestamp = header->timestamp;
+	entry->header_level = header->header_level;
+	entry->os_type = header->os_type;
+	entry->extra_flags = header->extra_flags;
+	entry->unix_perms = header->unix_perms;
+	entry->unix_uid = header->unix_uid;
+	entry->unix_gid = header->unix_gid;
+	entry->os9_perms = header->os9_perms;
+
+	++index->num_entries;
+
+	return 1;
+}
+
+// Get the value of a slot in the hash table.
+
+static unsigned int table_slot(LHAArchiveIndex *index, unsigned int slot)
+{
+	return lha_decode_uint32(index->table + slot * 4);
+}
+
+// Build the hash table for looking up entries by name.
+
+static int build_table(LHAArchiveIndex *index)
+{
+	unsigned int i, slot, mask;
+
+	// Keep the table at most half full.
+
+	index->table_size = 16;
+
+	while (index->table_size < index->num_entries * 2) {
+		index->table_size *= 2;
+	}
+
+	index->table = calloc(index->table_size, 4);
+
+	if (index->table == NULL) {
+		return 0;
+	}
+
+	mask = index->table_size - 1;
+
+	for (i = 0; i < index->num_entries; ++i) {
+		slot = hash_name(index->entries[i].name) & mask;
+
+		// If a file appears more than once, the later entry
+		// replaces the earlier one.
+
+		while (table_slot(index, slot) != 0
+		    && strcmp(index->entries[table_slot(index, slot) - 1].name,
+		              index->entries[i].name) != 0) {
+			slot = (slot + 1) & mask;
+		}
+
+		lha_encode_uint32(index->table + slot * 4, i + 1);
+	}
+
+	return 1;
+}
+
+LHAArchiveIndex *lha_archive_index_new(LHAInputStream *stream)
+{
+	LHAArchiveIndex *index;
+	LHABasicReader *reader;
+	LHAFileHeader *header;
+	int success;
+
+	index = calloc(1, sizeof(LHAArchiveIndex));
+
+	if (index == NULL) {
+		return NULL;
+	}
+
+	index->stream = stream;
+
+	reader = lha_basic_reader_new(stream);
+
+	if (reader == NULL) {
+		free(index);
+		return NULL;
+	}
+
+	// Read through all headers in the archive.
+
+	success = 1;
+
+	for (;;) {
+		header = lha_basic_reader_next_file(reader);
+
+		if (header == NULL) {
+			break;
+		}
+
+		if (!add_entry(index, reader, header)) {
+			success = 0;
+			break;
+		}
+	}
+
+	lha_basic_reader_free(reader);
+
+	if (!success || !build_table(index)) {
+		lha_archive_index_free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+// Calculate a checksum of the raw data of the first and last file
+// headers in the archive, used to detect if the archive has changed
+// since an index file was saved.
+
+static int header_checksum(LHAArchiveIndex *index, char *filename,
+                           uint16_t *result)
+{
+	LHAArchiveIndexEntry *entries[2];
+	uint8_t *data;
+	size_t data_len;
+	unsigned int i;
+	int success;
+
+	*result = 0;
+
+	if (index->num_entries == 0) {
+		return 1;
+	}
+
+	data = lha_arch_map_file(filename, &data_len);
+
+	if (data == NULL) {
+		return 0;
+	}
+
+	entries[0] = &index->entries[0];
+	entries[1] = &index->entries[index->num_entries - 1];
+	success = 1;
+
+	for (i = 0; i < 2; ++i) {
+		if (entries[i]->header_offset > entries[i]->data_offset
+		 || entries[i]->data_offset > data_len) {
+			success = 0;
+			break;
+		}
+
+		lha_crc16_buf(result, data + entries[i]->header_offset,
+		              (size_t) (entries[i]->data_offset
+		                        - entries[i]->header_offset));
+	}
+
+	lha_arch_unmap_file(data, data_len);
+
+	return success;
+}
+
+// Decode an entry from an index file. Returns zero if it is invalid.
+
+static int decode_entry(LHAArchiveIndexEntry *entry, uint8_t *buf,
+                        char *strings, size_t strings_len)
+{
+	uint32_t name, symlink_target;
+
+	entry->header_offset = lha_decode_uint64(buf);
+	entry->data_offset = lha_decode_uint64(buf + 8);
+	entry->compressed_length = (size_t) lha_decode_uint64(buf + 16);
+	entry->length = (size_t) lha_decode_uint64(buf + 24);
+	name = lha_decode_uint32(buf + 32);
+	symlink_target = lha_decode_uint32(buf + 36);
+	entry->timestamp = lha_decode_uint32(buf + 40);
+	entry->extra_flags = lha_decode_uint32(buf + 44);
+	entry->unix_perms = lha_decode_uint32(buf + 48);
+	entry->unix_uid = lha_decode_uint32(buf + 52);
+	entry->unix_gid = lha_decode_uint32(buf + 56);
+	entry->os9_perms = lha_decode_uint32(buf + 60);
+	entry->crc = lha_decode_uint16(buf + 64);
+	entry->header_level = buf[66];
+	entry->os_type = buf[67];
+	memcpy(entry->compress_method, buf + 68,
+	       sizeof(entry->compress_method));
+	entry->compress_method[5] = '\0';
+
+	// The string table is known to end with a NUL, so any offset
+	// within it gives a valid string.
+
+	if (name >= strings_len) {
+		return 0;
+	}
+
+	entry->name = strings + name;
+
+	if (symlink_target == NO_STRING) {
+		entry->symlink_target = NULL;
+	} else if (symlink_target < strings_len) {
+		entry->symlink_target = strings + symlink_target;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+// Check that the header of an index file is valid, and that the file
+// is the expected length.
+
+static int check_index_header(uint8_t *data, size_t data_len)
+{
+	uint64_t num_entries, table_size, strings_len;
+
+	if (data_len < INDEX_HEADER_LEN
+	 || memcmp(data, INDEX_MAGIC, 8) != 0
+	 || lha_decode_uint32(data + 8) != INDEX_VERSION) {
+		return 0;
+	}
+
+	num_entries = lha_decode_uint32(data + 12);
+	table_size = lha_decode_uint32(data + 36);
+	strings_len = lha_decode_uint64(data + 40);
+
+	// The hash table must be a power of two in size, and must have
+	// at least one free slot, or lookups would never terminate.
+
+	if (table_size <= num_entries
+	 || (table_size & (table_size - 1)) != 0) {
+		return 0;
+	}
+
+	if (strings_len > data_len
+	 || INDEX_HEADER_LEN + table_size * 4 + num_entries * INDEX_ENTRY_LEN
+	    + strings_len != data_len) {
+		return 0;
+	}
+
+	return strings_len == 0 || data[data_len - 1] == '\0';
+}
+
+LHAArchiveIndex *lha_archive_index_load(LHAInputStream *stream,
+                                        char *filename,
+                                        char *index_filename)
+{
+	LHAArchiveIndex *index;
+	uint8_t *data, *entry_data;
+	size_t data_len, strings_len;
+	uint64_t size, mtime;
+	uint16_t checksum;
+	char *strings;
+	unsigned int i;
+
+	data = lha_arch_map_file(index_filename, &data_len);
+
+	if (data == NULL) {
+		return NULL;
+	}
+
+	// Check the index file is valid, and that the archive has not
+	// changed since it was written.
+
+	if (!check_index_header(data, data_len)
+	 || !lha_arch_file_info(filename, &size, &mtime)
+	 || size != lha_decode_uint64(data + 16)
+	 || mtime != lha_decode_uint64(data + 24)) {
+		lha_arch_unmap_file(data, data_len);
+		return NULL;
+	}
+
+	index = calloc(1, sizeof(LHAArchiveIndex));
+
+	if (index == NULL) {
+		lha_arch_unmap_file(data, data_len);
+		return NULL;
+	}
+
+	index->stream = stream;
+	index->mapped = data;
+	index->mapped_len = data_len;
+	index->num_entries = lha_decode_uint32(data + 12);
+	index->table_size = lha_decode_uint32(data + 36);
+	index->table = data + INDEX_HEADER_LEN;
+
+	// The hash table and strings are used in place. Only the
+	// entries themselves are decoded, as the structures returned by
+	// lha_archive_index_entry() must be in the native format.
+
+	entry_data = index->table + index->table_size * 4;
+	strings = (char *) entry_data + index->num_entries * INDEX_ENTRY_LEN;
+	strings_len = data_len - (size_t) (strings - (char *) data);
+
+	if (index->num_entries > 0) {
+		index->entries = calloc(index->num_entries,
+		                        sizeof(LHAArchiveIndexEntry));
+
+		if (index->entries == NULL) {
+			lha_archive_index_free(index);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < index->num_entries; ++i) {
+		if (!decode_entry(&index->entries[i],
+		                  entry_data + i * INDEX_ENTRY_LEN,
+		                  strings, strings_len)) {
+			lha_archive_index_free(index);
+			return NULL;
+		}
+	}
+
+	index->entries_size = index->num_entries;
+
+	if (!header_checksum(index, filename, &checksum)
+	 || checksum != lha_decode_uint32(data + 32)) {
+		lha_archive_index_free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+// Get the length of a string in the string table of an index file.
+
+static size_t string_len(char *s)
+{
+	if (s == NULL) {
+		return 0;
+	}
+
+	return strlen(s) + 1;
+}
+
+// Encode an entry, to write to an index file.
+
+static void encode_entry(uint8_t *buf, LHAArchiveIndexEntry *entry,
+                         uint32_t name, uint32_t symlink_target)
+{
+	memset(buf, 0, INDEX_ENTRY_LEN);
+
+	lha_encode_uint64(buf, entry->header_offset);
+	lha_encode_uint64(buf + 8, entry->data_offset);
+	lha_encode_uint64(buf + 16, entry->compressed_length);
+	lha_encode_uint64(buf + 24, entry->length);
+	lha_encode_uint32(buf + 32, name);
+	lha_encode_uint32(buf + 36, symlink_target);
+	lha_encode_uint32(buf + 40, entry->timestamp);
+	lha_encode_uint32(buf + 44, entry->extra_flags);
+	lha_encode_uint32(buf + 48, entry->unix_perms);
+	lha_encode_uint32(buf + 52, entry->unix_uid);
+	lha_encode_uint32(buf + 56, entry->unix_gid);
+	lha_encode_uint32(buf + 60, entry->os9_perms);
+	lha_encode_uint16(buf + 64, entry->crc);
+	buf[66] = entry->header_level;
+	buf[67] = entry->os_type;
+	memcpy(buf + 68, entry->compress_method,
+	       sizeof(entry->compress_method));
+}
+
+// Write the contents of an index file. Returns zero for failure.
+
+static int write_index(LHAArchiveIndex *index, FILE *fstream,
+                       uint8_t *header)
+{
+	LHAArchiveIndexEntry *entry;
+	uint8_t buf[INDEX_ENTRY_LEN];
+	uint64_t strings_len;
+	uint32_t name, symlink_target;
+	unsigned int i;
+
+	// Work out the length of the string table, which must be small
+	// enough for the offsets to fit in an entry.
+
+	strings_len = 0;
+
+	for (i = 0; i < index->num_entries; ++i) {
+		entry = &index->entries[i];
+		strings_len += string_len(entry->name)
+		             + string_len(entry->symlink_target);
+	}
+
+	if (strings_len >= NO_STRING) {
+		return 0;
+	}
+
+	lha_encode_uint64(header + 40, strings_len);
+
+	if (fwrite(header, 1, INDEX_HEADER_LEN, fstream) != INDEX_HEADER_LEN
+	 || fwrite(index->table, 4, index->table_size, fstream)
+	      != index->table_size) {
+		return 0;
+	}
+
+	// Write the entries, with the offsets of their strings in the
+	// string table.
+
+	strings_len = 0;
+
+	for (i = 0; i < index->num_entries; ++i) {
+		entry = &index->entries[i];
+
+		name = (uint32_t) strings_len;
+		strings_len += string_len(entry->name);
+
+		if (entry->symlink_target != NULL) {
+			symlink_target = (uint32_t) strings_len;
+			strings_len += string_len(entry->symlink_target);
+		} else {
+			symlink_target = NO_STRING;
+		}
+
+		encode_entry(buf, entry, name, symlink_target);
+
+		if (fwrite(buf, 1, INDEX_ENTRY_LEN, fstream)
+		      != INDEX_ENTRY_LEN) {
+			return 0;
+		}
+	}
+
+	// Write the string table.
+
+	for (i = 0; i < index->num_entries; ++i) {
+		entry = &index->entries[i];
+
+		fwrite(entry->name, 1, string_len(entry->name), fstream);
+
+		if (entry->symlink_target != NULL) {
+			fwrite(entry->symlink_target, 1,
+			       string_len(entry->symlink_target), fstream);
+		}
+	}
+
+	return !ferror(fstream);
+}
+
+int lha_archive_index_save(LHAArchiveIndex *index, char *filename,
+                           char *index_filename)
+{
+	uint8_t header[INDEX_HEADER_LEN];
+	uint64_t size, mtime;
+	uint16_t checksum;
+	FILE *fstream;
+	int success;
+
+	if (!lha_arch_file_info(filename, &size, &mtime)
+	 || !header_checksum(index, filename, &checksum)) {
+		return 0;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, INDEX_MAGIC, 8);
+	lha_encode_uint32(header + 8, INDEX_VERSION);
+	lha_encode_uint32(header + 12, index->num_entries);
+	lha_encode_uint64(header + 16, size);
+	lha_encode_uint64(header + 24, mtime);
+	lha_encode_uint32(header + 32, checksum);
+	lha_encode_uint32(header + 36, index->table_size);
+
+	fstream = fopen(index_filename, "wb");
+
+	if (fstream == NULL) {
+		return 0;
+	}
+
+	success = write_index(index, fstream, header);
+
+	if (fclose(fstream) != 0) {
+		success = 0;
+	}
+
+	// Don't leave a partially written index file behind.
+
+	if (!success) {
+		remove(index_filename);
+	}
+
+	return success;
+}
+
+void lha_archive_index_free(LHAArchiveIndex *index)
+{
+	unsigned int i;
+
+	if (index->mapped != NULL) {
+		lha_arch_unmap_file(index->mapped, index->mapped_len);
+	} else {
+		for (i = 0; i < index->num_entries; ++i) {
+			free(index->entries[i].name);
+			free(index->entries[i].symlink_target);
+		}
+
+		free(index->table);
+	}
+
+	free(index->entries);
+	free(index);
+}
+
+unsigned int lha_archive_index_num_entries(LHAArchiveIndex *index)
+{
+	return index->num_entries;
+}
+
+const LHAArchiveIndexEntry *lha_archive_index_entry(LHAArchiveIndex *index,
+                                                    unsigned int n)
+{
+	if (n >= index->num_entries) {
+		return NULL;
+	}
+
+	return &index->entries[n];
+}
+
+const LHAArchiveIndexEntry *lha_archive_index_find(LHAArchiveIndex *index,
+                                                   char *name)
+{
+	LHAArchiveIndexEntry *entry;
+	unsigned int i, slot, mask, n;
+
+	mask = index->table_size - 1;
+	slot = hash_name(name) & mask;
+
+	// A loaded index file might be corrupt, so check the entry
+	// number is in range, and never search more than the whole
+	// table.
+
+	for (i = 0; i < index->table_size; ++i) {
+		n = table_slot(index, slot);
+
+		if (n == 0 || n > index->num_entries) {
+			break;
+		}
+
+		entry = &index->entries[n - 1];
+
+		if (!strcmp(entry->name, name)) {
+			return entry;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+LHAReader *lha_reader_open_member(LHAArchiveIndex *index, char *name)
+{
+	const LHAArchiveIndexEntry *entry;
+
+	if (index->stream == NULL) {
+		return NULL;
+	}
+
+	entry = lha_archive_index_find(index, name);
+
+	if (entry == NULL
+	 || !lha_input_stream_seek(index->stream, entry->header_offset)) {
+		return NULL;
+	}
+
+	return lha_reader_new(index->stream);
+}
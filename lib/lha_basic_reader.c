@@ -30,6 +30,8 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 struct _LHABasicReader {
 	LHAInputStream *stream;
 	LHAFileHeader *curr_file;
+	uint64_t curr_file_offset;
+	uint64_t curr_file_data_offset;
 	size_t curr_file_remaining;
 	int eof;
 };
@@ -46,6 +48,8 @@ LHABasicReader *lha_basic_reader_new(LHAInputStream *stream)
 
 	reader->stream = stream;
 	reader->curr_file = NULL;
+	reader->curr_file_offset = 0;
+	reader->curr_file_data_offset = 0;
 	reader->curr_file_remaining = 0;
 	reader->eof = 0;
 
@@ -66,6 +70,11 @@ LHAFileHeader *lha_basic_reader_curr_file(LHABasicReader *reader)
 	return reader->curr_file;
 }
 
+uint64_t lha_basic_reader_curr_file_offset(LHABasicReader *reader)
+{
+	return reader->curr_file_offset;
+}
+
 LHAFileHeader *lha_basic_reader_next_file(LHABasicReader *reader)
 {
 	// Free the current file header and skip over any remaining
@@ -87,6 +96,7 @@ LHAFileHeader *lha_basic_reader_next_file(LHABasicReader *reader)
 
 	// Read the header for the next file.
 
+	reader->curr_file_offset = lha_input_stream_tell(reader->stream);
 	reader->curr_file = lha_file_header_read(reader->stream);
 
 	if (reader->curr_file == NULL) {
@@ -94,15 +104,35 @@ LHAFileHeader *lha_basic_reader_next_file(LHABasicReader *reader)
 		return NULL;
 	}
 
+	reader->curr_file_data_offset = lha_input_stream_tell(reader->stream);
 	reader->curr_file_remaining = reader->curr_file->compressed_length;
 
 	return reader->curr_file;
 }
 
+// Seek to the specified position within the compressed data of the
+// current file.
+
+static int seek_compressed(LHABasicReader *reader, uint64_t offset)
+{
+	if (reader->curr_file == NULL
+	 || offset > reader->curr_file->compressed_length
+	 || !lha_input_stream_seek(reader->stream,
+	                           reader->curr_file_data_offset + offset)) {
+		return 0;
+	}
+
+	reader->curr_file_remaining
+	    = reader->curr_file->compressed_length - (size_t) offset;
+	reader->eof = 0;
+
+	return 1;
+}
+
 size_t lha_basic_reader_read_compressed(LHABasicReader *reader, void *buf,
                                         size_t buf_len)
 {
-	size_t bytes;
+	size_t bytes, n;
 
 	if (reader->eof || reader->curr_file_remaining == 0) {
 		return 0;
@@ -116,16 +146,53 @@ size_t lha_basic_reader_read_compressed(LHABasicReader *reader, void *buf,
 		bytes = buf_len;
 	}
 
-	if (!lha_input_stream_read(reader->stream, buf, bytes)) {
+	// Decoders read compressed data in large blocks, so a short read
+	// at the end of a truncated file must still return the data
+	// that was read.
+
+	n = lha_input_stream_read_some(reader->stream, buf, bytes);
+
+	if (n < bytes) {
 		reader->eof = 1;
+	}
+
+	if (n == 0) {
 		return 0;
 	}
 
 	// Update counter and return success.
 
-	reader->curr_file_remaining -= bytes;
+	reader->curr_file_remaining -= n;
 
-	return bytes;
+	return n;
+}
+
+size_t lha_basic_reader_borrow_compressed(LHABasicReader *reader,
+                                          const uint8_t **buf,
+                                          size_t buf_len)
+{
+	size_t n;
+
+	if (reader->eof || reader->curr_file_remaining == 0) {
+		return 0;
+	}
+
+	// Borrow up to the number of bytes of compressed data remaining.
+
+	if (buf_len > reader->curr_file_remaining) {
+		buf_len = reader->curr_file_remaining;
+	}
+
+	n = lha_input_stream_borrow(reader->stream, buf, buf_len);
+
+	if (n == 0) {
+		reader->eof = 1;
+		return 0;
+	}
+
+	reader->curr_file_remaining -= n;
+
+	return n;
 }
 
 static size_t decoder_callback(void *buf, size_t buf_len, void *user_data)
@@ -133,11 +200,18 @@ static size_t decoder_callback(void *buf, size_t buf_len, void *user_data)
 	return lha_basic_reader_read_compressed(user_data, buf, buf_len);
 }
 
+static size_t decoder_borrow_callback(const uint8_t **buf, size_t buf_len,
+                                      void *user_data)
+{
+	return lha_basic_reader_borrow_compressed(user_data, buf, buf_len);
+}
+
 // Create the decoder structure to decode the current file.
 
 LHADecoder *lha_basic_reader_decode(LHABasicReader *reader)
 {
 	LHADecoderType *dtype;
+	LHADecoder *decoder;
 
 	if (reader->curr_file == NULL) {
 		return NULL;
@@ -153,6 +227,70 @@ LHADecoder *lha_basic_reader_decode(LHABasicReader *reader)
 
 	// Create decoder.
 
-	return lha_decoder_new(dtype, decoder_callback, reader,
-	                       reader->curr_file->length);
+	decoder = lha_decoder_new(dtype, decoder_callback, reader,
+	                          reader->curr_file->length);
+
+	// If the input stream holds its data in memory, the decoder can
+	// read the compressed data directly from there.
+
+	if (decoder != NULL && lha_input_stream_can_borrow(reader->stream)) {
+		lha_decoder_set_borrow(decoder, decoder_borrow_callback);
+	}
+
+	return decoder;
+}
+
+int lha_basic_reader_reset_decoder(LHABasicReader *reader,
+                                   LHADecoder *decoder)
+{
+	if (reader->curr_file == NULL) {
+		return 0;
+	}
+
+	if (!lha_decoder_reset(decoder, decoder_callback, reader,
+	                       reader->curr_file->length)) {
+		return 0;
+	}
+
+	if (lha_input_stream_can_borrow(reader->stream)) {
+		lha_decoder_set_borrow(decoder, decoder_borrow_callback);
+	}
+
+	return 1;
 }
+
+int lha_basic_reader_rewind_decoder(LHABasicReader *reader,
+                                    LHADecoder *decoder)
+{
+	return seek_compressed(reader, 0)
+	    && lha_basic_reader_reset_decoder(reader, decoder);
+}
+
+int lha_basic_reader_restore_decoder(LHABasicReader *reader,
+                                     LHADecoder *decoder, uint8_t *state)
+{
+	uint64_t offset;
+
+	// The -pm1- decoder reads zeros past the end of the compressed
+	// data, so the state might have been saved after the end.
+
+	offset = lha_decoder_state_input_position(state);
+
+	if (reader->curr_file != NULL
+	 && offset > reader->curr_file->compressed_length) {
+		offset = reader->curr_file->compressed_length;
+	}
+
+	if (!seek_compressed(reader, offset)
+	 || !lha_decoder_restore_state(decoder, state, decoder_callback,
+	                               reader)) {
+		return 0;
+	}
+
+	if (lha_input_stream_can_borrow(reader->stream)) {
+		lha_decoder_set_borrow(decoder, decoder_borrow_callback);
+	}
+
+	return 1;
+}
+
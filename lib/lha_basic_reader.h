@@ -62,6 +62,16 @@ void lha_basic_reader_free(LHABasicReader *reader);
 
 LHAFileHeader *lha_basic_reader_curr_file(LHABasicReader *reader);
 
+/**
+ * Get the offset within the input stream of the header of the last
+ * file read by @ref lha_basic_reader_next_file.
+ *
+ * @param reader     The LHABasicReader structure.
+ * @return           Offset of the header, in bytes.
+ */
+
+uint64_t lha_basic_reader_curr_file_offset(LHABasicReader *reader);
+
 /**
  * Read the header of the next archived file from the input stream.
  *
@@ -84,6 +94,23 @@ LHAFileHeader *lha_basic_reader_next_file(LHABasicReader *reader);
 size_t lha_basic_reader_read_compressed(LHABasicReader *reader, void *buf,
                                        size_t buf_len);
 
+/**
+ * Borrow a pointer to some of the compressed data for the current
+ * archived file, without copying it. Only supported if the input
+ * stream supports borrowing.
+ *
+ * @param reader     The LHABasicReader structure.
+ * @param buf        Pointer to a variable in which to store a pointer
+ *                   to the data.
+ * @param buf_len    Maximum number of bytes to return.
+ * @return           Number of bytes available, or zero for end of
+ *                   file or error.
+ */
+
+size_t lha_basic_reader_borrow_compressed(LHABasicReader *reader,
+                                          const uint8_t **buf,
+                                          size_t buf_len);
+
 /**
  * Create a decoder object to decompress the compressed data in the
  * current file.
@@ -95,4 +122,46 @@ size_t lha_basic_reader_read_compressed(LHABasicReader *reader, void *buf,
 
 LHADecoder *lha_basic_reader_decode(LHABasicReader *reader);
 
+/**
+ * Reset an existing decoder, to decompress the compressed data in the
+ * current file. The decoder must be of the type needed for the current
+ * file's compression method.
+ *
+ * @param reader     The LHABasicReader structure.
+ * @param decoder    The decoder to reset.
+ * @return           Non-zero for success, or zero for failure, in which
+ *                   case the decoder must be freed.
+ */
+
+int lha_basic_reader_reset_decoder(LHABasicReader *reader,
+                                   LHADecoder *decoder);
+
+/**
+ * Seek back to the start of the compressed data in the current file,
+ * and reset a decoder to decompress it from the start again. This is
+ * only supported if the input stream supports seeking.
+ * @param reader     The LHABasicReader structure.
+ * @param decoder    The decoder to reset.
+ * @return           Non-zero for success, or zero for failure.
+ */
+
+int lha_basic_reader_rewind_decoder(LHABasicReader *reader,
+                                    LHADecoder *decoder);
+
+/**
+ * Restore a decoder state saved while decompressing the current file
+ * (see @ref lha_decoder_save_state), seeking to the position in the
+ * compressed data at which it was saved. This is only supported if the
+ * input stream supports seeking.
+ * @param reader     The LHABasicReader structure.
+ * @param decoder    The decoder to restore.
+ * @param state      Pointer to the saved state.
+ * @return           Non-zero for success, or zero for failure, in which
+ *                   case the decoder must be reset before it is used
+ *                   again.
+ */
+
+int lha_basic_reader_restore_decoder(LHABasicReader *reader,
+                                     LHADecoder *decoder, uint8_t *state);
+
 #endif /* #ifndef LHASA_LHA_BASIC_READER_H */
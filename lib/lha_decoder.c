@@ -24,6 +24,35 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "crc16.h"
 #include "lha_decoder.h"
+#include "lha_endian.h"
+
+// Push decoders only call the decoder's read() function when at least
+// this much compressed data is waiting to be read, or the end of the
+// data has been reached. This is larger than the most data that any of
+// the decoders reads in a single call (the largest is a -lh7- block
+// header, which includes tables that can be a little over 1KB), so the
+// decoders never run out of data part way through a command.
+
+#define FEED_INPUT_RESERVE 4096 /* bytes */
+
+// Size of the buffer used by push decoders to hold fed data.
+
+#define FEED_BUFFER_SIZE (FEED_INPUT_RESERVE * 2)
+
+// When decoding into a linear buffer, data is decoded in chunks of this
+// size, so that the CRC is calculated while the data is still in the
+// cache, and the progress callback is invoked regularly.
+
+#define LINEAR_CHUNK_SIZE (64 * 1024) /* bytes */
+
+// Layout of a saved decoder state. All values are little-endian.
+//
+//   0   Position in the decompressed data
+//   8   Position in the compressed data of the next bit to be read
+//   16  CRC of the decompressed data so far
+//   18  State specific to the type of decoder
+
+#define STATE_HEADER_LEN 18
 
 // Null decoder, used for -lz4-, -lh0-, -pm0-:
 extern LHADecoderType lha_null_decoder;
@@ -65,42 +94,121 @@ static struct {
 	{ "-pm2-", &lha_pm2_decoder },
 };
 
-LHADecoder *lha_decoder_new(LHADecoderType *dtype,
-                            LHADecoderCallback callback,
-                            void *callback_data,
-                            size_t stream_length)
+// Set the generic decoder state for the start of a new stream.
+
+static void init_decoder_state(LHADecoder *decoder, size_t stream_length)
+{
+	decoder->progress_callback = NULL;
+	decoder->last_block = UINT_MAX;
+	decoder->outbuf_pos = 0;
+	decoder->outbuf_len = 0;
+	decoder->stream_pos = 0;
+	decoder->stream_length = stream_length;
+	decoder->decoder_failed = 0;
+	decoder->crc = 0;
+	decoder->feedbuf_pos = 0;
+	decoder->feedbuf_len = 0;
+	decoder->feed_eof = 0;
+	decoder->feed_overrun = 0;
+	decoder->linear = 0;
+}
+
+// Callback function used by push decoders to read fed data.
+
+static size_t feed_callback(void *buf, size_t buf_len, void *user_data)
+{
+	LHADecoder *decoder = user_data;
+	size_t bytes;
+
+	bytes = decoder->feedbuf_len - decoder->feedbuf_pos;
+
+	if (bytes > buf_len) {
+		bytes = buf_len;
+	}
+
+	// If there is no more data before the end has been fed, the
+	// stream needs more data in one command than FEED_INPUT_RESERVE.
+
+	if (bytes == 0 && !decoder->feed_eof) {
+		decoder->feed_overrun = 1;
+	}
+
+	memcpy(buf, decoder->feedbuf + decoder->feedbuf_pos, bytes);
+	decoder->feedbuf_pos += bytes;
+
+	return bytes;
+}
+
+// Allocate a new decoder, and optionally a buffer for fed data.
+
+static LHADecoder *alloc_decoder(LHADecoderType *dtype,
+                                 size_t stream_length,
+                                 size_t feedbuf_size)
 {
 	LHADecoder *decoder;
 	void *extra_data;
 
 	// Space is allocated together: the LHADecoder structure,
 	// then the private data area used by the algorithm,
-	// followed by the output buffer,
+	// followed by the output buffer, and the feed buffer.
 
 	decoder = calloc(1, sizeof(LHADecoder) + dtype->extra_size
-	                        + dtype->max_read);
+	                        + dtype->max_read + feedbuf_size);
 
 	if (decoder == NULL) {
 		return NULL;
 	}
 
 	decoder->dtype = dtype;
-	decoder->progress_callback = NULL;
-	decoder->last_block = UINT_MAX;
-	decoder->outbuf_pos = 0;
-	decoder->outbuf_len = 0;
-	decoder->stream_pos = 0;
-	decoder->stream_length = stream_length;
-	decoder->decoder_failed = 0;
-	decoder->crc = 0;
+	init_decoder_state(decoder, stream_length);
 
 	// Private data area follows the structure.
 
 	extra_data = decoder + 1;
 	decoder->outbuf = ((uint8_t *) extra_data) + dtype->extra_size;
 
+	if (feedbuf_size > 0) {
+		decoder->feedbuf = decoder->outbuf + dtype->max_read;
+	}
+
+	return decoder;
+}
+
+LHADecoder *lha_decoder_new(LHADecoderType *dtype,
+                            LHADecoderCallback callback,
+                            void *callback_data,
+                            size_t stream_length)
+{
+	LHADecoder *decoder;
+
+	decoder = alloc_decoder(dtype, stream_length, 0);
+
+	if (decoder == NULL) {
+		return NULL;
+	}
+
+	if (dtype->init != NULL
+	 && !dtype->init(decoder + 1, callback, callback_data)) {
+		free(decoder);
+		return NULL;
+	}
+
+	return decoder;
+}
+
+LHADecoder *lha_decoder_new_push(LHADecoderType *dtype,
+                                 size_t stream_length)
+{
+	LHADecoder *decoder;
+
+	decoder = alloc_decoder(dtype, stream_length, FEED_BUFFER_SIZE);
+
+	if (decoder == NULL) {
+		return NULL;
+	}
+
 	if (dtype->init != NULL
-	 && !dtype->init(extra_data, callback, callback_data)) {
+	 && !dtype->init(decoder + 1, feed_callback, decoder)) {
 		free(decoder);
 		return NULL;
 	}
@@ -108,6 +216,44 @@ LHADecoder *lha_decoder_new(LHADecoderType *dtype,
 	return decoder;
 }
 
+int lha_decoder_reset(LHADecoder *decoder,
+                      LHADecoderCallback callback,
+                      void *callback_data,
+                      size_t stream_length)
+{
+	LHADecoderType *dtype;
+	void *extra_data;
+
+	dtype = decoder->dtype;
+	extra_data = decoder + 1;
+
+	init_decoder_state(decoder, stream_length);
+
+	if (decoder->feedbuf != NULL) {
+		callback = feed_callback;
+		callback_data = decoder;
+	}
+
+	if (dtype->reset != NULL) {
+		return dtype->reset(extra_data, callback, callback_data);
+	}
+
+	// No reset function, so shut down the decoder and initialize
+	// it again, from the same zeroed state as a new decoder.
+
+	if (dtype->free != NULL) {
+		dtype->free(extra_data);
+	}
+
+	memset(extra_data, 0, dtype->extra_size);
+
+	if (dtype->init != NULL) {
+		return dtype->init(extra_data, callback, callback_data);
+	}
+
+	return 1;
+}
+
 LHADecoderType *lha_decoder_for_name(char *name)
 {
 	unsigned int i;
@@ -168,6 +314,14 @@ void lha_decoder_monitor(LHADecoder *decoder,
 	check_progress_callback(decoder);
 }
 
+void lha_decoder_set_borrow(LHADecoder *decoder,
+                            LHADecoderBorrowCallback borrow)
+{
+	if (decoder->dtype->set_borrow != NULL) {
+		decoder->dtype->set_borrow(decoder + 1, borrow);
+	}
+}
+
 size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 {
 	size_t filled, bytes;
@@ -185,7 +339,9 @@ size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 	// Try to fill up the buffer that has been passed with as much
 	// data as possible. Each call to read() will fill up outbuf
 	// with some data; this is then copied into buf, with some
-	// data left at the end for the next call.
+	// data left at the end for the next call. If the decoder
+	// supports it, read_bulk() is used to decode directly into buf
+	// whenever there is enough space.
 
 	filled = 0;
 
@@ -211,14 +367,50 @@ size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 			break;
 		}
 
+		// If outbuf is empty and there is enough space, decode
+		// as much data as possible straight into buf.
+
+		if (decoder->dtype->read_bulk != NULL
+		 && decoder->feedbuf == NULL
+		 && decoder->outbuf_pos >= decoder->outbuf_len
+		 && buf_len - filled >= decoder->dtype->max_read) {
+			bytes = decoder->dtype->read_bulk(decoder + 1,
+			                                  buf + filled,
+			                                  buf_len - filled);
+
+			if (bytes == 0) {
+				decoder->decoder_failed = 1;
+				break;
+			}
+
+			filled += bytes;
+			continue;
+		}
+
 		// If outbuf is now empty, we can process another run to
 		// re-fill it.
 
 		if (decoder->outbuf_pos >= decoder->outbuf_len) {
+
+			// A push decoder must wait until enough data has
+			// been fed to decode a whole command.
+
+			if (decoder->feedbuf != NULL && !decoder->feed_eof
+			 && decoder->feedbuf_len - decoder->feedbuf_pos
+			      < FEED_INPUT_RESERVE) {
+				break;
+			}
+
 			decoder->outbuf_len
 			    = decoder->dtype->read(decoder + 1,
 			                           decoder->outbuf);
 			decoder->outbuf_pos = 0;
+
+			// If the fed data ran out, the output is not valid.
+
+			if (decoder->feed_overrun) {
+				decoder->outbuf_len = 0;
+			}
 		}
 
 		// No more data to be read?
@@ -246,6 +438,227 @@ size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 	return filled;
 }
 
+size_t lha_decoder_read_linear(LHADecoder *decoder, uint8_t *buf,
+                               size_t buf_len)
+{
+	size_t start, pos, limit, bytes;
+
+	if (buf_len > decoder->stream_length) {
+		buf_len = decoder->stream_length;
+	}
+
+	start = decoder->stream_pos;
+
+	if (start >= buf_len) {
+		return 0;
+	}
+
+	// Decoders that cannot use the buffer as their history, and push
+	// decoders, decode into the buffer in the normal way.
+
+	if (decoder->dtype->read_linear == NULL || decoder->feedbuf != NULL) {
+		return lha_decoder_read(decoder, buf + start, buf_len - start);
+	}
+
+	// Any data still waiting in the output buffer comes first.
+
+	pos = start;
+	bytes = decoder->outbuf_len - decoder->outbuf_pos;
+
+	if (bytes > buf_len - pos) {
+		bytes = buf_len - pos;
+	}
+
+	memcpy(buf + pos, decoder->outbuf + decoder->outbuf_pos, bytes);
+	decoder->outbuf_pos += bytes;
+	lha_crc16_buf(&decoder->crc, buf + pos, bytes);
+	decoder->stream_pos += bytes;
+	pos += bytes;
+
+	while (pos < buf_len && !decoder->decoder_failed) {
+		limit = pos + LINEAR_CHUNK_SIZE;
+
+		if (limit > buf_len) {
+			limit = buf_len;
+		}
+
+		bytes = decoder->dtype->read_linear(decoder + 1, buf, pos,
+		                                    limit, buf_len) - pos;
+		decoder->linear = 1;
+
+		if (pos + bytes < limit) {
+			decoder->decoder_failed = 1;
+		}
+
+		lha_crc16_buf(&decoder->crc, buf + pos, bytes);
+		decoder->stream_pos += bytes;
+		pos += bytes;
+
+		if (decoder->progress_callback != NULL) {
+			check_progress_callback(decoder);
+		}
+	}
+
+	return pos - start;
+}
+
+size_t lha_decoder_state_size(LHADecoderType *dtype)
+{
+	if (dtype->save_state == NULL) {
+		return 0;
+	}
+
+	return STATE_HEADER_LEN + dtype->state_size;
+}
+
+int lha_decoder_save_state(LHADecoder *decoder, uint8_t *buf)
+{
+	uint64_t input_bits;
+	size_t pending;
+	uint16_t crc;
+
+	if (decoder->dtype->save_state == NULL || decoder->feedbuf != NULL
+	 || decoder->decoder_failed || decoder->linear) {
+		return 0;
+	}
+
+	input_bits = decoder->dtype->save_state(decoder + 1,
+	                                        buf + STATE_HEADER_LEN);
+
+	// The decoder's state is after the data waiting in the output
+	// buffer was decoded, so the saved position and CRC are too.
+
+	pending = decoder->outbuf_len - decoder->outbuf_pos;
+	crc = decoder->crc;
+	lha_crc16_buf(&crc, decoder->outbuf + decoder->outbuf_pos, pending);
+
+	lha_encode_uint64(buf, decoder->stream_pos + pending);
+	lha_encode_uint64(buf + 8, input_bits);
+	lha_encode_uint16(buf + 16, crc);
+
+	return 1;
+}
+
+size_t lha_decoder_state_position(uint8_t *buf)
+{
+	return (size_t) lha_decode_uint64(buf);
+}
+
+uint64_t lha_decoder_state_input_position(uint8_t *buf)
+{
+	return lha_decode_uint64(buf + 8) / 8;
+}
+
+int lha_decoder_restore_state(LHADecoder *decoder, uint8_t *buf,
+                              LHADecoderCallback callback,
+                              void *callback_data)
+{
+	LHADecoderProgressCallback progress_callback;
+	void *progress_callback_data;
+	uint64_t output_pos;
+
+	output_pos = lha_decode_uint64(buf);
+
+	if (decoder->dtype->restore_state == NULL || decoder->feedbuf != NULL
+	 || output_pos > decoder->stream_length) {
+		return 0;
+	}
+
+	// Resetting the decoder removes the progress callback.
+
+	progress_callback = decoder->progress_callback;
+	progress_callback_data = decoder->progress_callback_data;
+
+	if (!lha_decoder_reset(decoder, callback, callback_data,
+	                       decoder->stream_length)) {
+		decoder->decoder_failed = 1;
+		return 0;
+	}
+
+	decoder->progress_callback = progress_callback;
+	decoder->progress_callback_data = progress_callback_data;
+
+	if (!decoder->dtype->restore_state(decoder + 1,
+	                                   buf + STATE_HEADER_LEN,
+	                                   lha_decode_uint64(buf + 8))) {
+		decoder->decoder_failed = 1;
+		return 0;
+	}
+
+	decoder->stream_pos = (size_t) output_pos;
+	decoder->crc = lha_decode_uint16(buf + 16);
+
+	return 1;
+}
+
+// Copy as much fed data as possible into a push decoder's feed buffer,
+// returning the number of bytes copied.
+
+static size_t fill_feed_buffer(LHADecoder *decoder,
+                               const uint8_t *in, size_t in_len)
+{
+	size_t bytes;
+
+	// Move unread data back to the start of the buffer.
+
+	bytes = decoder->feedbuf_len - decoder->feedbuf_pos;
+	memmove(decoder->feedbuf, decoder->feedbuf + decoder->feedbuf_pos,
+	        bytes);
+	decoder->feedbuf_pos = 0;
+	decoder->feedbuf_len = bytes;
+
+	bytes = FEED_BUFFER_SIZE - decoder->feedbuf_len;
+
+	if (bytes > in_len) {
+		bytes = in_len;
+	}
+
+	memcpy(decoder->feedbuf + decoder->feedbuf_len, in, bytes);
+	decoder->feedbuf_len += bytes;
+
+	return bytes;
+}
+
+int lha_decoder_feed(LHADecoder *decoder,
+                     const uint8_t *in, size_t in_len,
+                     uint8_t *out, size_t out_cap,
+                     size_t *consumed, size_t *produced)
+{
+	size_t bytes;
+
+	*consumed = 0;
+	*produced = 0;
+
+	if (decoder->feedbuf == NULL) {
+		return 0;
+	}
+
+	// Alternate between filling the feed buffer and decoding from
+	// it, until no more data can be decoded, either because the
+	// output buffer is full, or more data needs to be fed.
+
+	do {
+		if (*consumed < in_len) {
+			*consumed += fill_feed_buffer(decoder, in + *consumed,
+			                              in_len - *consumed);
+		}
+
+		bytes = lha_decoder_read(decoder, out + *produced,
+		                         out_cap - *produced);
+		*produced += bytes;
+	} while (bytes > 0);
+
+	return !decoder->decoder_failed
+	    || decoder->stream_pos >= decoder->stream_length;
+}
+
+void lha_decoder_feed_end(LHADecoder *decoder)
+{
+	if (decoder->feedbuf != NULL) {
+		decoder->feed_eof = 1;
+	}
+}
+
 uint16_t lha_decoder_get_crc(LHADecoder *decoder)
 {
 	return decoder->crc;
@@ -23,6 +23,22 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "public/lha_decoder.h"
 
+/**
+ * Callback function used to borrow compressed data from the input
+ * stream without copying it.
+ *
+ * @param buf            Pointer to a variable in which to store a
+ *                       pointer to the data.
+ * @param buf_len        Maximum number of bytes to return.
+ * @param user_data      Extra pointer passed to the callback.
+ * @return               Number of bytes available, or zero if no
+ *                       more data can be borrowed.
+ */
+
+typedef size_t (*LHADecoderBorrowCallback)(const uint8_t **buf,
+                                           size_t buf_len,
+                                           void *user_data);
+
 struct _LHADecoderType {
 
 	/**
@@ -75,6 +91,112 @@ struct _LHADecoderType {
 	    progress bar. */
 
 	size_t block_size;
+
+	/**
+	 * Callback function to set a function to use to borrow
+	 * compressed data from the input stream, instead of copying it
+	 * through the read callback. This is optional, and only
+	 * provided by decoders that can make use of it.
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param borrow         Callback function to borrow data.
+	 */
+
+	void (*set_borrow)(void *extra_data, LHADecoderBorrowCallback borrow);
+
+	/**
+	 * Callback function to decompress as much data as will fit
+	 * into the specified buffer, processing multiple commands in a
+	 * single call. This is optional; if it is not provided, read()
+	 * is used instead.
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param buf            Pointer to the buffer in which to store
+	 *                       the decompressed data.
+	 * @param buf_len        Size of the buffer, in bytes. This is
+	 *                       at least 'max_read' bytes.
+	 * @return               Number of bytes decompressed, or zero
+	 *                       for end of stream or error.
+	 */
+
+	size_t (*read_bulk)(void *extra_data, uint8_t *buf, size_t buf_len);
+
+	/**
+	 * Callback function to reset the decoder to its initial state,
+	 * to decompress a new stream. This is optional; if it is not
+	 * provided, the decoder is freed (if it has a free callback),
+	 * its extra data area cleared and init() called again. Decoders
+	 * can provide it if they can avoid reinitializing everything.
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param callback       Callback function to invoke to read more
+	 *                       compressed data.
+	 * @param callback_data  Extra pointer to pass to the callback.
+	 * @return               Non-zero for success.
+	 */
+
+	int (*reset)(void *extra_data,
+	             LHADecoderCallback callback,
+	             void *callback_data);
+
+	/**
+	 * Callback function to decompress data into a buffer holding
+	 * all output from the start of the stream, using the data in
+	 * the buffer as the history for copies. This is optional; see
+	 * @ref lha_decoder_read_linear. History from before the start
+	 * of the stream must be handled by the decoder.
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param buf            Pointer to the start of the buffer.
+	 * @param pos            Position in the buffer at which to
+	 *                       continue decoding.
+	 * @param limit          Decoding stops once this position has
+	 *                       been reached.
+	 * @param buf_len        Size of the buffer; nothing is written
+	 *                       beyond this.
+	 * @return               New position in the buffer. This is
+	 *                       less than 'limit' for error.
+	 */
+
+	size_t (*read_linear)(void *extra_data, uint8_t *buf, size_t pos,
+	                      size_t limit, size_t buf_len);
+
+	/** Number of bytes of state saved by save_state(). */
+
+	size_t state_size;
+
+	/**
+	 * Callback function to save the state of the decoder, so that
+	 * decoding can later continue from the same point. This is
+	 * optional; see @ref lha_decoder_save_state. It is only called
+	 * between calls to read() or read_bulk().
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param buf            Buffer of 'state_size' bytes in which to
+	 *                       store the state.
+	 * @return               Position in the input stream of the next
+	 *                       bit of compressed data to be read.
+	 */
+
+	uint64_t (*save_state)(void *extra_data, uint8_t *buf);
+
+	/**
+	 * Callback function to restore a state saved by save_state().
+	 * The decoder has just been reset, with a callback function that
+	 * reads the compressed data from the byte containing the next bit
+	 * to be read. The state might have been read from a file, so it
+	 * must be checked before it is used.
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param buf            Pointer to the saved state.
+	 * @param input_bits     Position in the input stream of the next
+	 *                       bit of compressed data to be read.
+	 * @return               Non-zero for success, or zero if the state
+	 *                       is not valid.
+	 */
+
+	int (*restore_state)(void *extra_data, uint8_t *buf,
+	                     uint64_t input_bits);
 };
 
 struct _LHADecoder {
@@ -108,6 +230,42 @@ struct _LHADecoder {
 	/** Current CRC of the output stream. */
 
 	uint16_t crc;
+
+	/**
+	 * For push decoders (see @ref lha_decoder_new_push), buffer
+	 * holding compressed data passed to @ref lha_decoder_feed that
+	 * the decoder has not yet read. NULL for other decoders.
+	 */
+
+	uint8_t *feedbuf;
+	size_t feedbuf_pos, feedbuf_len;
+
+	/** If true, the end of the compressed data has been fed. */
+
+	unsigned int feed_eof;
+
+	/** If true, the decoder ran out of fed data part way through
+	    a call to read(). */
+
+	unsigned int feed_overrun;
+
+	/** If true, data has been decoded using read_linear(), so the
+	    decoder's own history is not up to date. */
+
+	unsigned int linear;
 };
 
+/**
+ * Set a callback function for the decoder to use to borrow compressed
+ * data from the input stream. The callback is passed the same
+ * callback_data pointer as the read callback. If the decoder does not
+ * support borrowing, this has no effect.
+ *
+ * @param decoder        The decoder.
+ * @param borrow         Callback function to borrow data.
+ */
+
+void lha_decoder_set_borrow(LHADecoder *decoder,
+                            LHADecoderBorrowCallback borrow);
+
 #endif /* #ifndef LHASA_LHA_DECODER_H */
@@ -0,0 +1,572 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc16.h"
+#include "lha_encoder.h"
+
+// Size of the chunks of data compressed by worker threads, for parallel
+// encoders. Each chunk is compressed separately, ending with a partial
+// block, so larger chunks compress slightly better.
+
+#define CHUNK_SIZE (1024 * 1024) /* bytes */
+
+// Number of chunks that a parallel encoder has waiting to be compressed
+// or collected for each thread, so that the threads are kept busy.
+
+#define CHUNKS_PER_THREAD 2
+
+// A chunk of data compressed by a worker thread.
+
+struct _LHAEncoderJob {
+	LHAEncoderType *etype;
+	int level;
+
+	// Data to compress, preceded by history_len bytes of history
+	// from before the chunk, and the position reached by the encoder.
+
+	uint8_t *data;
+	size_t history_len, data_len, pos;
+
+	// Compressed data, and the number of zero bits at the end that
+	// pad it to a whole byte.
+
+	uint8_t *output;
+	size_t output_len;
+	unsigned int padding_bits;
+
+	// If non-zero, the chunk could not be compressed.
+
+	int failed;
+};
+
+// LHarc compression algorithms:
+extern LHAEncoderType lha_lh5_encoder;
+extern LHAEncoderType lha_lh6_encoder;
+extern LHAEncoderType lha_lh7_encoder;
+
+static struct {
+	char *name;
+	LHAEncoderType *etype;
+} encoders[] = {
+	{ "-lh5-", &lha_lh5_encoder },
+	{ "-lh6-", &lha_lh6_encoder },
+	{ "-lh7-", &lha_lh7_encoder },
+};
+
+// Callback function used by the encoder to read data to compress. The
+// data is passed through from the caller's callback, keeping track of
+// its length and CRC for the file header.
+
+static size_t read_callback(void *buf, size_t buf_len, void *user_data)
+{
+	LHAEncoder *encoder = user_data;
+	size_t bytes;
+
+	bytes = encoder->callback(buf, buf_len, encoder->callback_data);
+
+	lha_crc16_buf(&encoder->crc, buf, bytes);
+	encoder->stream_pos += bytes;
+
+	return bytes;
+}
+
+// Callback function used by the encoder compressing a chunk, to read
+// the data in the chunk.
+
+static size_t read_job_data(void *buf, size_t buf_len, void *user_data)
+{
+	LHAEncoderJob *job = user_data;
+	size_t bytes;
+
+	bytes = job->data_len - job->pos;
+
+	if (bytes > buf_len) {
+		bytes = buf_len;
+	}
+
+	memcpy(buf, job->data + job->pos, bytes);
+	job->pos += bytes;
+
+	return bytes;
+}
+
+// Compress a chunk, using an encoder that has been allocated for it.
+// Returns zero for failure.
+
+static int compress_job(LHAEncoderJob *job, void *extra_data)
+{
+	LHAEncoderType *etype = job->etype;
+	size_t output_size, bytes;
+	uint8_t *new_output;
+
+	if (etype->init != NULL
+	 && !etype->init(extra_data, job->level, read_job_data, job)) {
+		return 0;
+	}
+
+	etype->set_history(extra_data, job->data, job->history_len);
+
+	// Each call to read() needs space for max_read bytes.
+
+	output_size = 0;
+
+	do {
+		if (job->output_len + etype->max_read > output_size) {
+			output_size = (output_size + etype->max_read) * 2;
+			new_output = realloc(job->output, output_size);
+
+			if (new_output == NULL) {
+				return 0;
+			}
+
+			job->output = new_output;
+		}
+
+		bytes = etype->read(extra_data, job->output + job->output_len);
+		job->output_len += bytes;
+	} while (bytes > 0);
+
+	job->padding_bits = etype->padding_bits(extra_data);
+
+	return 1;
+}
+
+// Compress a chunk. Invoked from a worker thread.
+
+static void encode_job(void *data)
+{
+	LHAEncoderJob *job = data;
+	void *extra_data;
+
+	extra_data = calloc(1, job->etype->extra_size);
+
+	if (extra_data == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	job->failed = !compress_job(job, extra_data);
+
+	if (job->etype->free != NULL) {
+		job->etype->free(extra_data);
+	}
+
+	free(extra_data);
+}
+
+static void free_job(LHAEncoderJob *job)
+{
+	free(job->data);
+	free(job->output);
+	free(job);
+}
+
+// Read the next chunk of data to compress, with the history from the
+// end of the previous chunk. Returns NULL at the end of the data, or
+// if memory cannot be allocated (setting chunk_failed).
+
+static LHAEncoderJob *read_chunk(LHAEncoder *encoder)
+{
+	LHAEncoderJob *job;
+	size_t history_len, keep, bytes;
+
+	job = calloc(1, sizeof(LHAEncoderJob));
+
+	if (job == NULL) {
+		encoder->chunk_failed = 1;
+		return NULL;
+	}
+
+	history_len = encoder->history_len;
+	job->data = malloc(history_len + CHUNK_SIZE);
+
+	if (job->data == NULL) {
+		free(job);
+		encoder->chunk_failed = 1;
+		return NULL;
+	}
+
+	job->etype = encoder->etype;
+	job->level = encoder->level;
+	job->history_len = history_len;
+	job->pos = history_len;
+	memcpy(job->data, encoder->history, history_len);
+
+	job->data_len = history_len;
+
+	while (job->data_len < history_len + CHUNK_SIZE) {
+		bytes = encoder->callback(job->data + job->data_len,
+		                          history_len + CHUNK_SIZE
+		                            - job->data_len,
+		                          encoder->callback_data);
+
+		if (bytes == 0) {
+			encoder->input_eof = 1;
+			break;
+		}
+
+		job->data_len += bytes;
+	}
+
+	if (job->data_len == history_len) {
+		free_job(job);
+		return NULL;
+	}
+
+	// The end of this chunk is the history for the next one.
+
+	keep = job->data_len;
+
+	if (keep > encoder->etype->history_size) {
+		keep = encoder->etype->history_size;
+	}
+
+	memcpy(encoder->history, job->data + job->data_len - keep, keep);
+	encoder->history_len = keep;
+
+	return job;
+}
+
+// Append the compressed data for a chunk to the compressed data so far.
+// Chunks do not end on a byte boundary, so the data is shifted in place
+// to follow the bits left over from the previous chunk. Returns the
+// number of whole bytes that are ready to be output; the bits after
+// them are kept for the next chunk.
+
+static size_t append_job_output(LHAEncoder *encoder, LHAEncoderJob *job)
+{
+	uint8_t *p = job->output;
+	unsigned int shift, prev, b, rem;
+	size_t i, full, total_bits;
+
+	shift = encoder->carry_bits;
+	prev = encoder->carry;
+
+	if (shift > 0) {
+		for (i = 0; i < job->output_len; ++i) {
+			b = p[i];
+			p[i] = (uint8_t) ((prev << (8 - shift)) | (b >> shift));
+			prev = b & ((1U << shift) - 1);
+		}
+	}
+
+	// The padding at the end of the chunk is dropped. The last few
+	// bits are either at the start of the byte after the whole
+	// bytes, or in the bits shifted out of the end.
+
+	total_bits = shift + job->output_len * 8 - job->padding_bits;
+	full = total_bits / 8;
+	rem = (unsigned int) (total_bits % 8);
+
+	if (full < job->output_len) {
+		encoder->carry = (uint8_t) (p[full] >> (8 - rem));
+	} else {
+		encoder->carry = (uint8_t) (prev >> (shift - rem));
+	}
+
+	encoder->carry_bits = rem;
+
+	return full;
+}
+
+// Get more compressed data from a parallel encoder, setting outbuf to
+// point to it. Returns the number of bytes, or zero at the end of the
+// compressed data.
+
+static size_t read_parallel(LHAEncoder *encoder)
+{
+	LHAEncoderJob *job;
+
+	if (encoder->job != NULL) {
+		free_job(encoder->job);
+		encoder->job = NULL;
+	}
+
+	// Read more chunks to keep all the threads busy.
+
+	while (!encoder->input_eof && !encoder->chunk_failed
+	    && worker_pool_pending(encoder->pool) < encoder->max_jobs) {
+		job = read_chunk(encoder);
+
+		if (job == NULL) {
+			break;
+		}
+
+		if (!worker_pool_submit(encoder->pool, job)) {
+			free_job(job);
+			encoder->chunk_failed = 1;
+			break;
+		}
+	}
+
+	// Collect the next chunk, in order. If a chunk could not be
+	// compressed, stop there, so that the data compressed so far is
+	// still valid.
+
+	job = NULL;
+
+	if (!encoder->chunk_failed) {
+		job = worker_pool_wait(encoder->pool, 1);
+
+		if (job != NULL && job->failed) {
+			free_job(job);
+			encoder->chunk_failed = 1;
+			job = NULL;
+		}
+	}
+
+	// At the end, output the last few bits, padded to a whole byte.
+
+	if (job == NULL) {
+		if (encoder->carry_bits == 0) {
+			return 0;
+		}
+
+		encoder->carry <<= 8 - encoder->carry_bits;
+		encoder->carry_bits = 0;
+		encoder->outbuf = &encoder->carry;
+
+		return 1;
+	}
+
+	// The length and CRC only include data that has been compressed.
+
+	lha_crc16_buf(&encoder->crc, job->data + job->history_len,
+	              job->data_len - job->history_len);
+	encoder->stream_pos += job->data_len - job->history_len;
+
+	encoder->job = job;
+	encoder->outbuf = job->output;
+
+	return append_job_output(encoder, job);
+}
+
+// Set the generic encoder state for a new encoder.
+
+static void init_encoder_state(LHAEncoder *encoder, LHAEncoderType *etype,
+                               int level, LHAEncoderCallback callback,
+                               void *callback_data)
+{
+	encoder->etype = etype;
+	encoder->level = level;
+	encoder->callback = callback;
+	encoder->callback_data = callback_data;
+	encoder->stream_pos = 0;
+	encoder->outbuf_pos = 0;
+	encoder->outbuf_len = 0;
+	encoder->encoder_finished = 0;
+	encoder->crc = 0;
+	encoder->pool = NULL;
+	encoder->job = NULL;
+	encoder->history_len = 0;
+	encoder->input_eof = 0;
+	encoder->carry = 0;
+	encoder->carry_bits = 0;
+	encoder->chunk_failed = 0;
+}
+
+LHAEncoder *lha_encoder_new(LHAEncoderType *etype,
+                            int level,
+                            LHAEncoderCallback callback,
+                            void *callback_data)
+{
+	LHAEncoder *encoder;
+	void *extra_data;
+
+	if (level < LHA_ENCODER_MIN_LEVEL || level > LHA_ENCODER_MAX_LEVEL) {
+		return NULL;
+	}
+
+	// Space is allocated together: the LHAEncoder structure,
+	// then the private data area used by the algorithm,
+	// followed by the output buffer.
+
+	encoder = calloc(1, sizeof(LHAEncoder) + etype->extra_size
+	                        + etype->max_read);
+
+	if (encoder == NULL) {
+		return NULL;
+	}
+
+	init_encoder_state(encoder, etype, level, callback, callback_data);
+
+	// Private data area follows the structure.
+
+	extra_data = encoder + 1;
+	encoder->outbuf = ((uint8_t *) extra_data) + etype->extra_size;
+
+	if (etype->init != NULL
+	 && !etype->init(extra_data, level, read_callback, encoder)) {
+		free(encoder);
+		return NULL;
+	}
+
+	return encoder;
+}
+
+LHAEncoder *lha_encoder_new_parallel(LHAEncoderType *etype,
+                                     int level,
+                                     unsigned int num_threads,
+                                     LHAEncoderCallback callback,
+                                     void *callback_data)
+{
+	LHAEncoder *encoder;
+
+	if (level < LHA_ENCODER_MIN_LEVEL || level > LHA_ENCODER_MAX_LEVEL
+	 || etype->set_history == NULL || num_threads == 0) {
+		return NULL;
+	}
+
+	// The history buffer follows the structure. Chunks are
+	// compressed by their own encoders, so there is no private data
+	// area for the algorithm, and the output buffer is the output
+	// from each chunk in turn.
+
+	encoder = calloc(1, sizeof(LHAEncoder) + etype->history_size);
+
+	if (encoder == NULL) {
+		return NULL;
+	}
+
+	init_encoder_state(encoder, etype, level, callback, callback_data);
+	encoder->history = (uint8_t *) (encoder + 1);
+
+	encoder->pool = worker_pool_new(num_threads, encode_job);
+
+	if (encoder->pool == NULL) {
+		free(encoder);
+		return NULL;
+	}
+
+	encoder->max_jobs = num_threads * CHUNKS_PER_THREAD;
+
+	return encoder;
+}
+
+LHAEncoderType *lha_encoder_for_name(char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(encoders) / sizeof(*encoders); ++i) {
+		if (!strcmp(name, encoders[i].name)) {
+			return encoders[i].etype;
+		}
+	}
+
+	// Unknown?
+
+	return NULL;
+}
+
+void lha_encoder_free(LHAEncoder *encoder)
+{
+	LHAEncoderJob *job;
+
+	if (encoder->pool != NULL) {
+		while ((job = worker_pool_wait(encoder->pool, 1)) != NULL) {
+			free_job(job);
+		}
+
+		worker_pool_free(encoder->pool);
+
+		if (encoder->job != NULL) {
+			free_job(encoder->job);
+		}
+	} else if (encoder->etype->free != NULL) {
+		encoder->etype->free(encoder + 1);
+	}
+
+	free(encoder);
+}
+
+size_t lha_encoder_read(LHAEncoder *encoder, uint8_t *buf, size_t buf_len)
+{
+	size_t filled, bytes;
+
+	// Fill the buffer with as much data as possible. Each call to
+	// read() fills outbuf with some compressed data (typically a
+	// whole block); this is then copied into buf, with some data
+	// left at the end for the next call.
+
+	filled = 0;
+
+	while (filled < buf_len) {
+
+		// Try to empty out some of the output buffer first.
+
+		bytes = encoder->outbuf_len - encoder->outbuf_pos;
+
+		if (buf_len - filled < bytes) {
+			bytes = buf_len - filled;
+		}
+
+		memcpy(buf + filled, encoder->outbuf + encoder->outbuf_pos,
+		       bytes);
+		encoder->outbuf_pos += bytes;
+		filled += bytes;
+
+		// Once the end of the stream has been reached, don't call
+		// the read function again.
+
+		if (encoder->encoder_finished) {
+			break;
+		}
+
+		// If outbuf is now empty, compress some more data to
+		// re-fill it.
+
+		if (encoder->outbuf_pos >= encoder->outbuf_len) {
+			if (encoder->pool != NULL) {
+				encoder->outbuf_len = read_parallel(encoder);
+			} else {
+				encoder->outbuf_len
+				    = encoder->etype->read(encoder + 1,
+				                           encoder->outbuf);
+			}
+
+			encoder->outbuf_pos = 0;
+
+			if (encoder->outbuf_len == 0) {
+				encoder->encoder_finished = 1;
+				break;
+			}
+		}
+	}
+
+	return filled;
+}
+
+int lha_encoder_failed(LHAEncoder *encoder)
+{
+	return encoder->chunk_failed;
+}
+
+uint16_t lha_encoder_get_crc(LHAEncoder *encoder)
+{
+	return encoder->crc;
+}
+
+size_t lha_encoder_get_length(LHAEncoder *encoder)
+{
+	return encoder->stream_pos;
+}
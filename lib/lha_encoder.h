@@ -0,0 +1,181 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_LHA_ENCODER_H
+#define LHASA_LHA_ENCODER_H
+
+#include "public/lha_encoder.h"
+#include "worker_pool.h"
+
+typedef struct _LHAEncoderJob LHAEncoderJob;
+
+struct _LHAEncoderType {
+
+	/**
+	 * Callback function to initialize the encoder.
+	 *
+	 * @param extra_data     Pointer to the extra data area allocated for
+	 *                       the encoder.
+	 * @param level          Compression level.
+	 * @param callback       Callback function to invoke to read more
+	 *                       data to compress.
+	 * @param callback_data  Extra pointer to pass to the callback.
+	 * @return               Non-zero for success.
+	 */
+
+	int (*init)(void *extra_data,
+	            int level,
+	            LHAEncoderCallback callback,
+	            void *callback_data);
+
+	/**
+	 * Callback function to free the encoder.
+	 *
+	 * @param extra_data     Pointer to the extra data area allocated for
+	 *                       the encoder.
+	 */
+
+	void (*free)(void *extra_data);
+
+	/**
+	 * Callback function to read (ie. compress) data from the
+	 * encoder.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @param buf            Pointer to the buffer in which to store
+	 *                       the compressed data.  The buffer is
+	 *                       at least 'max_read' bytes in size.
+	 * @return               Number of bytes of compressed data, or
+	 *                       zero for the end of the stream.
+	 */
+
+	size_t (*read)(void *extra_data, uint8_t *buf);
+
+	/** Number of bytes of extra data to allocate for the encoder. */
+
+	size_t extra_size;
+
+	/** Maximum number of bytes that might be put into the buffer by
+	    a single call to read() */
+
+	size_t max_read;
+
+	/**
+	 * Callback function to set the data that comes before the data
+	 * to be compressed, so that copies can be made from it. This is
+	 * optional; encoders that provide it can compress chunks of data
+	 * in parallel (see @ref lha_encoder_new_parallel). It is called
+	 * after init(), before any data is read.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @param buf            Pointer to the history data.
+	 * @param buf_len        Length of the history data, in bytes. This
+	 *                       is at most 'history_size' bytes.
+	 */
+
+	void (*set_history)(void *extra_data, const uint8_t *buf,
+	                    size_t buf_len);
+
+	/** Maximum number of bytes of history used by set_history(). */
+
+	size_t history_size;
+
+	/**
+	 * Callback function to get the number of zero bits that were
+	 * added to the end of the compressed data, to pad it to a whole
+	 * number of bytes. Must be provided if set_history() is. It is
+	 * called once read() has returned zero.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @return               Number of padding bits, from 0 to 7.
+	 */
+
+	unsigned int (*padding_bits)(void *extra_data);
+};
+
+struct _LHAEncoder {
+
+	/** Type of encoder (algorithm) */
+
+	LHAEncoderType *etype;
+
+	/** Callback function to read data to compress. */
+
+	LHAEncoderCallback callback;
+	void *callback_data;
+
+	/** Number of bytes of data read so far. */
+
+	size_t stream_pos;
+
+	/** Output buffer, containing compressed data not yet returned. */
+
+	size_t outbuf_pos, outbuf_len;
+	uint8_t *outbuf;
+
+	/** If true, the encoder read() function returned zero. */
+
+	unsigned int encoder_finished;
+
+	/** Current CRC of the data read so far. */
+
+	uint16_t crc;
+
+	/** Compression level. */
+
+	int level;
+
+	/**
+	 * For parallel encoders (see @ref lha_encoder_new_parallel),
+	 * pool of worker threads used to compress chunks of data, and
+	 * the most chunks to have waiting at once. NULL for other
+	 * encoders.
+	 */
+
+	WorkerPool *pool;
+	unsigned int max_jobs;
+
+	/** Chunk whose compressed data is in outbuf. */
+
+	LHAEncoderJob *job;
+
+	/** The most recent data read, used as the history for the
+	    next chunk. */
+
+	uint8_t *history;
+	size_t history_len;
+
+	/** If true, the end of the data has been read. */
+
+	unsigned int input_eof;
+
+	/** Bits at the end of the compressed data so far that do not
+	    fill a whole byte, and how many there are. */
+
+	uint8_t carry;
+	unsigned int carry_bits;
+
+	/** If true, a chunk could not be compressed, so compression
+	    stopped early. */
+
+	unsigned int chunk_failed;
+};
+
+#endif /* #ifndef LHASA_LHA_ENCODER_H */
@@ -23,6 +23,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "lha_arch.h"
 #include "lha_input_stream.h"
@@ -53,10 +54,20 @@ typedef enum {
 
 struct _LHAInputStream {
 	const LHAInputStreamType *type;
+
+	// Extended functions, or NULL if the stream was created with
+	// lha_input_stream_new().
+
+	const LHAInputStreamTypeEx *ext;
 	void *handle;
 	LHAInputStreamState state;
 	uint8_t leadin[LEADIN_BUFFER_LEN];
 	size_t leadin_len;
+	uint8_t borrowed[LEADIN_BUFFER_LEN];
+
+	// Number of bytes read from the underlying stream so far.
+
+	uint64_t raw_pos;
 };
 
 LHAInputStream *lha_input_stream_new(const LHAInputStreamType *type,
@@ -71,13 +82,29 @@ LHAInputStream *lha_input_stream_new(const LHAInputStreamType *type,
 	}
 
 	result->type = type;
+	result->ext = NULL;
 	result->handle = handle;
 	result->leadin_len = 0;
+	result->raw_pos = 0;
 	result->state = LHA_INPUT_STREAM_INIT;
 
 	return result;
 }
 
+LHAInputStream *lha_input_stream_new_ex(const LHAInputStreamTypeEx *type,
+                                        void *handle)
+{
+	LHAInputStream *result;
+
+	result = lha_input_stream_new(&type->base, handle);
+
+	if (result != NULL) {
+		result->ext = type;
+	}
+
+	return result;
+}
+
 void lha_input_stream_free(LHAInputStream *stream)
 {
 	// Close the input stream.
@@ -134,7 +161,15 @@ static void empty_leadin(LHAInputStream *stream, size_t bytes)
 
 static int do_read(LHAInputStream *stream, void *buf, size_t buf_len)
 {
-	return stream->type->read(stream->handle, buf, buf_len);
+	int result;
+
+	result = stream->type->read(stream->handle, buf, buf_len);
+
+	if (result > 0) {
+		stream->raw_pos += (unsigned int) result;
+	}
+
+	return result;
 }
 
 // Skip the self-extractor header at the start of the file.
@@ -191,13 +226,12 @@ static int skip_sfx(LHAInputStream *stream)
 	return 0;
 }
 
-int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
-{
-	size_t total_bytes, n;
-	int result;
-
-	// Start of the stream?  Skip self-extract header, if there is one.
+// Check that the stream is in a state where data can be read.
+// At the start of the stream, the self-extract header is skipped, if
+// there is one. Returns zero if the stream has failed.
 
+static int check_stream_state(LHAInputStream *stream)
+{
 	if (stream->state == LHA_INPUT_STREAM_INIT) {
 		if (skip_sfx(stream)) {
 			stream->state = LHA_INPUT_STREAM_READING;
@@ -206,7 +240,16 @@ int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
 		}
 	}
 
-	if (stream->state == LHA_INPUT_STREAM_FAIL) {
+	return stream->state != LHA_INPUT_STREAM_FAIL;
+}
+
+size_t lha_input_stream_read_some(LHAInputStream *stream, void *buf,
+                                  size_t buf_len)
+{
+	size_t total_bytes, n;
+	int result;
+
+	if (!check_stream_state(stream)) {
 		return 0;
 	}
 
@@ -237,9 +280,89 @@ int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
 		}
 	}
 
+	return total_bytes;
+}
+
+int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
+{
 	// Only successful if the complete buffer is filled.
 
-	return total_bytes == buf_len;
+	return lha_input_stream_read_some(stream, buf, buf_len) == buf_len;
+}
+
+int lha_input_stream_can_borrow(LHAInputStream *stream)
+{
+	return stream->ext != NULL && stream->ext->borrow != NULL;
+}
+
+size_t lha_input_stream_borrow(LHAInputStream *stream, const uint8_t **buf,
+                               size_t buf_len)
+{
+	const void *data;
+	int result;
+
+	if (!lha_input_stream_can_borrow(stream)
+	 || !check_stream_state(stream)) {
+		return 0;
+	}
+
+	// Data left over in the lead-in buffer must be returned first.
+	// It is a copy, and may be overwritten by the next call, so
+	// return it by copying it into a buffer owned by the stream.
+
+	if (stream->leadin_len > 0) {
+		if (buf_len > stream->leadin_len) {
+			buf_len = stream->leadin_len;
+		}
+
+		memcpy(stream->borrowed, stream->leadin, buf_len);
+		empty_leadin(stream, buf_len);
+		*buf = stream->borrowed;
+
+		return buf_len;
+	}
+
+	result = stream->ext->borrow(stream->handle, &data, buf_len);
+
+	if (result <= 0) {
+		return 0;
+	}
+
+	*buf = data;
+	stream->raw_pos += (unsigned int) result;
+
+	return (size_t) result;
+}
+
+uint64_t lha_input_stream_tell(LHAInputStream *stream)
+{
+	check_stream_state(stream);
+
+	// Data in the lead-in buffer has been read from the underlying
+	// stream, but not yet returned.
+
+	return stream->raw_pos - stream->leadin_len;
+}
+
+int lha_input_stream_seek(LHAInputStream *stream, uint64_t offset)
+{
+	if (stream->ext == NULL || stream->ext->seek == NULL
+	 || !check_stream_state(stream)) {
+		return 0;
+	}
+
+	// The underlying stream is positioned after any data in the
+	// lead-in buffer, which is discarded.
+
+	if (!stream->ext->seek(stream->handle,
+	                       (int64_t) (offset - stream->raw_pos))) {
+		return 0;
+	}
+
+	stream->raw_pos = offset;
+	stream->leadin_len = 0;
+
+	return 1;
 }
 
 int lha_input_stream_skip(LHAInputStream *stream, size_t bytes)
@@ -248,7 +371,13 @@ int lha_input_stream_skip(LHAInputStream *stream, size_t bytes)
 	// the read function can be used to perform a skip.
 
 	if (stream->type->skip != NULL) {
-		return stream->type->skip(stream->handle, bytes);
+		if (!stream->type->skip(stream->handle, bytes)) {
+			return 0;
+		}
+
+		stream->raw_pos += bytes;
+
+		return 1;
 	} else {
 		uint8_t data[32];
 		unsigned int len;
@@ -354,6 +483,19 @@ static int file_source_skip(void *handle, size_t bytes)
 	return 1;
 }
 
+// Seek forwards or backwards in a FILE * input stream.
+
+static int file_source_seek(void *handle, int64_t offset)
+{
+	// Unseekable streams cannot go backwards at all, so don't try.
+
+	if (ftell(handle) < 0) {
+		return 0;
+	}
+
+	return fseek(handle, (long) offset, SEEK_CUR) == 0;
+}
+
 // Close a FILE * input stream.
 
 static void file_source_close(void *handle)
@@ -364,18 +506,26 @@ static void file_source_close(void *handle)
 // "Owned" file source - the stream will be closed when the input
 // stream is freed.
 
-static const LHAInputStreamType file_source_owned = {
-	file_source_read,
-	file_source_skip,
-	file_source_close
+static const LHAInputStreamTypeEx file_source_owned = {
+	{
+		file_source_read,
+		file_source_skip,
+		file_source_close
+	},
+	NULL,
+	file_source_seek
 };
 
 // "Unowned" file source - the stream is owned by the calling code.
 
-static const LHAInputStreamType file_source_unowned = {
-	file_source_read,
-	file_source_skip,
-	NULL
+static const LHAInputStreamTypeEx file_source_unowned = {
+	{
+		file_source_read,
+		file_source_skip,
+		NULL
+	},
+	NULL,
+	file_source_seek
 };
 
 LHAInputStream *lha_input_stream_from(char *filename)
@@ -389,7 +539,7 @@ LHAInputStream *lha_input_stream_from(char *filename)
 		return NULL;
 	}
 
-	result = lha_input_stream_new(&file_source_owned, fstream);
+	result = lha_input_stream_new_ex(&file_source_owned, fstream);
 
 	if (result == NULL) {
 		fclose(fstream);
@@ -401,5 +551,159 @@ LHAInputStream *lha_input_stream_from(char *filename)
 LHAInputStream *lha_input_stream_from_FILE(FILE *stream)
 {
 	lha_arch_set_binary(stream);
-	return lha_input_stream_new(&file_source_unowned, stream);
+	return lha_input_stream_new_ex(&file_source_unowned, stream);
+}
+
+// Memory source: reads from a block of data in memory, which may
+// have been mapped from a file.
+
+typedef struct {
+	const uint8_t *data;
+	size_t data_len;
+	size_t pos;
+	int mapped;
+} MemorySource;
+
+// Clamp a read length to the data remaining in a memory source.
+
+static size_t memory_source_avail(MemorySource *source, size_t buf_len)
+{
+	size_t remaining;
+
+	remaining = source->data_len - source->pos;
+
+	if (buf_len > remaining) {
+		buf_len = remaining;
+	}
+
+	if (buf_len > INT_MAX) {
+		buf_len = INT_MAX;
+	}
+
+	return buf_len;
+}
+
+static int memory_source_read(void *handle, void *buf, size_t buf_len)
+{
+	MemorySource *source = handle;
+
+	buf_len = memory_source_avail(source, buf_len);
+	memcpy(buf, source->data + source->pos, buf_len);
+	source->pos += buf_len;
+
+	return (int) buf_len;
+}
+
+static int memory_source_borrow(void *handle, const void **buf,
+                                size_t buf_len)
+{
+	MemorySource *source = handle;
+
+	buf_len = memory_source_avail(source, buf_len);
+	*buf = source->data + source->pos;
+	source->pos += buf_len;
+
+	return (int) buf_len;
+}
+
+static int memory_source_skip(void *handle, size_t bytes)
+{
+	MemorySource *source = handle;
+
+	if (bytes > source->data_len - source->pos) {
+		source->pos = source->data_len;
+		return 0;
+	}
+
+	source->pos += bytes;
+
+	return 1;
+}
+
+static int memory_source_seek(void *handle, int64_t offset)
+{
+	MemorySource *source = handle;
+
+	if (offset < -(int64_t) source->pos
+	 || offset > (int64_t) (source->data_len - source->pos)) {
+		return 0;
+	}
+
+	source->pos = (size_t) ((int64_t) source->pos + offset);
+
+	return 1;
+}
+
+static void memory_source_close(void *handle)
+{
+	MemorySource *source = handle;
+
+	if (source->mapped) {
+		lha_arch_unmap_file((void *) source->data, source->data_len);
+	}
+
+	free(source);
+}
+
+static const LHAInputStreamTypeEx memory_source = {
+	{
+		memory_source_read,
+		memory_source_skip,
+		memory_source_close
+	},
+	memory_source_borrow,
+	memory_source_seek
+};
+
+static LHAInputStream *memory_stream_new(const void *data, size_t data_len,
+                                         int mapped)
+{
+	LHAInputStream *result;
+	MemorySource *source;
+
+	source = malloc(sizeof(MemorySource));
+
+	if (source == NULL) {
+		return NULL;
+	}
+
+	source->data = data;
+	source->data_len = data_len;
+	source->pos = 0;
+	source->mapped = mapped;
+
+	result = lha_input_stream_new_ex(&memory_source, source);
+
+	if (result == NULL) {
+		free(source);
+	}
+
+	return result;
+}
+
+LHAInputStream *lha_input_stream_from_memory(const void *data,
+                                             size_t data_len)
+{
+	return memory_stream_new(data, data_len, 0);
+}
+
+LHAInputStream *lha_input_stream_from_mmap(char *filename)
+{
+	LHAInputStream *result;
+	void *data;
+	size_t data_len;
+
+	data = lha_arch_map_file(filename, &data_len);
+
+	if (data == NULL) {
+		return NULL;
+	}
+
+	result = memory_stream_new(data, data_len, 1);
+
+	if (result == NULL) {
+		lha_arch_unmap_file(data, data_len);
+	}
+
+	return result;
 }
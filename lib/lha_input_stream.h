@@ -37,6 +37,72 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len);
 
+/**
+ * Read a block of data from the LHA stream, of up to the specified
+ * number of bytes. Unlike @ref lha_input_stream_read, a partially
+ * filled buffer is not treated as an error.
+ *
+ * @param stream       The input stream.
+ * @param buf          Pointer to buffer in which to store read data.
+ * @param buf_len      Size of buffer, in bytes.
+ * @return             Number of bytes read, or zero if an error
+ *                     occurred, or end of file was reached.
+ */
+
+size_t lha_input_stream_read_some(LHAInputStream *stream, void *buf,
+                                  size_t buf_len);
+
+/**
+ * Query whether the input stream supports
+ * @ref lha_input_stream_borrow.
+ *
+ * @param stream       The input stream.
+ * @return             Non-zero if data can be borrowed from the stream.
+ */
+
+int lha_input_stream_can_borrow(LHAInputStream *stream);
+
+/**
+ * Borrow a pointer to the next block of data from the LHA stream,
+ * without copying it.
+ *
+ * @param stream       The input stream.
+ * @param buf          Pointer to a variable in which to store a pointer
+ *                     to the data. The data remains valid until the
+ *                     input stream is freed.
+ * @param buf_len      Maximum number of bytes to return.
+ * @return             Number of bytes available, or zero if an error
+ *                     occurred, end of file was reached, or the stream
+ *                     does not support borrowing.
+ */
+
+size_t lha_input_stream_borrow(LHAInputStream *stream, const uint8_t **buf,
+                               size_t buf_len);
+
+/**
+ * Get the current position within the LHA stream. This is the offset,
+ * from the start of the underlying stream, of the next byte that will
+ * be returned.
+ *
+ * @param stream       The input stream.
+ * @return             Offset of the next byte, in bytes.
+ */
+
+uint64_t lha_input_stream_tell(LHAInputStream *stream);
+
+/**
+ * Seek to the specified position within the LHA stream. Only supported
+ * if the underlying stream supports seeking.
+ *
+ * @param stream       The input stream.
+ * @param offset       Offset to seek to, as returned by
+ *                     @ref lha_input_stream_tell.
+ * @return             Non-zero for success, or zero if an error
+ *                     occurred, or the stream does not support seeking.
+ */
+
+int lha_input_stream_seek(LHAInputStream *stream, uint64_t offset);
+
 /**
  * Skip over the specified number of bytes.
  *
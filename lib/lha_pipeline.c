@@ -0,0 +1,507 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Three-stage extraction pipeline.
+//
+// The stages are connected by single-producer, single-consumer queues.
+// Each queue is a ring of large buffers: the producer fills the buffer
+// at the tail and the consumer empties the one at the head. The head and
+// tail indexes are updated atomically, so no lock is needed while the
+// queue is neither full nor empty; a thread only takes the monitor's
+// lock to sleep when it cannot continue, and the other thread only
+// takes it to wake a thread that is sleeping.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lha_arch.h"
+#include "lha_pipeline.h"
+#include "sparse_file.h"
+
+// Number of buffers in each queue, and the size of each buffer.
+
+#define PIPELINE_NUM_BUFFERS 4
+#define PIPELINE_BUFFER_SIZE (256 * 1024) /* bytes */
+
+#ifdef __GNUC__
+
+#define ATOMIC_LOAD(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, v)  __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(p, v)    __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB(p, v)    __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+
+typedef struct {
+
+	// Buffers, and the length of the data in each one.
+
+	uint8_t *data;
+	size_t len[PIPELINE_NUM_BUFFERS];
+
+	// Number of buffers that have been added to and removed from
+	// the queue. These are only written by the producer and the
+	// consumer respectively.
+
+	unsigned int tail, head;
+
+	// Set by the producer when it will add no more buffers, and by
+	// the consumer when it will remove no more buffers.
+
+	unsigned int closed, cancelled;
+
+	// Number of threads sleeping on the monitor.
+
+	unsigned int sleepers;
+
+	LHAArchMonitor *monitor;
+
+} Queue;
+
+struct _LHAPipeline {
+	LHABasicReader *reader;
+	FILE *output;
+	int sparse;
+
+	// Queue of compressed data, from the read thread to the decoder,
+	// and of decompressed data, from the decoder to the write thread.
+
+	Queue input, output_queue;
+
+	LHAArchThread *read_thread, *write_thread;
+
+	// Input buffer currently being read by the decoder.
+
+	const uint8_t *in_buf;
+	size_t in_pos, in_len;
+
+	// Set if writing to the output file failed.
+
+	unsigned int write_failed;
+};
+
+static int queue_init(Queue *queue)
+{
+	memset(queue, 0, sizeof(Queue));
+
+	queue->data = malloc(PIPELINE_NUM_BUFFERS * PIPELINE_BUFFER_SIZE);
+
+	if (queue->data == NULL) {
+		return 0;
+	}
+
+	queue->monitor = lha_arch_monitor_new();
+
+	if (queue->monitor == NULL) {
+		free(queue->data);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void queue_free(Queue *queue)
+{
+	lha_arch_monitor_free(queue->monitor);
+	free(queue->data);
+}
+
+// Sleep until the index at the specified pointer changes from the
+// specified value, or the queue is closed or cancelled.
+
+static void queue_wait(Queue *queue, unsigned int *index, unsigned int value)
+{
+	lha_arch_monitor_lock(queue->monitor);
+	ATOMIC_ADD(&queue->sleepers, 1);
+
+	while (ATOMIC_LOAD(index) == value
+	    && !ATOMIC_LOAD(&queue->closed)
+	    && !ATOMIC_LOAD(&queue->cancelled)) {
+		lha_arch_monitor_wait(queue->monitor);
+	}
+
+	ATOMIC_SUB(&queue->sleepers, 1);
+	lha_arch_monitor_unlock(queue->monitor);
+}
+
+// Wake the other thread, if it is sleeping. This must be called after
+// updating the queue state.
+
+static void queue_wake(Queue *queue)
+{
+	if (ATOMIC_LOAD(&queue->sleepers) > 0) {
+		lha_arch_monitor_lock(queue->monitor);
+		lha_arch_monitor_notify(queue->monitor);
+		lha_arch_monitor_unlock(queue->monitor);
+	}
+}
+
+// Get the buffer at the tail of the queue for the producer to fill,
+// waiting until one is free. Returns NULL if the queue is cancelled.
+
+static uint8_t *queue_put_begin(Queue *queue)
+{
+	unsigned int head, tail;
+
+	tail = queue->tail;
+
+	for (;;) {
+		head = ATOMIC_LOAD(&queue->head);
+
+		if (tail - head < PIPELINE_NUM_BUFFERS) {
+			return queue->data
+			     + (tail % PIPELINE_NUM_BUFFERS)
+			       * PIPELINE_BUFFER_SIZE;
+		}
+
+		if (ATOMIC_LOAD(&queue->cancelled)) {
+			return NULL;
+		}
+
+		queue_wait(queue, &queue->head, head);
+	}
+}
+
+// Add the buffer at the tail of the queue, once it has been filled.
+
+static void queue_put_end(Queue *queue, size_t len)
+{
+	unsigned int tail;
+
+	tail = queue->tail;
+	queue->len[tail % PIPELINE_NUM_BUFFERS] = len;
+	ATOMIC_STORE(&queue->tail, tail + 1);
+	queue_wake(queue);
+}
+
+// Get the buffer at the head of the queue, waiting until there is one.
+// Returns NULL if the queue is empty and has been closed.
+
+static uint8_t *queue_get_begin(Queue *queue, size_t *len)
+{
+	unsigned int head, tail;
+	unsigned int closed;
+
+	head = queue->head;
+
+	for (;;) {
+		closed = ATOMIC_LOAD(&queue->closed);
+		tail = ATOMIC_LOAD(&queue->tail);
+
+		if (tail != head) {
+			*len = queue->len[head % PIPELINE_NUM_BUFFERS];
+			return queue->data
+			     + (head % PIPELINE_NUM_BUFFERS)
+			       * PIPELINE_BUFFER_SIZE;
+		}
+
+		// The queue is closed after the last buffer is added, so
+		// if it was already closed, no more buffers are coming.
+
+		if (closed) {
+			return NULL;
+		}
+
+		queue_wait(queue, &queue->tail, tail);
+	}
+}
+
+// Remove the buffer at the head of the queue, once it has been used.
+
+static void queue_get_end(Queue *queue)
+{
+	ATOMIC_STORE(&queue->head, queue->head + 1);
+	queue_wake(queue);
+}
+
+static void queue_close(Queue *queue)
+{
+	ATOMIC_STORE(&queue->closed, 1);
+	queue_wake(queue);
+}
+
+static void queue_cancel(Queue *queue)
+{
+	ATOMIC_STORE(&queue->cancelled, 1);
+	queue_wake(queue);
+}
+
+// Read thread: reads compressed data into the input queue, until the
+// end of the file is reached or the decoder does not want any more.
+
+static void read_thread_main(void *data)
+{
+	LHAPipeline *pipeline = data;
+	uint8_t *buf;
+	size_t len;
+
+	for (;;) {
+		buf = queue_put_begin(&pipeline->input);
+
+		if (buf == NULL) {
+			break;
+		}
+
+		len = lha_basic_reader_read_compressed(pipeline->reader, buf,
+		                                       PIPELINE_BUFFER_SIZE);
+
+		if (len == 0) {
+			break;
+		}
+
+		queue_put_end(&pipeline->input, len);
+	}
+
+	queue_close(&pipeline->input);
+}
+
+static int write_output(LHAPipeline *pipeline, uint8_t *buf, size_t len)
+{
+	if (pipeline->sparse) {
+		return sparse_file_write(pipeline->output, buf, len);
+	} else {
+		return lha_arch_write(pipeline->output, buf, len);
+	}
+}
+
+// Write thread: writes decompressed data from the output queue to the
+// output file. After a write fails, the remaining data is discarded.
+
+static void write_thread_main(void *data)
+{
+	LHAPipeline *pipeline = data;
+	uint8_t *buf;
+	size_t len;
+
+	for (;;) {
+		buf = queue_get_begin(&pipeline->output_queue, &len);
+
+		if (buf == NULL) {
+			break;
+		}
+
+		if (!ATOMIC_LOAD(&pipeline->write_failed)
+		 && !write_output(pipeline, buf, len)) {
+			ATOMIC_STORE(&pipeline->write_failed, 1);
+		}
+
+		queue_get_end(&pipeline->output_queue);
+	}
+
+	if (pipeline->sparse && !sparse_file_finish(pipeline->output)) {
+		ATOMIC_STORE(&pipeline->write_failed, 1);
+	}
+}
+
+LHAPipeline *lha_pipeline_new(LHABasicReader *reader, FILE *output,
+                              int sparse)
+{
+	LHAPipeline *pipeline;
+
+	pipeline = calloc(1, sizeof(LHAPipeline));
+
+	if (pipeline == NULL) {
+		return NULL;
+	}
+
+	pipeline->reader = reader;
+	pipeline->output = output;
+	pipeline->sparse = sparse;
+
+	if (!queue_init(&pipeline->input)) {
+		goto fail1;
+	}
+
+	if (!queue_init(&pipeline->output_queue)) {
+		goto fail2;
+	}
+
+	pipeline->write_thread = lha_arch_thread_start(write_thread_main,
+	                                               pipeline);
+
+	if (pipeline->write_thread == NULL) {
+		goto fail3;
+	}
+
+	pipeline->read_thread = lha_arch_thread_start(read_thread_main,
+	                                              pipeline);
+
+	if (pipeline->read_thread == NULL) {
+		queue_close(&pipeline->output_queue);
+		lha_arch_thread_join(pipeline->write_thread);
+		goto fail3;
+	}
+
+	return pipeline;
+
+fail3:
+	queue_free(&pipeline->output_queue);
+fail2:
+	queue_free(&pipeline->input);
+fail1:
+	free(pipeline);
+
+	return NULL;
+}
+
+// Move on to the next buffer of compressed data, releasing the current
+// one. Returns zero if there is no more data.
+
+static int next_input(LHAPipeline *pipeline)
+{
+	uint8_t *buf;
+
+	if (pipeline->in_buf != NULL) {
+		queue_get_end(&pipeline->input);
+		pipeline->in_buf = NULL;
+	}
+
+	buf = queue_get_begin(&pipeline->input, &pipeline->in_len);
+
+	if (buf == NULL) {
+		pipeline->in_len = 0;
+		return 0;
+	}
+
+	pipeline->in_buf = buf;
+	pipeline->in_pos = 0;
+
+	return 1;
+}
+
+size_t lha_pipeline_read(void *buf, size_t buf_len, void *data)
+{
+	LHAPipeline *pipeline = data;
+	size_t bytes;
+
+	if (pipeline->in_pos >= pipeline->in_len && !next_input(pipeline)) {
+		return 0;
+	}
+
+	bytes = pipeline->in_len - pipeline->in_pos;
+
+	if (bytes > buf_len) {
+		bytes = buf_len;
+	}
+
+	memcpy(buf, pipeline->in_buf + pipeline->in_pos, bytes);
+	pipeline->in_pos += bytes;
+
+	return bytes;
+}
+
+size_t lha_pipeline_borrow(const uint8_t **buf, size_t buf_len, void *data)
+{
+	LHAPipeline *pipeline = data;
+	size_t bytes;
+
+	if (pipeline->in_pos >= pipeline->in_len && !next_input(pipeline)) {
+		return 0;
+	}
+
+	bytes = pipeline->in_len - pipeline->in_pos;
+
+	if (bytes > buf_len) {
+		bytes = buf_len;
+	}
+
+	*buf = pipeline->in_buf + pipeline->in_pos;
+	pipeline->in_pos += bytes;
+
+	return bytes;
+}
+
+uint8_t *lha_pipeline_output_buffer(LHAPipeline *pipeline, size_t *buf_len)
+{
+	if (ATOMIC_LOAD(&pipeline->write_failed)) {
+		return NULL;
+	}
+
+	*buf_len = PIPELINE_BUFFER_SIZE;
+
+	return queue_put_begin(&pipeline->output_queue);
+}
+
+void lha_pipeline_output_commit(LHAPipeline *pipeline, size_t len)
+{
+	if (len > 0) {
+		queue_put_end(&pipeline->output_queue, len);
+	}
+}
+
+int lha_pipeline_finish(LHAPipeline *pipeline)
+{
+	int result;
+
+	// Wait for the write thread to write everything, and stop the
+	// read thread if it is still reading.
+
+	queue_close(&pipeline->output_queue);
+	lha_arch_thread_join(pipeline->write_thread);
+
+	queue_cancel(&pipeline->input);
+	lha_arch_thread_join(pipeline->read_thread);
+
+	result = !pipeline->write_failed;
+
+	queue_free(&pipeline->output_queue);
+	queue_free(&pipeline->input);
+	free(pipeline);
+
+	return result;
+}
+
+#else /* #ifdef __GNUC__ */
+
+// Atomic operations are needed for the queues; without them, files are
+// always extracted without using a pipeline.
+
+LHAPipeline *lha_pipeline_new(LHABasicReader *reader, FILE *output,
+                              int sparse)
+{
+	return NULL;
+}
+
+size_t lha_pipeline_read(void *buf, size_t buf_len, void *data)
+{
+	return 0;
+}
+
+size_t lha_pipeline_borrow(const uint8_t **buf, size_t buf_len, void *data)
+{
+	return 0;
+}
+
+uint8_t *lha_pipeline_output_buffer(LHAPipeline *pipeline, size_t *buf_len)
+{
+	return NULL;
+}
+
+void lha_pipeline_output_commit(LHAPipeline *pipeline, size_t len)
+{
+}
+
+int lha_pipeline_finish(LHAPipeline *pipeline)
+{
+	return 0;
+}
+
+#endif /* #ifdef __GNUC__ */
+
@@ -0,0 +1,123 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_LHA_PIPELINE_H
+#define LHASA_LHA_PIPELINE_H
+
+#include <stdio.h>
+
+#include "lha_basic_reader.h"
+
+/**
+ * Extraction pipeline.
+ *
+ * A pipeline extracts the current file from an @ref LHABasicReader
+ * using three threads connected by queues of large buffers. A read
+ * thread reads the compressed data, the calling thread decompresses it,
+ * and a write thread writes the decompressed data to the output file.
+ * This allows slow reads and writes to overlap with decompression.
+ *
+ * The decoder reads the compressed data using @ref lha_pipeline_read or
+ * @ref lha_pipeline_borrow, and decompresses into buffers returned by
+ * @ref lha_pipeline_output_buffer.
+ */
+
+typedef struct _LHAPipeline LHAPipeline;
+
+/**
+ * Create a new pipeline to extract the current file from a reader.
+ *
+ * The read thread starts reading compressed data immediately. The
+ * basic reader must not be used until the pipeline is finished.
+ *
+ * @param reader     The basic reader.
+ * @param output     File handle returned by @ref lha_arch_fopen, to
+ *                   write the decompressed data.
+ * @param sparse     If non-zero, create holes in the output file instead
+ *                   of writing blocks of zeros.
+ * @return           Pointer to the new pipeline, or NULL if it could not
+ *                   be created (including if threads are unavailable).
+ */
+
+LHAPipeline *lha_pipeline_new(LHABasicReader *reader, FILE *output,
+                              int sparse);
+
+/**
+ * Decoder callback function to read compressed data from the pipeline.
+ *
+ * @param buf        Pointer to the buffer in which to store the data.
+ * @param buf_len    Size of the buffer, in bytes.
+ * @param pipeline   Pointer to the pipeline.
+ * @return           Number of bytes read, or zero for end of file.
+ */
+
+size_t lha_pipeline_read(void *buf, size_t buf_len, void *pipeline);
+
+/**
+ * Decoder callback function to borrow compressed data from the
+ * pipeline, without copying it. The data remains valid until the next
+ * call to @ref lha_pipeline_read or @ref lha_pipeline_borrow.
+ *
+ * @param buf        Pointer to a variable in which to store a pointer
+ *                   to the data.
+ * @param buf_len    Maximum number of bytes to return.
+ * @param pipeline   Pointer to the pipeline.
+ * @return           Number of bytes available, or zero for end of file.
+ */
+
+size_t lha_pipeline_borrow(const uint8_t **buf, size_t buf_len,
+                           void *pipeline);
+
+/**
+ * Get a buffer in which to store decompressed data, waiting for the
+ * write thread if necessary.
+ *
+ * @param pipeline   The pipeline.
+ * @param buf_len    Pointer to a variable in which to store the size of
+ *                   the buffer, in bytes.
+ * @return           Pointer to the buffer, or NULL if writing to the
+ *                   output file has failed.
+ */
+
+uint8_t *lha_pipeline_output_buffer(LHAPipeline *pipeline, size_t *buf_len);
+
+/**
+ * Pass the buffer returned by @ref lha_pipeline_output_buffer to the
+ * write thread, to be written to the output file.
+ *
+ * @param pipeline   The pipeline.
+ * @param len        Number of bytes of data in the buffer.
+ */
+
+void lha_pipeline_output_commit(LHAPipeline *pipeline, size_t len);
+
+/**
+ * Finish extraction, waiting for all data to be written to the output
+ * file, and free the pipeline. Any compressed data that has not been
+ * read by the decoder is discarded.
+ *
+ * @param pipeline   The pipeline.
+ * @return           Non-zero if all data was written successfully, or
+ *                   zero for failure.
+ */
+
+int lha_pipeline_finish(LHAPipeline *pipeline);
+
+#endif /* #ifndef LHASA_LHA_PIPELINE_H */
@@ -25,9 +25,26 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "lha_arch.h"
 #include "lha_decoder.h"
 #include "lha_basic_reader.h"
+#include "lha_pipeline.h"
+#include "lha_seek_index.h"
+#include "sparse_file.h"
 #include "public/lha_reader.h"
 #include "macbinary.h"
 
+// Size of the buffer used to decompress files when extracting. Data is
+// written to the output file in chunks of this size.
+
+#define DECODE_BUFFER_SIZE (64 * 1024)
+
+// Files at least this large are decompressed directly into a mapping of
+// the output file, if possible.
+
+#define MAPPED_OUTPUT_MIN_LENGTH (1024 * 1024)
+
+// Maximum number of decoders kept for reuse by each reader.
+
+#define DECODER_CACHE_SIZE 4
+
 typedef enum {
 
 	// Initial state at start of stream:
@@ -75,6 +92,36 @@ struct _LHAReader {
 
 	LHADecoder *inner_decoder;
 
+	// Decoders that have finished decompressing a file and are kept
+	// to be reset and reused for later files, instead of allocating
+	// a new decoder for every file. Unused slots are NULL; when the
+	// cache is full, slots are replaced in round-robin order.
+
+	LHADecoder *decoder_cache[DECODER_CACHE_SIZE];
+	unsigned int decoder_cache_next;
+
+	// Minimum compressed length of files to extract using a pipeline
+	// (zero to never use one), and the pipeline being used to extract
+	// the current file, if any.
+
+	size_t pipeline_min_length;
+	LHAPipeline *pipeline;
+
+	// Buffer used by do_decode, allocated the first time it is
+	// needed.
+
+	uint8_t *decode_buf;
+
+	// If non-zero, extracted files are written as sparse files.
+
+	int sparse;
+
+	// Seek index being used for the current file, if any, and the
+	// position in the file at which to add the next checkpoint.
+
+	LHASeekIndex *seek_index;
+	size_t next_checkpoint;
+
 	// Policy used to extract directories.
 
 	LHAReaderDirPolicy dir_policy;
@@ -95,12 +142,68 @@ struct _LHAReader {
 	LHAFileHeader *deferred_symlinks;
 };
 
+/**
+ * Store a decoder in the decoder cache, so that it can be reused.
+ *
+ * If the cache is full, another decoder is evicted and freed to make
+ * room for it.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @param decoder        The decoder to store.
+ */
+
+static void cache_decoder(LHAReader *reader, LHADecoder *decoder)
+{
+	unsigned int i;
+
+	for (i = 0; i < DECODER_CACHE_SIZE; ++i) {
+		if (reader->decoder_cache[i] == NULL) {
+			reader->decoder_cache[i] = decoder;
+			return;
+		}
+	}
+
+	i = reader->decoder_cache_next;
+	reader->decoder_cache_next = (i + 1) % DECODER_CACHE_SIZE;
+
+	lha_decoder_free(reader->decoder_cache[i]);
+	reader->decoder_cache[i] = decoder;
+}
+
+/**
+ * Remove a decoder of the specified type from the decoder cache.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @param dtype          The type of decoder to look for.
+ * @return               The decoder, or NULL if there is no decoder
+ *                       of that type in the cache.
+ */
+
+static LHADecoder *take_cached_decoder(LHAReader *reader,
+                                       LHADecoderType *dtype)
+{
+	LHADecoder *decoder;
+	unsigned int i;
+
+	for (i = 0; i < DECODER_CACHE_SIZE; ++i) {
+		decoder = reader->decoder_cache[i];
+
+		if (decoder != NULL && decoder->dtype == dtype) {
+			reader->decoder_cache[i] = NULL;
+			return decoder;
+		}
+	}
+
+	return NULL;
+}
+
 /**
  * Free the current decoder structure.
  *
  * If the reader has an allocated decoder being used to decompress the
- * current file, the decoder is freed and the decoder pointer reset
- * to NULL.
+ * current file, the decoder is released and the decoder pointer reset
+ * to NULL. The decoder that does the decompression is kept in the
+ * decoder cache for reuse.
  *
  * @param reader         Pointer to the LHA reader structure.
  */
@@ -112,16 +215,75 @@ static void close_decoder(LHAReader *reader)
 			reader->inner_decoder = NULL;
 		}
 
-		lha_decoder_free(reader->decoder);
+		if (reader->inner_decoder == NULL) {
+			cache_decoder(reader, reader->decoder);
+		} else {
+			lha_decoder_free(reader->decoder);
+		}
+
 		reader->decoder = NULL;
 	}
 
 	if (reader->inner_decoder != NULL) {
-		lha_decoder_free(reader->inner_decoder);
+		cache_decoder(reader, reader->inner_decoder);
 		reader->inner_decoder = NULL;
 	}
 }
 
+/**
+ * Get a decoder to decompress the current file, reusing a cached
+ * decoder if there is one of the right type.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @return               Pointer to the decoder, or NULL for failure.
+ */
+
+static LHADecoder *get_decoder(LHAReader *reader)
+{
+	LHADecoderType *dtype;
+	LHADecoder *decoder;
+
+	dtype = lha_decoder_for_name(reader->curr_file->compress_method);
+
+	if (dtype == NULL) {
+		return NULL;
+	}
+
+	decoder = take_cached_decoder(reader, dtype);
+
+	// When extracting using a pipeline, the decoder reads compressed
+	// data from the pipeline instead of the basic reader.
+
+	if (reader->pipeline != NULL) {
+		if (decoder == NULL) {
+			decoder = lha_decoder_new(dtype, lha_pipeline_read,
+			                          reader->pipeline,
+			                          reader->curr_file->length);
+		} else if (!lha_decoder_reset(decoder, lha_pipeline_read,
+		                              reader->pipeline,
+		                              reader->curr_file->length)) {
+			lha_decoder_free(decoder);
+			decoder = NULL;
+		}
+
+		if (decoder != NULL) {
+			lha_decoder_set_borrow(decoder, lha_pipeline_borrow);
+		}
+
+		return decoder;
+	}
+
+	if (decoder != NULL) {
+		if (lha_basic_reader_reset_decoder(reader->reader, decoder)) {
+			return decoder;
+		}
+
+		lha_decoder_free(decoder);
+	}
+
+	return lha_basic_reader_decode(reader->reader);
+}
+
 /**
  * Create the decoder structure to decompress the data from the
  * current file.
@@ -142,7 +304,7 @@ static int open_decoder(LHAReader *reader,
 		return 0;
 	}
 
-	reader->inner_decoder = lha_basic_reader_decode(reader->reader);
+	reader->inner_decoder = get_decoder(reader);
 
 	if (reader->inner_decoder == NULL) {
 		return 0;
@@ -200,6 +362,11 @@ LHAReader *lha_reader_new(LHAInputStream *stream)
 	reader->dir_stack = NULL;
 	reader->dir_policy = LHA_READER_DIR_END_OF_DIR;
 	reader->deferred_symlinks = NULL;
+	reader->pipeline_min_length = 0;
+	reader->pipeline = NULL;
+	reader->decode_buf = NULL;
+	reader->sparse = 0;
+	reader->seek_index = NULL;
 
 	return reader;
 }
@@ -207,11 +374,19 @@ LHAReader *lha_reader_new(LHAInputStream *stream)
 void lha_reader_free(LHAReader *reader)
 {
 	LHAFileHeader *header;
+	unsigned int i;
 
-	// Shut down the current decoder, if there is one.
+	// Shut down the current decoder, if there is one, and free
+	// all cached decoders.
 
 	close_decoder(reader);
 
+	for (i = 0; i < DECODER_CACHE_SIZE; ++i) {
+		if (reader->decoder_cache[i] != NULL) {
+			lha_decoder_free(reader->decoder_cache[i]);
+		}
+	}
+
 	// Free any file headers in the stack.
 
 	while (reader->dir_stack != NULL) {
@@ -221,6 +396,7 @@ void lha_reader_free(LHAReader *reader)
 	}
 
 	lha_basic_reader_free(reader->reader);
+	free(reader->decode_buf);
 	free(reader);
 }
 
@@ -230,6 +406,16 @@ void lha_reader_set_dir_policy(LHAReader *reader,
 	reader->dir_policy = policy;
 }
 
+void lha_reader_set_pipeline(LHAReader *reader, size_t min_length)
+{
+	reader->pipeline_min_length = min_length;
+}
+
+void lha_reader_set_sparse(LHAReader *reader, int sparse)
+{
+	reader->sparse = sparse;
+}
+
 /**
  * Check if the directory at the top of the stack should be popped.
  *
@@ -291,9 +477,11 @@ static int end_of_top_dir(LHAReader *reader)
 
 LHAFileHeader *lha_reader_next_file(LHAReader *reader)
 {
-	// Free the current decoder if there is one.
+	// Free the current decoder if there is one. The seek index is
+	// only used for the current file.
 
 	close_decoder(reader);
+	reader->seek_index = NULL;
 
 	// No point continuing once the end of the input stream has
 	// been reached.
@@ -348,8 +536,30 @@ LHAFileHeader *lha_reader_next_file(LHAReader *reader)
 	return reader->curr_file;
 }
 
+/**
+ * Add a checkpoint to the seek index if the decoder has passed the
+ * position of the next one.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ */
+
+static void add_checkpoint(LHAReader *reader)
+{
+	size_t pos;
+
+	pos = lha_decoder_get_length(reader->decoder);
+
+	if (pos >= reader->next_checkpoint) {
+		lha_seek_index_add(reader->seek_index, reader->decoder);
+		reader->next_checkpoint
+		    = lha_seek_index_next(reader->seek_index, pos);
+	}
+}
+
 size_t lha_reader_read(LHAReader *reader, void *buf, size_t buf_len)
 {
+	size_t bytes;
+
 	// The first time that we try to read the current file, we
 	// must create the decoder to decompress it.
 
@@ -361,7 +571,111 @@ size_t lha_reader_read(LHAReader *reader, void *buf, size_t buf_len)
 
 	// Read from decoder and return the result.
 
-	return lha_decoder_read(reader->decoder, buf, buf_len);
+	bytes = lha_decoder_read(reader->decoder, buf, buf_len);
+
+	if (reader->seek_index != NULL) {
+		add_checkpoint(reader);
+	}
+
+	return bytes;
+}
+
+/**
+ * Check whether the current file was decompressed successfully, once
+ * all of its data has been read.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @return               Non-zero if the length and CRC of the data match
+ *                       the file header.
+ */
+
+static int decode_succeeded(LHAReader *reader)
+{
+	// Decoder stores output position and performs running CRC.
+	// At the end of the stream these should match the header values.
+
+	return lha_decoder_get_length(reader->inner_decoder)
+	         == reader->curr_file->length
+	    && lha_decoder_get_crc(reader->inner_decoder)
+	         == reader->curr_file->crc;
+}
+
+void *lha_reader_read_all(LHAReader *reader, void *buf, size_t *len)
+{
+	uint8_t *result;
+	size_t bytes;
+
+	if (reader->decoder == NULL) {
+		if (!open_decoder(reader, NULL, NULL)) {
+			return NULL;
+		}
+	} else if (lha_decoder_get_length(reader->decoder) > 0) {
+		return NULL;
+	}
+
+	// Allocate a buffer if one was not supplied. An empty file
+	// still needs a valid pointer to return.
+
+	result = buf;
+
+	if (result == NULL) {
+		result = malloc(reader->curr_file->length + 1);
+
+		if (result == NULL) {
+			return NULL;
+		}
+	}
+
+	// Decompress the whole file in one go, then check the result.
+
+	bytes = lha_decoder_read_linear(reader->decoder, result,
+	                                reader->curr_file->length);
+
+	if (!decode_succeeded(reader)) {
+		if (buf == NULL) {
+			free(result);
+		}
+
+		return NULL;
+	}
+
+	*len = bytes;
+
+	return result;
+}
+
+/**
+ * Allocate the decode buffer, if it has not been allocated already.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @return               Non-zero for success, or zero for failure.
+ */
+
+static int alloc_decode_buf(LHAReader *reader)
+{
+	if (reader->decode_buf == NULL) {
+		reader->decode_buf = malloc(DECODE_BUFFER_SIZE);
+	}
+
+	return reader->decode_buf != NULL;
+}
+
+/**
+ * Write data from the decode buffer to the output file.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @param output         FILE handle to write decompressed data.
+ * @param len            Number of bytes to write.
+ * @return               Non-zero for success, or zero for failure.
+ */
+
+static int write_output(LHAReader *reader, FILE *output, size_t len)
+{
+	if (reader->sparse) {
+		return sparse_file_write(output, reader->decode_buf, len);
+	} else {
+		return lha_arch_write(output, reader->decode_buf, len);
+	}
 }
 
 /**
@@ -378,29 +692,126 @@ size_t lha_reader_read(LHAReader *reader, void *buf, size_t buf_len)
 
 static int do_decode(LHAReader *reader, FILE *output)
 {
-	uint8_t buf[64];
-	unsigned int bytes;
+	size_t bytes;
+
+	if (!alloc_decode_buf(reader)) {
+		return 0;
+	}
 
-	// Decompress the current file.
+	// Decompress the current file. The decoder fills the whole buffer
+	// each time until the end of the file, so every write except the
+	// last is a full, aligned chunk.
 
 	do {
-		bytes = lha_reader_read(reader, buf, sizeof(buf));
+		bytes = lha_reader_read(reader, reader->decode_buf,
+		                        DECODE_BUFFER_SIZE);
 
-		if (output != NULL) {
-			if (fwrite(buf, 1, bytes, output) < bytes) {
-				return 0;
-			}
+		if (output != NULL && !write_output(reader, output, bytes)) {
+			return 0;
 		}
 
 	} while (bytes > 0);
 
-	// Decoder stores output position and performs running CRC.
-	// At the end of the stream these should match the header values.
+	if (output != NULL && reader->sparse
+	 && !sparse_file_finish(output)) {
+		return 0;
+	}
 
-	return lha_decoder_get_length(reader->inner_decoder)
-	         == reader->curr_file->length
-	    && lha_decoder_get_crc(reader->inner_decoder)
-	         == reader->curr_file->crc;
+	return decode_succeeded(reader);
+}
+
+/**
+ * Check whether the current file should be decompressed directly into
+ * a mapping of the output file.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @return               Non-zero if the output file should be mapped.
+ */
+
+static int use_mapped_output(LHAReader *reader)
+{
+	// Sparse files must not have their space allocated, and the
+	// length of files with a MacBinary header is not known until
+	// the header has been stripped off.
+
+	return !reader->sparse
+	    && reader->curr_file->os_type != LHA_OS_TYPE_MACOS
+	    && reader->curr_file->length >= MAPPED_OUTPUT_MIN_LENGTH;
+}
+
+/**
+ * Decompress the current file directly into a mapping of the output
+ * file. The decoder uses the data already written to the mapping as
+ * its history, so no other copy of the data is made. If the file
+ * cannot be mapped, it is decompressed with @ref do_decode instead.
+ *
+ * Assumes that @param open_decoder has already been called to
+ * start the decode process.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @param output         FILE handle to write decompressed data.
+ * @return               Non-zero if the file decompressed successfully.
+ */
+
+static int do_decode_mapped(LHAReader *reader, FILE *output)
+{
+	uint8_t *data;
+	size_t len, bytes;
+
+	len = reader->curr_file->length;
+	data = lha_arch_map_output(output, len);
+
+	if (data == NULL) {
+		// The file may have been extended before mapping failed.
+
+		lha_arch_truncate(output);
+
+		return do_decode(reader, output);
+	}
+
+	bytes = lha_decoder_read_linear(reader->decoder, data, len);
+	lha_arch_unmap_file(data, len);
+
+	// If decompression failed, leave only the data that was
+	// decompressed, as when the file is written normally.
+
+	if (bytes < len) {
+		lha_arch_skip(output, bytes);
+		lha_arch_truncate(output);
+	}
+
+	return decode_succeeded(reader);
+}
+
+/**
+ * Decompress the current file using a pipeline.
+ *
+ * Assumes that @param open_decoder has already been called to start
+ * the decode process, with the pipeline set. Data is decompressed
+ * directly into the pipeline's output buffers.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @return               Non-zero if the file decompressed successfully.
+ */
+
+static int do_decode_pipelined(LHAReader *reader)
+{
+	uint8_t *buf;
+	size_t buf_len, bytes;
+
+	do {
+		buf = lha_pipeline_output_buffer(reader->pipeline, &buf_len);
+
+		if (buf == NULL) {
+			return 0;
+		}
+
+		bytes = lha_reader_read(reader, buf, buf_len);
+		lha_pipeline_output_commit(reader->pipeline, bytes);
+
+	} while (bytes > 0);
+
+	return decode_succeeded(reader);
 }
 
 int lha_reader_check(LHAReader *reader,
@@ -424,6 +835,97 @@ int lha_reader_check(LHAReader *reader,
 	    && do_decode(reader, NULL);
 }
 
+int lha_reader_set_seek_index(LHAReader *reader, LHASeekIndex *index)
+{
+	// The positions in a file with a MacBinary header do not match
+	// the positions in the decoder's output.
+
+	if (reader->curr_file_type != CURR_FILE_NORMAL
+	 || reader->curr_file->os_type == LHA_OS_TYPE_MACOS
+	 || !lha_seek_index_attach(index, reader->curr_file)) {
+		return 0;
+	}
+
+	reader->seek_index = index;
+	reader->next_checkpoint = lha_seek_index_next(index, 0);
+
+	if (reader->decoder != NULL) {
+		reader->next_checkpoint = lha_seek_index_next(index,
+		    lha_decoder_get_length(reader->decoder));
+	}
+
+	return 1;
+}
+
+int lha_reader_seek(LHAReader *reader, size_t offset)
+{
+	uint8_t *state;
+	size_t pos, bytes;
+
+	if (reader->decoder == NULL) {
+		if (!open_decoder(reader, NULL, NULL)) {
+			return 0;
+		}
+	}
+
+	if (reader->decoder != reader->inner_decoder
+	 || reader->pipeline != NULL
+	 || offset > reader->curr_file->length) {
+		return 0;
+	}
+
+	pos = lha_decoder_get_length(reader->decoder);
+	state = NULL;
+
+	if (reader->seek_index != NULL) {
+		state = lha_seek_index_find(reader->seek_index, offset);
+	}
+
+	// Restore the nearest checkpoint if that avoids decompressing
+	// some of the data. Otherwise, seeking backwards means starting
+	// from the beginning again.
+
+	if (state != NULL
+	 && (offset < pos || lha_decoder_state_position(state) > pos)) {
+		if (!lha_basic_reader_restore_decoder(reader->reader,
+		                                      reader->decoder,
+		                                      state)) {
+			return 0;
+		}
+	} else if (offset < pos) {
+		if (!lha_basic_reader_rewind_decoder(reader->reader,
+		                                     reader->decoder)) {
+			return 0;
+		}
+	}
+
+	// Decompress and discard the data up to the new position.
+
+	if (!alloc_decode_buf(reader)) {
+		return 0;
+	}
+
+	pos = lha_decoder_get_length(reader->decoder);
+
+	while (pos < offset) {
+		bytes = offset - pos;
+
+		if (bytes > DECODE_BUFFER_SIZE) {
+			bytes = DECODE_BUFFER_SIZE;
+		}
+
+		bytes = lha_reader_read(reader, reader->decode_buf, bytes);
+
+		if (bytes == 0) {
+			return 0;
+		}
+
+		pos += bytes;
+	}
+
+	return 1;
+}
+
 /**
  * Open an output stream into which to decompress the current file.
  *
@@ -435,6 +937,7 @@ int lha_reader_check(LHAReader *reader,
 
 static FILE *open_output_file(LHAReader *reader, char *filename)
 {
+	FILE *fstream;
 	int unix_uid = -1, unix_gid = -1, unix_perms = -1;
 
 	if (LHA_FILE_HAVE_EXTRA(reader->curr_file, LHA_FILE_UNIX_UID_GID)) {
@@ -446,7 +949,16 @@ static FILE *open_output_file(LHAReader *reader, char *filename)
 		unix_perms = reader->curr_file->unix_perms;
 	}
 
-	return lha_arch_fopen(filename, unix_uid, unix_gid, unix_perms);
+	fstream = lha_arch_fopen(filename, unix_uid, unix_gid, unix_perms);
+
+	// Reserve space for the whole file, unless it is being written
+	// as a sparse file, when the point is not to allocate space.
+
+	if (fstream != NULL && !reader->sparse) {
+		lha_arch_preallocate(fstream, reader->curr_file->length);
+	}
+
+	return fstream;
 }
 
 /**
@@ -590,6 +1102,61 @@ static int extract_directory(LHAReader *reader, char *path)
 	return 1;
 }
 
+/**
+ * Check whether the current file should be extracted using a pipeline.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @return               Non-zero if a pipeline should be used.
+ */
+
+static int use_pipeline(LHAReader *reader)
+{
+	return reader->pipeline_min_length > 0
+	    && reader->curr_file->compressed_length
+	         >= reader->pipeline_min_length
+	    && lha_decoder_for_name(reader->curr_file->compress_method)
+	         != NULL;
+}
+
+/**
+ * Decompress the current file into the specified output file, using
+ * a pipeline if possible.
+ *
+ * @param reader         Pointer to the LHA reader structure.
+ * @param fstream        FILE handle to write decompressed data.
+ * @param callback       Callback function to invoke to track progress.
+ * @param callback_data  Extra pointer to pass to the callback function.
+ * @return               Non-zero if the file decompressed successfully.
+ */
+
+static int extract_pipelined(LHAReader *reader, FILE *fstream,
+                             LHADecoderProgressCallback callback,
+                             void *callback_data)
+{
+	int result;
+
+	reader->pipeline = lha_pipeline_new(reader->reader, fstream,
+	                                    reader->sparse);
+
+	// If threads are not available, decode in this thread instead.
+
+	if (reader->pipeline == NULL) {
+		return open_decoder(reader, callback, callback_data)
+		    && do_decode(reader, fstream);
+	}
+
+	result = open_decoder(reader, callback, callback_data)
+	      && do_decode_pipelined(reader);
+	result = lha_pipeline_finish(reader->pipeline) && result;
+	reader->pipeline = NULL;
+
+	// The decoder reads from the pipeline, which no longer exists.
+
+	close_decoder(reader);
+
+	return result;
+}
+
 /**
  * Extract the current file.
  *
@@ -628,12 +1195,25 @@ static int extract_file(LHAReader *reader, char *filename,
 
 	result = 0;
 
-	if (open_decoder(reader, callback, callback_data)) {
+	if (use_pipeline(reader)) {
+		fstream = open_output_file(reader, filename);
+
+		if (fstream != NULL) {
+			result = extract_pipelined(reader, fstream,
+			                           callback, callback_data);
+			fclose(fstream);
+		}
+	} else if (open_decoder(reader, callback, callback_data)) {
 
 		fstream = open_output_file(reader, filename);
 
 		if (fstream != NULL) {
-			result = do_decode(reader, fstream);
+			if (use_mapped_output(reader)) {
+				result = do_decode_mapped(reader, fstream);
+			} else {
+				result = do_decode(reader, fstream);
+			}
+
 			fclose(fstream);
 		}
 	}
@@ -883,3 +1463,9 @@ int lha_reader_current_is_fake(LHAReader *reader)
 	return reader->curr_file_type == CURR_FILE_FAKE_DIR
 	    || reader->curr_file_type == CURR_FILE_DEFERRED_SYMLINK;
 }
+
+uint64_t lha_reader_curr_file_offset(LHAReader *reader)
+{
+	return lha_basic_reader_curr_file_offset(reader->reader);
+}
+
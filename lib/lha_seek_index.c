@@ -0,0 +1,409 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lha_decoder.h"
+#include "lha_endian.h"
+#include "lha_seek_index.h"
+
+// Layout of a seek index file. All values are little-endian.
+//
+// The file begins with a header:
+//
+//   0   Magic string (SEEK_INDEX_MAGIC)
+//   8   Format version (SEEK_INDEX_VERSION)
+//   12  Number of checkpoints
+//   16  Interval between checkpoints
+//   24  Length of the file that the index is for
+//   32  Compressed length of the file
+//   40  Size of each checkpoint
+//   44  CRC of the file
+//   46  Compression method of the file
+//
+// This is followed by the checkpoints, in order of position. Each is a
+// decoder state, as saved by lha_decoder_save_state().
+
+#define SEEK_INDEX_MAGIC       "LHASEEK\0"
+#define SEEK_INDEX_VERSION     1
+#define SEEK_INDEX_HEADER_LEN  56
+
+struct _LHASeekIndex {
+
+	// Interval between checkpoints.
+
+	size_t interval;
+
+	// Details of the file that the checkpoints were saved for.
+	// These are only valid once there are checkpoints in the index.
+
+	size_t length, compressed_length;
+	uint16_t crc;
+	char compress_method[6];
+
+	// Saved decoder states for each checkpoint, state_size bytes
+	// each, in order of position.
+
+	uint8_t *checkpoints;
+	size_t state_size;
+	unsigned int num_checkpoints, checkpoints_size;
+};
+
+LHASeekIndex *lha_seek_index_new(size_t interval)
+{
+	LHASeekIndex *index;
+
+	if (interval == 0) {
+		return NULL;
+	}
+
+	index = calloc(1, sizeof(LHASeekIndex));
+
+	if (index == NULL) {
+		return NULL;
+	}
+
+	index->interval = interval;
+	index->checkpoints = NULL;
+	index->num_checkpoints = 0;
+	index->checkpoints_size = 0;
+
+	return index;
+}
+
+void lha_seek_index_free(LHASeekIndex *index)
+{
+	free(index->checkpoints);
+	free(index);
+}
+
+unsigned int lha_seek_index_num_checkpoints(LHASeekIndex *index)
+{
+	return index->num_checkpoints;
+}
+
+// Get the saved decoder state for the specified checkpoint.
+
+static uint8_t *checkpoint(LHASeekIndex *index, unsigned int n)
+{
+	return index->checkpoints + (size_t) n * index->state_size;
+}
+
+int lha_seek_index_attach(LHASeekIndex *index, LHAFileHeader *header)
+{
+	LHADecoderType *dtype;
+	size_t state_size;
+
+	dtype = lha_decoder_for_name(header->compress_method);
+
+	if (dtype == NULL) {
+		return 0;
+	}
+
+	state_size = lha_decoder_state_size(dtype);
+
+	if (state_size == 0) {
+		return 0;
+	}
+
+	// An index that already has checkpoints can only be used with
+	// the file that they were saved for.
+
+	if (index->num_checkpoints > 0) {
+		return index->length == header->length
+		    && index->compressed_length == header->compressed_length
+		    && index->crc == header->crc
+		    && !strcmp(index->compress_method,
+		               header->compress_method);
+	}
+
+	index->length = header->length;
+	index->compressed_length = header->compressed_length;
+	index->crc = header->crc;
+	memcpy(index->compress_method, header->compress_method,
+	       sizeof(index->compress_method));
+	index->state_size = state_size;
+
+	return 1;
+}
+
+size_t lha_seek_index_next(LHASeekIndex *index, size_t pos)
+{
+	return (pos / index->interval + 1) * index->interval;
+}
+
+int lha_seek_index_add(LHASeekIndex *index, LHADecoder *decoder)
+{
+	unsigned int new_size;
+	uint8_t *new_checkpoints, *state;
+	size_t pos;
+
+	// Allocate space for the new checkpoint.
+
+	if (index->num_checkpoints >= index->checkpoints_size) {
+		new_size = index->checkpoints_size * 2 + 8;
+		new_checkpoints = realloc(index->checkpoints,
+		                          (size_t) new_size
+		                            * index->state_size);
+
+		if (new_checkpoints == NULL) {
+			return 0;
+		}
+
+		index->checkpoints = new_checkpoints;
+		index->checkpoints_size = new_size;
+	}
+
+	state = checkpoint(index, index->num_checkpoints);
+
+	if (!lha_decoder_save_state(decoder, state)) {
+		return 0;
+	}
+
+	// Only keep the checkpoint if it is in a later interval than the
+	// last one; the file might be read more than once.
+
+	pos = lha_decoder_state_position(state);
+
+	if (index->num_checkpoints == 0
+	 || pos / index->interval
+	      > lha_decoder_state_position(
+	            checkpoint(index, index->num_checkpoints - 1))
+	          / index->interval) {
+		++index->num_checkpoints;
+	}
+
+	return 1;
+}
+
+uint8_t *lha_seek_index_find(LHASeekIndex *index, size_t offset)
+{
+	unsigned int low, high, mid;
+
+	// Binary search for the first checkpoint after the position;
+	// the one before it is the result.
+
+	low = 0;
+	high = index->num_checkpoints;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+
+		if (lha_decoder_state_position(checkpoint(index, mid))
+		      <= offset) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	if (low == 0) {
+		return NULL;
+	}
+
+	return checkpoint(index, low - 1);
+}
+
+// Read the whole of a file into memory. Returns a pointer to the data,
+// or NULL for failure.
+
+static uint8_t *read_file(char *filename, size_t *len)
+{
+	FILE *fstream;
+	uint8_t *data;
+	long size;
+
+	fstream = fopen(filename, "rb");
+
+	if (fstream == NULL) {
+		return NULL;
+	}
+
+	data = NULL;
+
+	if (fseek(fstream, 0, SEEK_END) == 0
+	 && (size = ftell(fstream)) >= SEEK_INDEX_HEADER_LEN
+	 && fseek(fstream, 0, SEEK_SET) == 0) {
+		data = malloc((size_t) size);
+
+		if (data != NULL
+		 && fread(data, 1, (size_t) size, fstream) != (size_t) size) {
+			free(data);
+			data = NULL;
+		}
+
+		*len = (size_t) size;
+	}
+
+	fclose(fstream);
+
+	return data;
+}
+
+// Check that the checkpoints loaded from a seek index file are in
+// order of position, and within the file.
+
+static int check_checkpoints(LHASeekIndex *index)
+{
+	size_t pos, last_pos;
+	unsigned int i;
+
+	last_pos = 0;
+
+	for (i = 0; i < index->num_checkpoints; ++i) {
+		pos = lha_decoder_state_position(checkpoint(index, i));
+
+		if ((i > 0 && pos <= last_pos) || pos > index->length) {
+			return 0;
+		}
+
+		last_pos = pos;
+	}
+
+	return 1;
+}
+
+LHASeekIndex *lha_seek_index_load(char *filename)
+{
+	LHASeekIndex *index;
+	LHADecoderType *dtype;
+	uint8_t *data;
+	size_t len;
+	uint64_t interval;
+	int valid;
+
+	data = read_file(filename, &len);
+
+	if (data == NULL) {
+		return NULL;
+	}
+
+	interval = lha_decode_uint64(data + 16);
+
+	if (memcmp(data, SEEK_INDEX_MAGIC, 8) != 0
+	 || lha_decode_uint32(data + 8) != SEEK_INDEX_VERSION
+	 || interval == 0 || interval > SIZE_MAX) {
+		free(data);
+		return NULL;
+	}
+
+	index = lha_seek_index_new((size_t) interval);
+
+	if (index == NULL) {
+		free(data);
+		return NULL;
+	}
+
+	index->num_checkpoints = lha_decode_uint32(data + 12);
+	index->length = (size_t) lha_decode_uint64(data + 24);
+	index->compressed_length = (size_t) lha_decode_uint64(data + 32);
+	index->state_size = lha_decode_uint32(data + 40);
+	index->crc = lha_decode_uint16(data + 44);
+	memcpy(index->compress_method, data + 46, 5);
+	index->compress_method[5] = '\0';
+
+	// The checkpoints must be the right size for the compression
+	// method, and fill the rest of the file exactly. An index with
+	// no checkpoints has no compression method.
+
+	dtype = lha_decoder_for_name(index->compress_method);
+
+	if (index->num_checkpoints == 0) {
+		valid = len == SEEK_INDEX_HEADER_LEN;
+	} else {
+		valid = dtype != NULL
+		     && index->state_size == lha_decoder_state_size(dtype)
+		     && (len - SEEK_INDEX_HEADER_LEN) / index->state_size
+		          == index->num_checkpoints
+		     && (len - SEEK_INDEX_HEADER_LEN) % index->state_size
+		          == 0;
+	}
+
+	if (!valid) {
+		free(data);
+		lha_seek_index_free(index);
+		return NULL;
+	}
+
+	// The checkpoints are moved to the start of the data, so that
+	// it can be used as the checkpoint array.
+
+	memmove(data, data + SEEK_INDEX_HEADER_LEN,
+	        len - SEEK_INDEX_HEADER_LEN);
+	index->checkpoints = data;
+	index->checkpoints_size = index->num_checkpoints;
+
+	if (!check_checkpoints(index)) {
+		lha_seek_index_free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+int lha_seek_index_save(LHASeekIndex *index, char *filename)
+{
+	uint8_t header[SEEK_INDEX_HEADER_LEN];
+	FILE *fstream;
+	int success;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, SEEK_INDEX_MAGIC, 8);
+	lha_encode_uint32(header + 8, SEEK_INDEX_VERSION);
+	lha_encode_uint32(header + 12, index->num_checkpoints);
+	lha_encode_uint64(header + 16, index->interval);
+
+	// An index with no checkpoints is not tied to a file.
+
+	if (index->num_checkpoints > 0) {
+		lha_encode_uint64(header + 24, index->length);
+		lha_encode_uint64(header + 32, index->compressed_length);
+		lha_encode_uint32(header + 40, (uint32_t) index->state_size);
+		lha_encode_uint16(header + 44, index->crc);
+		memcpy(header + 46, index->compress_method, 5);
+	}
+
+	fstream = fopen(filename, "wb");
+
+	if (fstream == NULL) {
+		return 0;
+	}
+
+	success = fwrite(header, 1, SEEK_INDEX_HEADER_LEN, fstream)
+	            == SEEK_INDEX_HEADER_LEN
+	       && fwrite(index->checkpoints, index->state_size,
+	                 index->num_checkpoints, fstream)
+	            == index->num_checkpoints;
+
+	if (fclose(fstream) != 0) {
+		success = 0;
+	}
+
+	// Don't leave a partially written index file behind.
+
+	if (!success) {
+		remove(filename);
+	}
+
+	return success;
+}
+
@@ -0,0 +1,76 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_LHA_SEEK_INDEX_H
+#define LHASA_LHA_SEEK_INDEX_H
+
+#include "lha_decoder.h"
+#include "lha_file_header.h"
+#include "public/lha_seek_index.h"
+
+/**
+ * Prepare to use a seek index for the specified file.
+ *
+ * @param index        The seek index.
+ * @param header       Header of the file.
+ * @return             Non-zero if the index can be used for the file:
+ *                     the file's compression method must support
+ *                     checkpoints, and any checkpoints already in the
+ *                     index must have been added for the same file.
+ */
+
+int lha_seek_index_attach(LHASeekIndex *index, LHAFileHeader *header);
+
+/**
+ * Get the position in the decompressed data at which the next
+ * checkpoint should be added, after the specified position.
+ *
+ * @param index        The seek index.
+ * @param pos          Current position in the decompressed data.
+ * @return             Position of the next checkpoint.
+ */
+
+size_t lha_seek_index_next(LHASeekIndex *index, size_t pos);
+
+/**
+ * Save the state of a decoder as a new checkpoint. The checkpoint is
+ * only added if it is at least one interval after the last checkpoint
+ * in the index.
+ *
+ * @param index        The seek index.
+ * @param decoder      The decoder.
+ * @return             Non-zero for success, or zero for failure.
+ */
+
+int lha_seek_index_add(LHASeekIndex *index, LHADecoder *decoder);
+
+/**
+ * Find the last checkpoint at or before the specified position.
+ *
+ * @param index        The seek index.
+ * @param offset       Position in the decompressed data.
+ * @return             Pointer to the decoder state saved at the
+ *                     checkpoint, or NULL if there is no checkpoint
+ *                     before the position.
+ */
+
+uint8_t *lha_seek_index_find(LHASeekIndex *index, size_t offset);
+
+#endif /* #ifndef LHASA_LHA_SEEK_INDEX_H */
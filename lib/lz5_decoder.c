@@ -23,6 +23,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <inttypes.h>
 
 #include "lha_decoder.h"
+#include "lha_endian.h"
 
 // Parameters for ring buffer, used for storing history.  This acts
 // as the dictionary for copy operations.
@@ -41,17 +42,52 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define OUTPUT_BUFFER_SIZE (15 + THRESHOLD) * 8
 
+// Size of the internal buffer used to hold compressed data read from
+// the callback function.
+
+#define INPUT_BUFFER_SIZE 4096 /* bytes */
+
+// Maximum size of a "run": a control byte and eight copy commands.
+
+#define MAX_RUN_INPUT (1 + 2 * 8)
+
+// Size of the state saved by lha_lz5_save_state(): the ring buffer and
+// the position within it.
+
+#define STATE_SIZE (RING_BUFFER_SIZE + 2)
+
 // Decoder for the -lz5- compression method used by LArc.
 //
 // This processes "runs" of eight commands, each of which is either
 // "output a character" or "copy block".  The result of that run
 // is written into the output buffer.
+//
+// The input stream is byte-aligned, so compressed data is read in large
+// blocks and runs are decoded straight out of memory, rather than
+// invoking the callback function for each command.
 
 typedef struct {
 	uint8_t ringbuf[RING_BUFFER_SIZE];
 	unsigned int ringbuf_pos;
 	LHADecoderCallback callback;
 	void *callback_data;
+
+	// Optional callback function to borrow data from the input
+	// stream without copying it.
+
+	LHADecoderBorrowCallback borrow;
+
+	// Data read from the input stream that has not yet been decoded.
+	// This points either to inbuf, or to data borrowed from the
+	// input stream.
+
+	const uint8_t *data;
+	size_t data_pos, data_len;
+	uint8_t inbuf[INPUT_BUFFER_SIZE];
+
+	// Number of bytes read from the input stream.
+
+	uint64_t bytes_read;
 } LHALZ5Decoder;
 
 static void fill_initial(LHALZ5Decoder *decoder)
@@ -103,10 +139,61 @@ static int lha_lz5_init(void *data, LHADecoderCallback callback,
 	decoder->ringbuf_pos = RING_BUFFER_SIZE - START_OFFSET;
 	decoder->callback = callback;
 	decoder->callback_data = callback_data;
+	decoder->borrow = NULL;
+	decoder->data = decoder->inbuf;
+	decoder->data_pos = 0;
+	decoder->data_len = 0;
+	decoder->bytes_read = 0;
 
 	return 1;
 }
 
+// Read more data from the input stream, once all the data already read
+// has been consumed. Returns zero for end of file.
+
+static int fill_input(LHALZ5Decoder *decoder)
+{
+	const uint8_t *borrowed;
+	size_t bytes;
+
+	decoder->data_pos = 0;
+
+	// Borrow the stream's data if possible, falling back to the
+	// read callback if there is none.
+
+	if (decoder->borrow != NULL) {
+		bytes = decoder->borrow(&borrowed, SIZE_MAX,
+		                        decoder->callback_data);
+
+		if (bytes > 0) {
+			decoder->data = borrowed;
+			decoder->data_len = bytes;
+			decoder->bytes_read += bytes;
+			return 1;
+		}
+	}
+
+	bytes = decoder->callback(decoder->inbuf, INPUT_BUFFER_SIZE,
+	                          decoder->callback_data);
+
+	decoder->data = decoder->inbuf;
+	decoder->data_len = bytes;
+	decoder->bytes_read += bytes;
+
+	return bytes > 0;
+}
+
+// Read a single byte from the input stream, returning -1 for end of file.
+
+static int read_byte(LHALZ5Decoder *decoder)
+{
+	if (decoder->data_pos >= decoder->data_len && !fill_input(decoder)) {
+		return -1;
+	}
+
+	return decoder->data[decoder->data_pos++];
+}
+
 // Add a single byte to the output buffer.
 
 static void output_byte(LHALZ5Decoder *decoder, uint8_t *buf,
@@ -127,31 +214,102 @@ static void output_block(LHALZ5Decoder *decoder,
                          unsigned int start,
                          unsigned int len)
 {
+	uint8_t *src, *dest, *out;
 	unsigned int i;
 
+	// Usually neither the source nor the destination range wraps
+	// around the end of the ring buffer, and the block can be copied
+	// without checking. The copy must still be done a byte at a time,
+	// as the ranges may overlap.
+
+	if (start + len <= RING_BUFFER_SIZE
+	 && decoder->ringbuf_pos + len <= RING_BUFFER_SIZE) {
+		src = decoder->ringbuf + start;
+		dest = decoder->ringbuf + decoder->ringbuf_pos;
+		out = buf + *buf_len;
+
+		for (i = 0; i < len; ++i) {
+			out[i] = dest[i] = src[i];
+		}
+
+		*buf_len += len;
+		decoder->ringbuf_pos = (decoder->ringbuf_pos + len)
+		                     % RING_BUFFER_SIZE;
+		return;
+	}
+
 	for (i = 0; i < len; ++i) {
 		output_byte(decoder, buf, buf_len,
 		            decoder->ringbuf[(start + i) % RING_BUFFER_SIZE]);
 	}
 }
 
+// Perform a "copy block" command, given its two bytes of input.
+
+static void copy_command(LHALZ5Decoder *decoder, uint8_t *buf,
+                         size_t *buf_len, unsigned int b0, unsigned int b1)
+{
+	unsigned int seqstart, seqlen;
+
+	seqstart = ((b1 & 0xf0) << 4) | b0;
+	seqlen = (b1 & 0x0f) + THRESHOLD;
+
+	output_block(decoder, buf, buf_len, seqstart, seqlen);
+}
+
+// Decode a run when the whole of it is known to be waiting in the
+// input buffer, so that no checks for the end of the data are needed.
+
+static size_t decode_buffered_run(LHALZ5Decoder *decoder, uint8_t *buf)
+{
+	const uint8_t *p;
+	unsigned int bitmap, bit;
+	size_t result;
+
+	result = 0;
+	p = decoder->data + decoder->data_pos;
+	bitmap = *p++;
+
+	for (bit = 0; bit < 8; ++bit) {
+		if ((bitmap & (1 << bit)) != 0) {
+			output_byte(decoder, buf, &result, *p);
+			p += 1;
+		} else {
+			copy_command(decoder, buf, &result, p[0], p[1]);
+			p += 2;
+		}
+	}
+
+	decoder->data_pos = (size_t) (p - decoder->data);
+
+	return result;
+}
+
 // Process a "run" of LZ5-compressed data (a control byte followed by
 // eight "commands").
 
 static size_t lha_lz5_read(void *data, uint8_t *buf)
 {
 	LHALZ5Decoder *decoder = data;
-	uint8_t bitmap;
+	int bitmap, b0, b1;
 	unsigned int bit;
 	size_t result;
 
-	// Start from an empty buffer.
+	if (decoder->data_len - decoder->data_pos >= MAX_RUN_INPUT) {
+		return decode_buffered_run(decoder, buf);
+	}
+
+	// Otherwise, the run might continue into the next block of the
+	// input stream, or be cut short by the end of the stream; read
+	// it a byte at a time.
 
 	result = 0;
 
 	// Read the bitmap byte first.
 
-	if (!decoder->callback(&bitmap, 1, decoder->callback_data)) {
+	bitmap = read_byte(decoder);
+
+	if (bitmap < 0) {
 		return 0;
 	}
 
@@ -161,37 +319,99 @@ static size_t lha_lz5_read(void *data, uint8_t *buf)
 
 	for (bit = 0; bit < 8; ++bit) {
 		if ((bitmap & (1 << bit)) != 0) {
-			uint8_t b;
+			b0 = read_byte(decoder);
 
-			if (!decoder->callback(&b, 1, decoder->callback_data)) {
+			if (b0 < 0) {
 				break;
 			}
 
-			output_byte(decoder, buf, &result, b);
+			output_byte(decoder, buf, &result, (uint8_t) b0);
 		} else {
-			uint8_t cmd[2];
-			unsigned int seqstart, seqlen;
+			b0 = read_byte(decoder);
+			b1 = read_byte(decoder);
 
-			if (!decoder->callback(cmd, 2, decoder->callback_data)) {
+			if (b0 < 0 || b1 < 0) {
 				break;
 			}
 
-			seqstart = (((unsigned int) cmd[1] & 0xf0) << 4)
-			         | cmd[0];
-			seqlen = ((unsigned int) cmd[1] & 0x0f) + THRESHOLD;
+			copy_command(decoder, buf, &result,
+			             (unsigned int) b0, (unsigned int) b1);
+		}
+	}
+
+	return result;
+}
+
+// Decode as many runs as will fit into the specified buffer.
+
+static size_t lha_lz5_read_bulk(void *data, uint8_t *buf, size_t buf_len)
+{
+	size_t result, bytes;
+
+	result = 0;
+
+	while (buf_len - result >= OUTPUT_BUFFER_SIZE) {
+		bytes = lha_lz5_read(data, buf + result);
 
-			output_block(decoder, buf, &result, seqstart, seqlen);
+		if (bytes == 0) {
+			break;
 		}
+
+		result += bytes;
 	}
 
 	return result;
 }
 
+static uint64_t lha_lz5_save_state(void *data, uint8_t *buf)
+{
+	LHALZ5Decoder *decoder = data;
+
+	memcpy(buf, decoder->ringbuf, RING_BUFFER_SIZE);
+	lha_encode_uint16(buf + RING_BUFFER_SIZE,
+	                  (uint16_t) decoder->ringbuf_pos);
+
+	// Data in the input buffer has been read, but not yet used.
+
+	return (decoder->bytes_read
+	        - (decoder->data_len - decoder->data_pos)) * 8;
+}
+
+static int lha_lz5_restore_state(void *data, uint8_t *buf,
+                                 uint64_t input_bits)
+{
+	LHALZ5Decoder *decoder = data;
+
+	memcpy(decoder->ringbuf, buf, RING_BUFFER_SIZE);
+	decoder->ringbuf_pos = lha_decode_uint16(buf + RING_BUFFER_SIZE);
+	decoder->bytes_read = input_bits / 8;
+
+	// The input stream is read a byte at a time, so the state is
+	// always saved at the start of a byte.
+
+	return decoder->ringbuf_pos < RING_BUFFER_SIZE
+	    && input_bits % 8 == 0;
+}
+
+static void lha_lz5_set_borrow(void *data, LHADecoderBorrowCallback borrow)
+{
+	LHALZ5Decoder *decoder = data;
+
+	decoder->borrow = borrow;
+}
+
 LHADecoderType lha_lz5_decoder = {
 	lha_lz5_init,
 	NULL,
 	lha_lz5_read,
 	sizeof(LHALZ5Decoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_lz5_set_borrow,
+	lha_lz5_read_bulk,
+	NULL,
+	NULL,
+	STATE_SIZE,
+	lha_lz5_save_state,
+	lha_lz5_restore_state
 };
@@ -23,6 +23,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <inttypes.h>
 
 #include "lha_decoder.h"
+#include "lha_endian.h"
 
 #include "bit_stream_reader.c"
 
@@ -38,16 +39,32 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define THRESHOLD 2
 
-// Size of output buffer.  Must be large enough to hold the results of
-// the maximum copy operation.
+// Maximum number of bytes output by a single command: the maximum
+// copy operation.
 
-#define OUTPUT_BUFFER_SIZE (15 + THRESHOLD)
+#define MAX_COMMAND_OUTPUT (15 + THRESHOLD)
+
+// Size of output buffer.  Large enough to hold the results of a "run"
+// of eight commands (see below).
+
+#define OUTPUT_BUFFER_SIZE (MAX_COMMAND_OUTPUT * 8)
+
+// Size of the state saved by lha_lzs_save_state(): the ring buffer and
+// the position within it.
+
+#define STATE_SIZE (RING_BUFFER_SIZE + 2)
 
 // Decoder for the -lzs- compression method used by old versions of LArc.
 //
 // The input stream consists of commands, each of which is either "output
 // a literal byte value" or "copy block". A bit at the start of each
 // command signals which command it is.
+//
+// Commands are decoded in "runs" that continue for as long as there is
+// room in the output buffer for another one. A command is at most 16
+// bits long, so each command is decoded from a single peek at the bit
+// stream, falling back to reading a field at a time only at the end
+// of the stream.
 
 typedef struct {
 	BitStreamReader bit_stream_reader;
@@ -88,25 +105,43 @@ static void output_block(LHALZSDecoder *decoder,
                          unsigned int start,
                          unsigned int len)
 {
+	uint8_t *src, *dest, *out;
 	unsigned int i;
 
+	// Fast path when neither range wraps around the end of the ring
+	// buffer. Overlapping copies repeat earlier bytes, so this is
+	// still a forwards byte-by-byte copy, not a memcpy().
+
+	if (start + len <= RING_BUFFER_SIZE
+	 && decoder->ringbuf_pos + len <= RING_BUFFER_SIZE) {
+		src = decoder->ringbuf + start;
+		dest = decoder->ringbuf + decoder->ringbuf_pos;
+		out = buf + *buf_len;
+
+		for (i = 0; i < len; ++i) {
+			out[i] = dest[i] = src[i];
+		}
+
+		*buf_len += len;
+		decoder->ringbuf_pos = (decoder->ringbuf_pos + len)
+		                     % RING_BUFFER_SIZE;
+		return;
+	}
+
 	for (i = 0; i < len; ++i) {
 		output_byte(decoder, buf, buf_len,
 		            decoder->ringbuf[(start + i) % RING_BUFFER_SIZE]);
 	}
 }
 
-// Process a single command from the LZS input stream.
+// Process a single command from the LZS input stream, reading one field
+// at a time. Used at the end of the stream, where there may be fewer
+// than 16 bits left. Returns zero for failure.
 
-static size_t lha_lzs_read(void *data, uint8_t *buf)
+static int read_command_slow(LHALZSDecoder *decoder, uint8_t *buf,
+                             size_t *buf_len)
 {
-	LHALZSDecoder *decoder = data;
 	int bit;
-	size_t result;
-
-	// Start from an empty buffer.
-
-	result = 0;
 
 	// Each command starts with a bit that signals the type:
 
@@ -127,7 +162,7 @@ static size_t lha_lzs_read(void *data, uint8_t *buf)
 			return 0;
 		}
 
-		output_byte(decoder, buf, &result, (uint8_t) b);
+		output_byte(decoder, buf, buf_len, (uint8_t) b);
 	} else {
 		int pos, len;
 
@@ -138,18 +173,109 @@ static size_t lha_lzs_read(void *data, uint8_t *buf)
 			return 0;
 		}
 
-		output_block(decoder, buf, &result, (unsigned int) pos,
+		output_block(decoder, buf, buf_len, (unsigned int) pos,
 		             (unsigned int) len + THRESHOLD);
 	}
 
+	return 1;
+}
+
+// Decode as many commands as will fit into the specified buffer.
+
+static size_t decode_run(LHALZSDecoder *decoder, uint8_t *buf,
+                         size_t buf_len)
+{
+	size_t result;
+	int code;
+
+	result = 0;
+
+	while (buf_len - result >= MAX_COMMAND_OUTPUT) {
+
+		// A literal command is a set bit followed by the byte
+		// value; a copy command is a clear bit followed by an
+		// 11-bit position and a 4-bit length.
+
+		code = peek_bits(&decoder->bit_stream_reader, 16);
+
+		if (code < 0) {
+			if (!read_command_slow(decoder, buf, &result)) {
+				break;
+			}
+		} else if ((code & 0x8000) != 0) {
+			skip_bits(&decoder->bit_stream_reader, 9);
+			output_byte(decoder, buf, &result,
+			            (uint8_t) (code >> 7));
+		} else {
+			skip_bits(&decoder->bit_stream_reader, 16);
+			output_block(decoder, buf, &result,
+			             (unsigned int) code >> 4,
+			             ((unsigned int) code & 0x0f) + THRESHOLD);
+		}
+	}
+
 	return result;
 }
 
+// Process a run of commands from the LZS input stream.
+
+static size_t lha_lzs_read(void *data, uint8_t *buf)
+{
+	return decode_run(data, buf, OUTPUT_BUFFER_SIZE);
+}
+
+static size_t lha_lzs_read_bulk(void *data, uint8_t *buf, size_t buf_len)
+{
+	return decode_run(data, buf, buf_len);
+}
+
+static uint64_t lha_lzs_save_state(void *data, uint8_t *buf)
+{
+	LHALZSDecoder *decoder = data;
+
+	memcpy(buf, decoder->ringbuf, RING_BUFFER_SIZE);
+	lha_encode_uint16(buf + RING_BUFFER_SIZE,
+	                  (uint16_t) decoder->ringbuf_pos);
+
+	return bit_stream_reader_position(&decoder->bit_stream_reader);
+}
+
+static int lha_lzs_restore_state(void *data, uint8_t *buf,
+                                 uint64_t input_bits)
+{
+	LHALZSDecoder *decoder = data;
+
+	memcpy(decoder->ringbuf, buf, RING_BUFFER_SIZE);
+	decoder->ringbuf_pos = lha_decode_uint16(buf + RING_BUFFER_SIZE);
+
+	if (decoder->ringbuf_pos >= RING_BUFFER_SIZE) {
+		return 0;
+	}
+
+	return bit_stream_reader_restore(&decoder->bit_stream_reader,
+	                                 input_bits);
+}
+
+static void lha_lzs_set_borrow(void *data, LHADecoderBorrowCallback borrow)
+{
+	LHALZSDecoder *decoder = data;
+
+	bit_stream_reader_set_borrow(&decoder->bit_stream_reader, borrow,
+	                             decoder->bit_stream_reader.callback_data);
+}
+
 LHADecoderType lha_lzs_decoder = {
 	lha_lzs_init,
 	NULL,
 	lha_lzs_read,
 	sizeof(LHALZSDecoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_lzs_set_borrow,
+	lha_lzs_read_bulk,
+	NULL,
+	NULL,
+	STATE_SIZE,
+	lha_lzs_save_state,
+	lha_lzs_restore_state
 };
@@ -30,6 +30,10 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 typedef struct {
 	LHADecoderCallback callback;
 	void *callback_data;
+
+	// Number of bytes read from the input stream.
+
+	uint64_t bytes_read;
 } LHANullDecoder;
 
 static int lha_null_init(void *data, LHADecoderCallback callback,
@@ -39,15 +43,41 @@ static int lha_null_init(void *data, LHADecoderCallback callback,
 
 	decoder->callback = callback;
 	decoder->callback_data = callback_data;
+	decoder->bytes_read = 0;
 
 	return 1;
 }
 
 static size_t lha_null_read(void *data, uint8_t *buf)
+{
+	LHANullDecoder *decoder = data;
+	size_t result;
+
+	result = decoder->callback(buf, BLOCK_READ_SIZE,
+	                           decoder->callback_data);
+	decoder->bytes_read += result;
+
+	return result;
+}
+
+// The data is not compressed, so there is no state to save other than
+// the position in the input stream.
+
+static uint64_t lha_null_save_state(void *data, uint8_t *buf)
 {
 	LHANullDecoder *decoder = data;
 
-	return decoder->callback(buf, BLOCK_READ_SIZE, decoder->callback_data);
+	return decoder->bytes_read * 8;
+}
+
+static int lha_null_restore_state(void *data, uint8_t *buf,
+                                  uint64_t input_bits)
+{
+	LHANullDecoder *decoder = data;
+
+	decoder->bytes_read = input_bits / 8;
+
+	return input_bits % 8 == 0;
 }
 
 LHADecoderType lha_null_decoder = {
@@ -56,5 +86,12 @@ LHADecoderType lha_null_decoder = {
 	lha_null_read,
 	sizeof(LHANullDecoder),
 	BLOCK_READ_SIZE,
-	2048
+	2048,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	0,
+	lha_null_save_state,
+	lha_null_restore_state
 };
@@ -33,6 +33,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <inttypes.h>
 
 #include "lha_decoder.h"
+#include "lha_endian.h"
 #include "bit_stream_reader.c"
 #include "pma_common.c"
 
@@ -53,6 +54,35 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define OUTPUT_BUFFER_SIZE (MAX_BYTE_BLOCK_LEN + MAX_COPY_BLOCK_LEN)
 
+// Size of the state saved by lha_pm1_save_state(): the ring buffer and
+// the position within it, the output stream position, the index of the
+// byte decode tree and the history list.
+
+#define STATE_SIZE \
+	(RING_BUFFER_SIZE + 2 + 4 + 1 + HISTORY_LIST_STATE_SIZE)
+
+// Saved index of the byte decode tree before it has been read.
+
+#define STATE_NO_TREE 0xff
+
+// Number of bits used to index the byte lookup table. The byte decode
+// trees are at most five levels deep.
+
+#define BYTE_LOOKUP_BITS 5
+
+// Number of bits in the longest code for a byte value: the code from
+// the byte decode tree, followed by up to 6 bits of value.
+
+#define MAX_BYTE_CODE_BITS (BYTE_LOOKUP_BITS + 6)
+
+// Entry in the byte lookup table: the index into byte_ranges decoded
+// using the byte decode tree, and the length of its code, in bits.
+
+typedef struct {
+	uint8_t index;
+	uint8_t bits;
+} ByteLookupEntry;
+
 typedef struct {
 	BitStreamReader bit_stream_reader;
 
@@ -65,6 +95,12 @@ typedef struct {
 
 	const uint8_t *byte_decode_tree;
 
+	// Lookup table for decoding byte_decode_tree, indexed by the
+	// next BYTE_LOOKUP_BITS bits of the input stream. Built when
+	// byte_decode_tree is set.
+
+	ByteLookupEntry byte_lookup[1 << BYTE_LOOKUP_BITS];
+
 	// History ring buffer.
 
 	uint8_t ringbuf[RING_BUFFER_SIZE];
@@ -218,6 +254,61 @@ static int lha_pm1_init(void *data, LHADecoderCallback callback,
 	return 1;
 }
 
+// Find the index into byte_ranges given by a code read using the
+// specified byte decode tree. The code is in the top bits of 'bits',
+// which is BYTE_LOOKUP_BITS long, and its length is stored in
+// 'code_len'.
+
+static unsigned int walk_byte_decode_tree(const uint8_t *ptr,
+                                          unsigned int bits,
+                                          unsigned int *code_len)
+{
+	unsigned int child, bit;
+
+	*code_len = 0;
+
+	if (ptr[0] == 0) {
+		return 0;
+	}
+
+	// Walk down the tree, using a bit at each node to determine
+	// which path to take. The trees are at most five levels deep,
+	// so the bits never run out.
+
+	for (;;) {
+		bit = (bits >> (BYTE_LOOKUP_BITS - 1 - *code_len)) & 1;
+		++*code_len;
+
+		if (bit == 0) {
+			child = (*ptr >> 4) & 0x0f;
+		} else {
+			child = *ptr & 0x0f;
+		}
+
+		// Reached a leaf node?
+
+		if (child >= 10) {
+			return child - 10;
+		}
+
+		ptr += child;
+	}
+}
+
+// Build the byte lookup table for the byte decode tree.
+
+static void build_byte_lookup(LHAPM1Decoder *decoder)
+{
+	unsigned int i, index, code_len;
+
+	for (i = 0; i < (1 << BYTE_LOOKUP_BITS); ++i) {
+		index = walk_byte_decode_tree(decoder->byte_decode_tree, i,
+		                              &code_len);
+		decoder->byte_lookup[i].index = (uint8_t) index;
+		decoder->byte_lookup[i].bits = (uint8_t) code_len;
+	}
+}
+
 // Read the 5-bit header from the start of the input stream. This
 // specifies the table entry to use for byte decodes.
 
@@ -232,6 +323,7 @@ static int read_start_header(LHAPM1Decoder *decoder)
 	}
 
 	decoder->byte_decode_tree = byte_decode_trees[index];
+	build_byte_lookup(decoder);
 
 	return 1;
 }
@@ -258,90 +350,74 @@ static void outputted_byte(LHAPM1Decoder *decoder, uint8_t b)
 
 static int read_copy_byte_count(LHAPM1Decoder *decoder)
 {
-	int x;
+	BitStreamReader *reader = &decoder->bit_stream_reader;
+	int x, y;
 
 	// This is a form of static huffman encoding that uses less bits
-	// to encode short copy amounts (again).
+	// to encode short copy amounts (again). The longest code is 18
+	// bits, so all of the bits are examined at once, and only the
+	// bits that were used are then skipped.
+
+	x = peek_bits(reader, 18);
+
+	if (x < 0) {
+		return -1;
+	}
 
 	// Value in the range 3..5?
 	// Length values start at 3: if it was 2, a different copy
 	// range would have been used and this function would not
 	// have been called.
 
-	x = read_bits(&decoder->bit_stream_reader, 2);
-
-	if (x < 0) {
-		return -1;
-	} else if (x < 3) {
-		return x + 3;
+	if ((x >> 16) < 3) {
+		skip_bits(reader, 2);
+		return (x >> 16) + 3;
 	}
 
 	// Value in range 6..10?
 
-	x = read_bits(&decoder->bit_stream_reader, 3);
+	y = (x >> 13) & 0x07;
 
-	if (x < 0) {
-		return -1;
-	} else if (x < 5) {
-		return x + 6;
+	if (y < 5) {
+		skip_bits(reader, 5);
+		return y + 6;
 	}
 
 	// Value in range 11..14?
 
-	else if (x == 5) {
-		x = read_bits(&decoder->bit_stream_reader, 2);
-
-		if (x < 0) {
-			return -1;
-		} else {
-			return x + 11;
-		}
+	else if (y == 5) {
+		skip_bits(reader, 7);
+		return ((x >> 11) & 0x03) + 11;
 	}
 
 	// Value in range 15..22?
 
-	else if (x == 6) {
-		x = read_bits(&decoder->bit_stream_reader, 3);
-
-		if (x < 0) {
-			return -1;
-		} else {
-			return x + 15;
-		}
+	else if (y == 6) {
+		skip_bits(reader, 8);
+		return ((x >> 10) & 0x07) + 15;
 	}
 
-	// else x == 7...
+	// else y == 7...
 
-	x = read_bits(&decoder->bit_stream_reader, 6);
+	y = (x >> 7) & 0x3f;
 
-	if (x < 0) {
-		return -1;
-	} else if (x < 62) {
-		return x + 23;
+	if (y < 62) {
+		skip_bits(reader, 11);
+		return y + 23;
 	}
 
 	// Value in range 85..116?
 
-	else if (x == 62) {
-		x = read_bits(&decoder->bit_stream_reader, 5);
-
-		if (x < 0) {
-			return -1;
-		} else {
-			return x + 85;
-		}
+	else if (y == 62) {
+		skip_bits(reader, 16);
+		return ((x >> 2) & 0x1f) + 85;
 	}
 
 	// Value in range 117..244?
 
-	else {  // a = 63
-		x = read_bits(&decoder->bit_stream_reader, 7);
-
-		if (x < 0) {
-			return -1;
-		} else {
-			return x + 117;
-		}
+	else {  // y = 63
+		skip_bits(reader, 18);
+		return (x & 0x7f) + 117;
 	}
 }
 
@@ -496,136 +572,97 @@ static size_t read_copy_command(LHAPM1Decoder *decoder, uint8_t *buf)
 	return count;
 }
 
-// Read the index into the byte decode table, using the byte_decode_tree
-// set at the start of the stream. Returns -1 for failure.
-
-static int read_byte_decode_index(LHAPM1Decoder *decoder)
-{
-	const uint8_t *ptr;
-	unsigned int child;
-	int bit;
-
-	ptr = decoder->byte_decode_tree;
-
-	if (ptr[0] == 0) {
-		return 0;
-	}
-
-	// Walk down the tree, reading a bit at each node to determine
-	// which path to take.
-
-	for (;;) {
-		bit = read_bit(&decoder->bit_stream_reader);
-
-		if (bit < 0) {
-			return -1;
-		} else if (bit == 0) {
-			child = (*ptr >> 4) & 0x0f;
-		} else {
-			child = *ptr & 0x0f;
-		}
-
-		// Reached a leaf node?
-
-		if (child >= 10) {
-			return child - 10;
-		}
-
-		ptr += child;
-	}
-}
-
 // Read a single byte value from the input stream.
 // Returns -1 for failure.
 
 static int read_byte(LHAPM1Decoder *decoder)
 {
-	int index;
-	int count;
+	const VariableLengthTable *range;
+	ByteLookupEntry *entry;
+	unsigned int code_len, count;
+	int bits;
 
-	// Read the index into the byte_ranges table to use.
+	// The byte value is encoded as an index into the byte_ranges
+	// table, decoded using byte_decode_tree, followed by a value
+	// from that range. This is actually a distance to walk along
+	// the history linked list - it is static huffman encoding, so
+	// that recently used byte values use fewer bits. Both parts are
+	// decoded from the bits of the longest possible code at once.
 
-	index = read_byte_decode_index(decoder);
+	bits = peek_bits(&decoder->bit_stream_reader, MAX_BYTE_CODE_BITS);
 
-	if (index < 0) {
+	if (bits < 0) {
 		return -1;
 	}
 
-	// Decode value using byte_ranges table. This is actually
-	// a distance to walk along the history linked list - it
-	// is static huffman encoding, so that recently used byte
-	// values use fewer bits.
+	entry = &decoder->byte_lookup[bits >> (MAX_BYTE_CODE_BITS
+	                                       - BYTE_LOOKUP_BITS)];
+	range = &byte_ranges[entry->index];
+	code_len = entry->bits + range->bits;
 
-	count = decode_variable_length(&decoder->bit_stream_reader,
-	                               byte_ranges, index);
+	count = range->offset
+	      + (((unsigned int) bits >> (MAX_BYTE_CODE_BITS - code_len))
+	         & ((1U << range->bits) - 1));
 
-	if (count < 0) {
-		return -1;
-	}
+	skip_bits(&decoder->bit_stream_reader, code_len);
 
 	// Walk through the history linked list to get the actual
 	// value.
 
-	return find_in_history_list(&decoder->history_list, count);
+	return find_in_history_list(&decoder->history_list,
+	                            (uint8_t) count);
 }
 
 // Read the length of a block of bytes.
 
 static int read_byte_block_count(BitStreamReader *reader)
 {
-	int x;
+	int x, y;
 
 	// This is a form of static huffman coding, where smaller
-	// lengths are encoded using shorter bit sequences.
+	// lengths are encoded using shorter bit sequences. As with
+	// copy counts, all 16 bits of the longest code are examined
+	// at once.
 
-	// Value in the range 1..3?
-
-	x = read_bits(reader, 2);
+	x = peek_bits(reader, 16);
 
 	if (x < 0) {
 		return 0;
-	} else if (x < 3) {
-		return x + 1;
+	}
+
+	// Value in the range 1..3?
+
+	if ((x >> 14) < 3) {
+		skip_bits(reader, 2);
+		return (x >> 14) + 1;
 	}
 
 	// Value in the range 4..10?
 
-	x = read_bits(reader, 3);
+	y = (x >> 11) & 0x07;
 
-	if (x < 0) {
-		return 0;
-	} else if (x < 7) {
-		return x + 4;
+	if (y < 7) {
+		skip_bits(reader, 5);
+		return y + 4;
 	}
 
 	// Value in the range 11..25?
 
-	x = read_bits(reader, 4);
+	y = (x >> 7) & 0x0f;
 
-	if (x < 0) {
-		return 0;
-	} else if (x < 14) {
-		return x + 11;
-	} else if (x == 14) {
+	if (y < 14) {
+		skip_bits(reader, 9);
+		return y + 11;
+	} else if (y == 14) {
 		// Value in the range 25-88:
 
-		x = read_bits(reader, 6);
-
-		if (x < 0) {
-			return 0;
-		} else {
-			return x + 25;
-		}
-	} else { // x = 15
+		skip_bits(reader, 15);
+		return ((x >> 1) & 0x3f) + 25;
+	} else { // y = 15
 		// Value in the range 89-216:
 
-		x = read_bits(reader, 7);
-
-		if (x < 0) {
-			return 0;
-		} else {
-			return x + 89;
-		}
+		skip_bits(reader, 16);
+		return (x & 0x7f) + 89;
 	}
 }
 
@@ -703,11 +740,84 @@ static size_t lha_pm1_read(void *data, uint8_t *buf)
 	}
 }
 
+static uint64_t lha_pm1_save_state(void *data, uint8_t *buf)
+{
+	LHAPM1Decoder *decoder = data;
+	uint8_t *p;
+
+	memcpy(buf, decoder->ringbuf, RING_BUFFER_SIZE);
+	p = buf + RING_BUFFER_SIZE;
+
+	lha_encode_uint16(p, (uint16_t) decoder->ringbuf_pos);
+	lha_encode_uint32(p + 2, decoder->output_stream_pos);
+
+	if (decoder->byte_decode_tree == NULL) {
+		p[6] = STATE_NO_TREE;
+	} else {
+		p[6] = (uint8_t) ((decoder->byte_decode_tree
+		                   - byte_decode_trees[0])
+		                  / sizeof(*byte_decode_trees));
+	}
+
+	save_history_list(&decoder->history_list, p + 7);
+
+	return bit_stream_reader_position(&decoder->bit_stream_reader);
+}
+
+static int lha_pm1_restore_state(void *data, uint8_t *buf,
+                                 uint64_t input_bits)
+{
+	LHAPM1Decoder *decoder = data;
+	uint8_t *p;
+
+	memcpy(decoder->ringbuf, buf, RING_BUFFER_SIZE);
+	p = buf + RING_BUFFER_SIZE;
+
+	decoder->ringbuf_pos = lha_decode_uint16(p);
+	decoder->output_stream_pos = lha_decode_uint32(p + 2);
+
+	if (p[6] == STATE_NO_TREE) {
+		decoder->byte_decode_tree = NULL;
+	} else if (p[6] < sizeof(byte_decode_trees)
+	                  / sizeof(*byte_decode_trees)) {
+		decoder->byte_decode_tree = byte_decode_trees[p[6]];
+		build_byte_lookup(decoder);
+	} else {
+		return 0;
+	}
+
+	if (decoder->ringbuf_pos >= RING_BUFFER_SIZE
+	 || !restore_history_list(&decoder->history_list, p + 7)) {
+		return 0;
+	}
+
+	return bit_stream_reader_restore(&decoder->bit_stream_reader,
+	                                 input_bits);
+}
+
+static void lha_pm1_set_borrow(void *data, LHADecoderBorrowCallback borrow)
+{
+	LHAPM1Decoder *decoder = data;
+
+	// The wrapper function is bypassed while data can be borrowed;
+	// it is still used to pad the stream once the data runs out.
+
+	bit_stream_reader_set_borrow(&decoder->bit_stream_reader, borrow,
+	                             decoder->callback_data);
+}
+
 LHADecoderType lha_pm1_decoder = {
 	lha_pm1_init,
 	NULL,
 	lha_pm1_read,
 	sizeof(LHAPM1Decoder),
 	OUTPUT_BUFFER_SIZE,
-	2048
+	2048,
+	lha_pm1_set_borrow,
+	NULL,
+	NULL,
+	NULL,
+	STATE_SIZE,
+	lha_pm1_save_state,
+	lha_pm1_restore_state
 };
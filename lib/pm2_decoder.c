@@ -29,13 +29,16 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <inttypes.h>
 
 #include "lha_decoder.h"
+#include "lha_endian.h"
 
 #include "bit_stream_reader.c"
 #include "pma_common.c"
 
-// Include tree decoder.
+// Include tree decoder. Lookup tables are used to decode the code
+// and offset trees, which are read from for every command.
 
 typedef uint8_t TreeElement;
+#define TREE_LOOKUP_BITS      8
 #include "tree_decode.c"
 
 // Size of the ring buffer (in bytes) used to store past history
@@ -56,6 +59,14 @@ typedef uint8_t TreeElement;
 
 #define OFFSET_TREE_ELEMENTS  17
 
+// Size of the state saved by lha_pm2_decoder_save_state(): the ring
+// buffer and the position within it, the tree rebuild state, the
+// history list and the trees.
+
+#define STATE_SIZE \
+	(RING_BUFFER_SIZE + 2 + 4 + HISTORY_LIST_STATE_SIZE \
+	 + CODE_TREE_ELEMENTS + OFFSET_TREE_ELEMENTS)
+
 typedef enum {
 	PM2_REBUILD_UNBUILT,          // At start of stream
 	PM2_REBUILD_BUILD1,           // After 1KiB
@@ -100,6 +111,12 @@ typedef struct {
 
 	TreeElement offset_tree[OFFSET_TREE_ELEMENTS];
 
+	// Lookup tables for decoding the trees, rebuilt whenever the
+	// trees change.
+
+	TreeLookupEntry code_lookup[TREE_LOOKUP_SIZE];
+	TreeLookupEntry offset_lookup[TREE_LOOKUP_SIZE];
+
 } LHAPM2Decoder;
 
 // Decode table for history value. Characters that appeared recently in
@@ -160,6 +177,8 @@ static int lha_pm2_decoder_init(void *data, LHADecoderCallback callback,
 
 	init_tree(decoder->code_tree, CODE_TREE_ELEMENTS);
 	init_tree(decoder->offset_tree, OFFSET_TREE_ELEMENTS);
+	build_lookup_table(decoder->code_lookup, decoder->code_tree);
+	build_lookup_table(decoder->offset_lookup, decoder->offset_tree);
 
 	return 1;
 }
@@ -344,6 +363,12 @@ static void rebuild_tree(LHAPM2Decoder *decoder)
 			decoder->tree_rebuild_remaining = 4096;
 			break;
 	}
+
+	// The tables are small, so it is simplest to rebuild them both,
+	// even if only one tree was read.
+
+	build_lookup_table(decoder->code_lookup, decoder->code_tree);
+	build_lookup_table(decoder->offset_lookup, decoder->offset_tree);
 }
 
 static void output_byte(LHAPM2Decoder *decoder, uint8_t *buf,
@@ -433,8 +458,9 @@ static int history_get_offset(LHAPM2Decoder *decoder, unsigned int code)
 
 	else if (code < 20) {
 
-		val = read_from_tree(&decoder->bit_stream_reader,
-		                     decoder->offset_tree);
+		val = read_from_lookup_table(&decoder->bit_stream_reader,
+		                             decoder->offset_tree,
+		                             decoder->offset_lookup);
 
 		if (val < 0) {
 			return -1;
@@ -522,7 +548,9 @@ static size_t lha_pm2_decoder_read(void *data, uint8_t *buf)
 
 	result = 0;
 
-	code = read_from_tree(&decoder->bit_stream_reader, decoder->code_tree);
+	code = read_from_lookup_table(&decoder->bit_stream_reader,
+	                              decoder->code_tree,
+	                              decoder->code_lookup);
 
 	if (code < 0) {
 		return 0;
@@ -538,11 +566,115 @@ static size_t lha_pm2_decoder_read(void *data, uint8_t *buf)
 	return result;
 }
 
+// Decode as many commands as will fit into the specified buffer.
+
+static size_t lha_pm2_decoder_read_bulk(void *data, uint8_t *buf,
+                                        size_t buf_len)
+{
+	size_t result, bytes;
+
+	result = 0;
+
+	while (buf_len - result >= OUTPUT_BUFFER_SIZE) {
+		bytes = lha_pm2_decoder_read(data, buf + result);
+
+		if (bytes == 0) {
+			break;
+		}
+
+		result += bytes;
+	}
+
+	return result;
+}
+
+static uint64_t lha_pm2_decoder_save_state(void *data, uint8_t *buf)
+{
+	LHAPM2Decoder *decoder = data;
+	uint8_t *p;
+
+	memcpy(buf, decoder->ringbuf, RING_BUFFER_SIZE);
+	p = buf + RING_BUFFER_SIZE;
+
+	lha_encode_uint16(p, (uint16_t) decoder->ringbuf_pos);
+	lha_encode_uint16(p + 2, (uint16_t) decoder->tree_rebuild_remaining);
+	p[4] = (uint8_t) decoder->tree_state;
+	p[5] = (uint8_t) decoder->need_offset_tree;
+	p += 6;
+
+	save_history_list(&decoder->history_list, p);
+	p += HISTORY_LIST_STATE_SIZE;
+
+	memcpy(p, decoder->code_tree, CODE_TREE_ELEMENTS);
+	memcpy(p + CODE_TREE_ELEMENTS, decoder->offset_tree,
+	       OFFSET_TREE_ELEMENTS);
+
+	return bit_stream_reader_position(&decoder->bit_stream_reader);
+}
+
+static int lha_pm2_decoder_restore_state(void *data, uint8_t *buf,
+                                         uint64_t input_bits)
+{
+	LHAPM2Decoder *decoder = data;
+	uint8_t *p;
+
+	memcpy(decoder->ringbuf, buf, RING_BUFFER_SIZE);
+	p = buf + RING_BUFFER_SIZE;
+
+	decoder->ringbuf_pos = lha_decode_uint16(p);
+	decoder->tree_rebuild_remaining = lha_decode_uint16(p + 2);
+	decoder->tree_state = (PM2RebuildState) p[4];
+	decoder->need_offset_tree = p[5] != 0;
+
+	if (decoder->ringbuf_pos >= RING_BUFFER_SIZE
+	 || p[4] > PM2_REBUILD_CONTINUING
+	 || decoder->tree_rebuild_remaining > 4096
+	 || !restore_history_list(&decoder->history_list, p + 6)) {
+		return 0;
+	}
+
+	p += 6 + HISTORY_LIST_STATE_SIZE;
+
+	memcpy(decoder->code_tree, p, CODE_TREE_ELEMENTS);
+	memcpy(decoder->offset_tree, p + CODE_TREE_ELEMENTS,
+	       OFFSET_TREE_ELEMENTS);
+
+	// There are up to 31 codes, read from a 5-bit field, and up to
+	// 8 offset codes.
+
+	if (!check_tree(decoder->code_tree, CODE_TREE_ELEMENTS, 32)
+	 || !check_tree(decoder->offset_tree, OFFSET_TREE_ELEMENTS, 8)) {
+		return 0;
+	}
+
+	build_lookup_table(decoder->code_lookup, decoder->code_tree);
+	build_lookup_table(decoder->offset_lookup, decoder->offset_tree);
+
+	return bit_stream_reader_restore(&decoder->bit_stream_reader,
+	                                 input_bits);
+}
+
+static void lha_pm2_decoder_set_borrow(void *data,
+                                       LHADecoderBorrowCallback borrow)
+{
+	LHAPM2Decoder *decoder = data;
+
+	bit_stream_reader_set_borrow(&decoder->bit_stream_reader, borrow,
+	                             decoder->bit_stream_reader.callback_data);
+}
+
 LHADecoderType lha_pm2_decoder = {
 	lha_pm2_decoder_init,
 	NULL,
 	lha_pm2_decoder_read,
 	sizeof(LHAPM2Decoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_pm2_decoder_set_borrow,
+	lha_pm2_decoder_read_bulk,
+	NULL,
+	NULL,
+	STATE_SIZE,
+	lha_pm2_decoder_save_state,
+	lha_pm2_decoder_restore_state
 };
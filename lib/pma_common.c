@@ -56,6 +56,14 @@ typedef struct {
 // a character is output, it is moved to the front of the linked
 // list. The entry point index into the list is the last output
 // character, given by history_head;
+//
+// A move-to-front array would make looking up a character a single
+// load, but moving a character to the front would then mean shifting
+// every entry in front of it. The list is updated for every byte that
+// is output, including the bytes of copies, while it is only searched
+// for literal bytes, which are much less common. With a linked list,
+// the update is always a constant amount of work, and in practice this
+// is faster overall.
 
 typedef struct {
 	HistoryNode history[256];
@@ -159,3 +167,58 @@ static void update_history_list(HistoryLinkedList *list, uint8_t b)
 
 	list->history_head = b;
 }
+
+// Size of a history list saved by save_history_list().
+
+#define HISTORY_LIST_STATE_SIZE 256
+
+// Save the history list, as the byte values in order along the chain,
+// starting from the head.
+
+static void save_history_list(HistoryLinkedList *list, uint8_t *buf)
+{
+	unsigned int i;
+	uint8_t code;
+
+	code = list->history_head;
+
+	for (i = 0; i < 256; ++i) {
+		buf[i] = code;
+		code = list->history[code].prev;
+	}
+}
+
+// Restore a history list saved by save_history_list(). Returns zero if
+// the saved list is not valid: every byte value must appear once.
+
+static int restore_history_list(HistoryLinkedList *list, uint8_t *buf)
+{
+	uint8_t seen[256];
+	unsigned int i;
+	uint8_t code, prev;
+
+	memset(seen, 0, sizeof(seen));
+
+	for (i = 0; i < 256; ++i) {
+		if (seen[buf[i]]) {
+			return 0;
+		}
+
+		seen[buf[i]] = 1;
+	}
+
+	// Link each value to the next one along the chain, which wraps
+	// around from the last value back to the head.
+
+	for (i = 0; i < 256; ++i) {
+		code = buf[i];
+		prev = buf[(i + 1) % 256];
+
+		list->history[code].prev = prev;
+		list->history[prev].next = code;
+	}
+
+	list->history_head = buf[0];
+
+	return 1;
+}
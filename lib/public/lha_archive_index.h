@@ -0,0 +1,241 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+
+#ifndef LHASA_PUBLIC_LHA_ARCHIVE_INDEX_H
+#define LHASA_PUBLIC_LHA_ARCHIVE_INDEX_H
+
+#include "lha_input_stream.h"
+#include "lha_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_archive_index.h
+ *
+ * @brief Index of the files in an LZH archive.
+ *
+ * This file defines the functions relating to the @ref LHAArchiveIndex
+ * structure, which records the location of every file in an archive,
+ * so that individual files can be opened without reading through all
+ * of the files before them.
+ *
+ * An index can be saved to a separate index file, so that large
+ * archives can later be listed or searched without reading the file
+ * headers again.
+ */
+
+/**
+ * Opaque structure, representing an index of the files in an archive.
+ */
+
+typedef struct _LHAArchiveIndex LHAArchiveIndex;
+
+/**
+ * Structure describing a file recorded in an @ref LHAArchiveIndex.
+ */
+
+typedef struct {
+
+	/**
+	 * Full path of the file within the archive: the concatenation
+	 * of the path and filename fields of the file header.
+	 */
+	char *name;
+
+	/** Offset of the file header within the input stream. */
+	uint64_t header_offset;
+
+	/** Offset of the compressed data within the input stream. */
+	uint64_t data_offset;
+
+	/** Length of the compressed data. */
+	size_t compressed_length;
+
+	/** Length of the uncompressed data. */
+	size_t length;
+
+	/** Compression method. */
+	char compress_method[6];
+
+	/** 16-bit CRC of the uncompressed data. */
+	uint16_t crc;
+
+	/**
+	 * Target of the symbolic link, or NULL if the file is not a
+	 * symbolic link.
+	 */
+	char *symlink_target;
+
+	/** Unix timestamp of the modification time of the file. */
+	unsigned int timestamp;
+
+	/** LZH header format used to store the file header. */
+	uint8_t header_level;
+
+	/** OS type indicator (see @ref LHAFileHeader). */
+	uint8_t os_type;
+
+	/**
+	 * Flags bitfield identifying which of the fields below are set,
+	 * as for @ref LHAFileHeader.
+	 */
+	unsigned int extra_flags;
+
+	/** Unix permissions. */
+	unsigned int unix_perms;
+
+	/** Unix user ID. */
+	unsigned int unix_uid;
+
+	/** Unix group ID. */
+	unsigned int unix_gid;
+
+	/** OS-9 permissions. */
+	unsigned int os9_perms;
+
+} LHAArchiveIndexEntry;
+
+/**
+ * Create an index of the files in an archive, by reading through the
+ * headers of all files in the specified input stream.
+ *
+ * The input stream is not freed when the index is freed; however, it
+ * must remain valid while the index is in use, as it is used by
+ * @ref lha_reader_open_member to read files from the archive.
+ *
+ * @param stream       The input stream, positioned at the start of
+ *                     the archive.
+ * @return             Pointer to a new @ref LHAArchiveIndex structure,
+ *                     or NULL for error.
+ */
+
+LHAArchiveIndex *lha_archive_index_new(LHAInputStream *stream);
+
+/**
+ * Load an index previously saved with @ref lha_archive_index_save.
+ *
+ * The index file is mapped into memory rather than read. It is only
+ * loaded if it is valid and up to date: the size and modification
+ * time of the archive must match those recorded when the index was
+ * saved, as must a checksum of the first and last file headers in
+ * the archive.
+ *
+ * @param stream       Input stream to read files from with
+ *                     @ref lha_reader_open_member, or NULL if files
+ *                     will not be opened.
+ * @param filename     Path to the archive file.
+ * @param index_filename  Path to the index file.
+ * @return             Pointer to a new @ref LHAArchiveIndex structure,
+ *                     or NULL if the index file could not be loaded,
+ *                     or is out of date.
+ */
+
+LHAArchiveIndex *lha_archive_index_load(LHAInputStream *stream,
+                                        char *filename,
+                                        char *index_filename);
+
+/**
+ * Save an index to an index file, so that it can be loaded again later
+ * with @ref lha_archive_index_load.
+ *
+ * @param index        The index.
+ * @param filename     Path to the archive file that the index was
+ *                     created from.
+ * @param index_filename  Path to the index file to write.
+ * @return             Non-zero for success, or zero for failure.
+ */
+
+int lha_archive_index_save(LHAArchiveIndex *index, char *filename,
+                           char *index_filename);
+
+/**
+ * Free an @ref LHAArchiveIndex structure.
+ *
+ * @param index        The index.
+ */
+
+void lha_archive_index_free(LHAArchiveIndex *index);
+
+/**
+ * Get the number of files recorded in an index.
+ *
+ * @param index        The index.
+ * @return             Number of files.
+ */
+
+unsigned int lha_archive_index_num_entries(LHAArchiveIndex *index);
+
+/**
+ * Get the entry for a file recorded in an index. Entries are in the
+ * order that the files appear in the archive.
+ *
+ * @param index        The index.
+ * @param n            Number of the entry, counting from zero.
+ * @return             Pointer to the entry, or NULL if n is out of range.
+ */
+
+const LHAArchiveIndexEntry *lha_archive_index_entry(LHAArchiveIndex *index,
+                                                    unsigned int n);
+
+/**
+ * Look up a file in an index by name.
+ *
+ * @param index        The index.
+ * @param name         Full path of the file within the archive (see
+ *                     @ref LHAArchiveIndexEntry::name).
+ * @return             Pointer to the entry, or NULL if the file is not
+ *                     in the archive. If the archive contains several
+ *                     files with the same name, the last one is
+ *                     returned.
+ */
+
+const LHAArchiveIndexEntry *lha_archive_index_find(LHAArchiveIndex *index,
+                                                   char *name);
+
+/**
+ * Open a file in an indexed archive, seeking directly to it.
+ *
+ * A new @ref LHAReader is returned, reading from the input stream the
+ * index was created from. The first call to @ref lha_reader_next_file
+ * returns the header of the requested file, which can then be read
+ * or extracted as normal.
+ *
+ * The input stream must support seeking (see
+ * @ref LHAInputStreamTypeEx). As the reader shares the
+ * input stream with the index, only one reader returned by this
+ * function can be in use at once; it must be freed (with
+ * @ref lha_reader_free) before another file is opened.
+ *
+ * @param index        The index.
+ * @param name         Full path of the file within the archive.
+ * @return             Pointer to a new @ref LHAReader structure, or NULL
+ *                     if the file is not in the archive, or for error.
+ */
+
+LHAReader *lha_reader_open_member(LHAArchiveIndex *index, char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_ARCHIVE_INDEX_H */
@@ -119,6 +119,44 @@ LHADecoder *lha_decoder_new(LHADecoderType *dtype,
                             void *callback_data,
                             size_t stream_length);
 
+/**
+ * Allocate a new push decoder for the specified type.
+ *
+ * Instead of reading compressed data through a callback function, a
+ * push decoder is passed compressed data as it becomes available, using
+ * @ref lha_decoder_feed. This allows data to be decompressed as it
+ * arrives from a non-blocking source, such as a network socket.
+ *
+ * @param dtype          The decoder type.
+ * @param stream_length  Length of the uncompressed data, in bytes. When
+ *                       this point is reached, decompression will stop.
+ * @return               Pointer to the new decoder, or NULL for failure.
+ */
+
+LHADecoder *lha_decoder_new_push(LHADecoderType *dtype,
+                                 size_t stream_length);
+
+/**
+ * Reset a decoder, so that it can be used to decompress another stream
+ * of data compressed with the same algorithm. This is cheaper than
+ * freeing the decoder and allocating a new one.
+ *
+ * @param decoder        The decoder.
+ * @param callback       Callback function for the decoder to call to read
+ *                       more compressed data. Ignored for push decoders.
+ * @param callback_data  Extra data to pass to the callback function.
+ * @param stream_length  Length of the uncompressed data, in bytes. When
+ *                       this point is reached, decompression will stop.
+ * @return               Non-zero for success, or zero for failure. If
+ *                       the reset fails, the decoder cannot be used
+ *                       again, and must be freed.
+ */
+
+int lha_decoder_reset(LHADecoder *decoder,
+                      LHADecoderCallback callback,
+                      void *callback_data,
+                      size_t stream_length);
+
 /**
  * Free a decoder.
  *
@@ -150,6 +188,83 @@ void lha_decoder_monitor(LHADecoder *decoder,
 
 size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len);
 
+/**
+ * Decode (decompress) data into a buffer that holds all of the output
+ * from the start of the stream, such as a memory-mapped output file.
+ * Decoders that support it keep no history of their own in this mode:
+ * copies read earlier output directly from the buffer, and the data is
+ * decoded straight into it without passing through an output buffer.
+ * Other decoders decode into the buffer as @ref lha_decoder_read does.
+ *
+ * Decoding continues from the current position in the stream (see
+ * @ref lha_decoder_get_length); the data before it must already be in
+ * the buffer. Once this function has been used, data must not be read
+ * from the decoder using @ref lha_decoder_read.
+ *
+ * @param decoder        The decoder.
+ * @param buf            Pointer to the start of the output buffer.
+ * @param buf_len        Size of the buffer, in bytes.
+ * @return               Number of bytes decompressed.
+ */
+
+size_t lha_decoder_read_linear(LHADecoder *decoder, uint8_t *buf,
+                               size_t buf_len);
+
+/**
+ * Pass more compressed data to a push decoder, and decode as much of
+ * it as possible.
+ *
+ * Data is decoded a command at a time, and decoding only continues
+ * while enough compressed data is available to be certain that the next
+ * command can be decoded completely; otherwise, decoding stops until
+ * more data is fed. The decoder keeps a small amount of compressed data
+ * buffered internally, so not all of the passed data may be consumed;
+ * the rest must be passed again in the next call. Similarly, the
+ * decoder holds any decompressed data that does not fit into the output
+ * buffer until the next call.
+ *
+ * Calling this function with in_len set to zero just decodes from the
+ * data already fed, so that output held by the decoder can be collected
+ * without passing more data. Once all the compressed data has been fed,
+ * call @ref lha_decoder_feed_end, and then call this function with
+ * in_len set to zero repeatedly until no more data is produced.
+ * Decompression has finished successfully if
+ * @ref lha_decoder_get_length then returns the stream length.
+ *
+ * @param decoder        The decoder, created with
+ *                       @ref lha_decoder_new_push.
+ * @param in             Pointer to the compressed data.
+ * @param in_len         Length of the compressed data, in bytes. May be
+ *                       zero.
+ * @param out            Pointer to buffer to store decompressed data.
+ * @param out_cap        Size of the output buffer, in bytes.
+ * @param consumed       Pointer to a variable in which to store the
+ *                       number of bytes of compressed data consumed.
+ * @param produced       Pointer to a variable in which to store the
+ *                       number of bytes of data decompressed.
+ * @return               Non-zero for success, or zero if the compressed
+ *                       data is invalid or truncated, or the decoder is
+ *                       not a push decoder.
+ */
+
+int lha_decoder_feed(LHADecoder *decoder,
+                     const uint8_t *in, size_t in_len,
+                     uint8_t *out, size_t out_cap,
+                     size_t *consumed, size_t *produced);
+
+/**
+ * Indicate that all the compressed data has been passed to a push
+ * decoder with @ref lha_decoder_feed. The decoder then decodes the
+ * remaining data, rather than waiting for more to be fed. The
+ * remaining output is collected by calling @ref lha_decoder_feed
+ * with in_len set to zero.
+ *
+ * @param decoder        The decoder, created with
+ *                       @ref lha_decoder_new_push.
+ */
+
+void lha_decoder_feed_end(LHADecoder *decoder);
+
 /**
  * Get the current 16-bit CRC of the decompressed data.
  *
@@ -175,6 +290,79 @@ uint16_t lha_decoder_get_crc(LHADecoder *decoder);
 
 size_t lha_decoder_get_length(LHADecoder *decoder);
 
+/**
+ * Get the size of the buffer needed to save the state of a decoder of
+ * the specified type with @ref lha_decoder_save_state.
+ *
+ * @param dtype          The decoder type.
+ * @return               Size of the saved state, in bytes, or zero if
+ *                       decoders of this type cannot save their state.
+ */
+
+size_t lha_decoder_state_size(LHADecoderType *dtype);
+
+/**
+ * Save the state of a decoder, so that decoding can later continue
+ * from the same point with @ref lha_decoder_restore_state, without
+ * decoding all of the data before it again. The state includes the
+ * position in the stream and the CRC of the data so far.
+ *
+ * The state is saved in a portable format, so that it can be stored
+ * in a file. It cannot be saved for push decoders, after an error, or
+ * after @ref lha_decoder_read_linear has been used.
+ *
+ * @param decoder        The decoder.
+ * @param buf            Buffer in which to store the state, of the
+ *                       size returned by @ref lha_decoder_state_size.
+ * @return               Non-zero for success, or zero for failure.
+ */
+
+int lha_decoder_save_state(LHADecoder *decoder, uint8_t *buf);
+
+/**
+ * Get the position in the decompressed data at which a decoder state
+ * was saved. This might be after the position returned by
+ * @ref lha_decoder_get_length when the state was saved, as the decoder
+ * can decompress some data before it is read.
+ *
+ * @param buf            Pointer to the saved state.
+ * @return               Position in the decompressed data, in bytes.
+ */
+
+size_t lha_decoder_state_position(uint8_t *buf);
+
+/**
+ * Get the position in the compressed data from which the callback
+ * function must read, to restore a saved state.
+ *
+ * @param buf            Pointer to the saved state.
+ * @return               Position in the compressed data, in bytes.
+ */
+
+uint64_t lha_decoder_state_input_position(uint8_t *buf);
+
+/**
+ * Restore a state saved by @ref lha_decoder_save_state, to continue
+ * decoding from the point where the state was saved. The decoder must
+ * be of the same type, and decoding the same stream, as the decoder
+ * that saved the state.
+ *
+ * @param decoder        The decoder.
+ * @param buf            Pointer to the saved state.
+ * @param callback       Callback function for the decoder to call to
+ *                       read more compressed data. It must read from
+ *                       the position returned by
+ *                       @ref lha_decoder_state_input_position.
+ * @param callback_data  Extra data to pass to the callback function.
+ * @return               Non-zero for success, or zero if the state is
+ *                       not valid; the decoder must then be reset
+ *                       before it can be used again.
+ */
+
+int lha_decoder_restore_state(LHADecoder *decoder, uint8_t *buf,
+                              LHADecoderCallback callback,
+                              void *callback_data);
+
 #ifdef __cplusplus
 }
 #endif
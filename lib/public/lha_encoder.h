@@ -0,0 +1,237 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+
+#ifndef LHASA_PUBLIC_LHA_ENCODER_H
+#define LHASA_PUBLIC_LHA_ENCODER_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_encoder.h
+ *
+ * @brief Raw LHA data encoder.
+ *
+ * This file defines the interface to the compression code, which can
+ * be used to generate the raw compressed data stored in an LZH file.
+ *
+ * Encoders are only provided for some of the algorithms that can be
+ * decoded (see @ref lha_decoder.h); they are represented by the
+ * @ref LHAEncoderType structure, and can be retrieved using the
+ * @ref lha_encoder_for_name function. One of these can then be passed to
+ * the @ref lha_encoder_new function to create a @ref LHAEncoder structure
+ * and compress the data.
+ */
+
+/**
+ * Opaque type representing a type of encoder.
+ *
+ * This is an implementation of the compression code for one of the
+ * algorithms used in LZH archive files. Pointers to these structures are
+ * retrieved by using the @ref lha_encoder_for_name function.
+ */
+
+typedef struct _LHAEncoderType LHAEncoderType;
+
+/**
+ * Opaque type representing an instance of an encoder.
+ *
+ * This is an encoder structure being used to compress a stream of
+ * data. Instantiated using the @ref lha_encoder_new function and freed
+ * using the @ref lha_encoder_free function.
+ */
+
+typedef struct _LHAEncoder LHAEncoder;
+
+/**
+ * Callback function invoked when an encoder wants to read more data
+ * to compress.
+ *
+ * @param buf        Pointer to the buffer in which to store the data.
+ * @param buf_len    Size of the buffer, in bytes.
+ * @param user_data  Extra pointer to pass to the encoder.
+ * @return           Number of bytes read, or zero for end of file.
+ */
+
+typedef size_t (*LHAEncoderCallback)(void *buf, size_t buf_len,
+                                     void *user_data);
+
+/**
+ * Lowest compression level, which compresses fastest.
+ */
+
+#define LHA_ENCODER_MIN_LEVEL      1
+
+/**
+ * Highest compression level, which gives the best compression ratio.
+ */
+
+#define LHA_ENCODER_MAX_LEVEL      9
+
+/**
+ * Compression level giving a balance between speed and compression
+ * ratio.
+ */
+
+#define LHA_ENCODER_DEFAULT_LEVEL  6
+
+/**
+ * Get the encoder type for the specified name.
+ *
+ * @param name           String identifying the encoder type, for
+ *                       example, "-lh5-".
+ * @return               Pointer to the encoder type, or NULL if there
+ *                       is no encoder type for the specified name.
+ */
+
+LHAEncoderType *lha_encoder_for_name(char *name);
+
+/**
+ * Allocate a new encoder for the specified type.
+ *
+ * @param etype          The encoder type.
+ * @param level          Compression level, from
+ *                       @ref LHA_ENCODER_MIN_LEVEL to
+ *                       @ref LHA_ENCODER_MAX_LEVEL. Higher levels
+ *                       search harder for matches, and are slower.
+ * @param callback       Callback function for the encoder to call to read
+ *                       more data to compress.
+ * @param callback_data  Extra data to pass to the callback function.
+ * @return               Pointer to the new encoder, or NULL for failure
+ *                       (including if the level is out of range).
+ */
+
+LHAEncoder *lha_encoder_new(LHAEncoderType *etype,
+                            int level,
+                            LHAEncoderCallback callback,
+                            void *callback_data);
+
+/**
+ * Allocate a new encoder for the specified type, that compresses the
+ * data using multiple threads.
+ *
+ * The data is split into large chunks, that are compressed in parallel.
+ * Each chunk is compressed as a separate series of blocks, that can
+ * still copy from the data in the preceding chunk. The result can be
+ * decompressed as normal, but is not identical to the output of an
+ * encoder created with @ref lha_encoder_new, and is very slightly
+ * larger. If threads are not supported, the chunks are compressed one
+ * at a time.
+ *
+ * If a chunk cannot be compressed (eg. if memory cannot be allocated
+ * for it), compression stops early, and @ref lha_encoder_failed
+ * returns non-zero. The data already read for that chunk and any
+ * after it is lost; the compressed data is still valid, and
+ * @ref lha_encoder_get_length and @ref lha_encoder_get_crc only cover
+ * the data compressed.
+ *
+ * @param etype          The encoder type.
+ * @param level          Compression level, from
+ *                       @ref LHA_ENCODER_MIN_LEVEL to
+ *                       @ref LHA_ENCODER_MAX_LEVEL.
+ * @param num_threads    Number of threads to use.
+ * @param callback       Callback function for the encoder to call to read
+ *                       more data to compress.
+ * @param callback_data  Extra data to pass to the callback function.
+ * @return               Pointer to the new encoder, or NULL for failure
+ *                       (including if the encoder type cannot compress
+ *                       in parallel).
+ */
+
+LHAEncoder *lha_encoder_new_parallel(LHAEncoderType *etype,
+                                     int level,
+                                     unsigned int num_threads,
+                                     LHAEncoderCallback callback,
+                                     void *callback_data);
+
+/**
+ * Free an encoder.
+ *
+ * @param encoder        The encoder to free.
+ */
+
+void lha_encoder_free(LHAEncoder *encoder);
+
+/**
+ * Encode (compress) more data. Data is read from the callback function
+ * until it reaches the end of the data.
+ *
+ * @param encoder        The encoder.
+ * @param buf            Pointer to buffer to store compressed data.
+ * @param buf_len        Size of the buffer, in bytes.
+ * @return               Number of bytes of compressed data stored in the
+ *                       buffer. This is less than buf_len only at the
+ *                       end of the compressed data, or if compression
+ *                       failed (see @ref lha_encoder_failed).
+ */
+
+size_t lha_encoder_read(LHAEncoder *encoder, uint8_t *buf, size_t buf_len);
+
+/**
+ * Check whether compression stopped before the end of the data because
+ * of an error. This should be checked once @ref lha_encoder_read has
+ * reached the end of the compressed data.
+ *
+ * Only parallel encoders (see @ref lha_encoder_new_parallel) can fail
+ * in this way; for other encoders, this always returns zero.
+ *
+ * @param encoder        The encoder.
+ * @return               Non-zero if compression failed, and some of the
+ *                       data read from the callback function was not
+ *                       compressed.
+ */
+
+int lha_encoder_failed(LHAEncoder *encoder);
+
+/**
+ * Get the current 16-bit CRC of the data that has been compressed.
+ *
+ * This should be called at the end of compression, to get the CRC to
+ * store in the file header.
+ *
+ * @param encoder        The encoder.
+ * @return               16-bit CRC of the data read so far.
+ */
+
+uint16_t lha_encoder_get_crc(LHAEncoder *encoder);
+
+/**
+ * Get the count of the number of bytes of data that have been read
+ * from the callback function to be compressed.
+ *
+ * This should be called at the end of compression, to get the file
+ * length to store in the file header.
+ *
+ * @param encoder        The encoder.
+ * @return               The number of bytes read.
+ */
+
+size_t lha_encoder_get_length(LHAEncoder *encoder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_ENCODER_H */
@@ -23,6 +23,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #define LHASA_PUBLIC_LHA_INPUT_STREAM_H
 
 #include <stdio.h>
+#include <inttypes.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -84,6 +85,57 @@ typedef struct {
 
 } LHAInputStreamType;
 
+/**
+ * Extended set of callback functions to read data from the input
+ * stream, used with @ref lha_input_stream_new_ex. As well as the
+ * functions in @ref LHAInputStreamType, this includes optional
+ * functions that the library can use to read the data more
+ * efficiently, and to seek within it.
+ */
+
+typedef struct {
+
+	/**
+	 * Basic functions to read data, as for
+	 * @ref lha_input_stream_new.
+	 */
+
+	LHAInputStreamType base;
+
+	/**
+	 * Borrow a pointer to the next block of data from the input
+	 * stream, instead of copying it into a buffer. The stream
+	 * position advances past the returned data. This is an optional
+	 * function, that streams whose data is already in memory can
+	 * provide to avoid copying.
+	 *
+	 * @param handle       Handle pointer.
+	 * @param buf          Pointer to a variable in which to store a
+	 *                     pointer to the data. The data must remain
+	 *                     valid until the input stream is closed.
+	 * @param buf_len      Maximum number of bytes to return.
+	 * @return             Number of bytes available at the returned
+	 *                     pointer, zero for end of file, or -1 for
+	 *                     error.
+	 */
+
+	int (*borrow)(void *handle, const void **buf, size_t buf_len);
+
+	/**
+	 * Seek forwards or backwards from the current position in the
+	 * input stream. This is an optional function, needed to open
+	 * files in random order with @ref lha_reader_open_member.
+	 *
+	 * @param handle       Handle pointer.
+	 * @param offset       Number of bytes to seek by; negative values
+	 *                     seek backwards.
+	 * @return             Non-zero for success, or zero for failure.
+	 */
+
+	int (*seek)(void *handle, int64_t offset);
+
+} LHAInputStreamTypeEx;
+
 /**
  * Create new @ref LHAInputStream structure, using a set of generic functions
  * to provide LHA data.
@@ -97,6 +149,19 @@ typedef struct {
 LHAInputStream *lha_input_stream_new(const LHAInputStreamType *type,
                                      void *handle);
 
+/**
+ * Create new @ref LHAInputStream structure, using an extended set of
+ * generic functions to provide LHA data.
+ *
+ * @param type         Pointer to a @ref LHAInputStreamTypeEx structure
+ *                     containing callback functions to read data.
+ * @param handle       Handle pointer to be passed to callback functions.
+ * @return             Pointer to a new @ref LHAInputStream or NULL for error.
+ */
+
+LHAInputStream *lha_input_stream_new_ex(const LHAInputStreamTypeEx *type,
+                                        void *handle);
+
 /**
  * Create new @ref LHAInputStream, reading from the specified filename.
  * The file is automatically closed when the input stream is freed.
@@ -118,6 +183,32 @@ LHAInputStream *lha_input_stream_from(char *filename);
 
 LHAInputStream *lha_input_stream_from_FILE(FILE *stream);
 
+/**
+ * Create new @ref LHAInputStream, reading from the specified filename.
+ * Instead of being read into memory, the file is mapped, and compressed
+ * data is passed to the decoders without copying it. The file is
+ * unmapped when the input stream is freed.
+ *
+ * @param filename     Name of the file to read from.
+ * @return             Pointer to a new @ref LHAInputStream or NULL for error
+ *                     (including if the file cannot be mapped).
+ */
+
+LHAInputStream *lha_input_stream_from_mmap(char *filename);
+
+/**
+ * Create new @ref LHAInputStream, to read from a block of data in memory.
+ * The data is not copied, and must remain valid until the input stream
+ * is freed.
+ *
+ * @param data         Pointer to the data to read from.
+ * @param data_len     Length of the data, in bytes.
+ * @return             Pointer to a new @ref LHAInputStream or NULL for error.
+ */
+
+LHAInputStream *lha_input_stream_from_memory(const void *data,
+                                             size_t data_len);
+
 /**
  * Free an @ref LHAInputStream structure.
  *
@@ -136,6 +136,38 @@ void lha_reader_free(LHAReader *reader);
 void lha_reader_set_dir_policy(LHAReader *reader,
                                LHAReaderDirPolicy policy);
 
+/**
+ * Set the minimum size of file to extract using a pipeline.
+ *
+ * When a file is extracted using a pipeline, the compressed data is
+ * read, decompressed and written to the output file on three separate
+ * threads, so that slow reads and writes overlap with decompression.
+ * Starting the threads has a cost, so this is only worthwhile for
+ * large files. By default, pipelines are not used.
+ *
+ * @param reader     The @ref LHAReader structure.
+ * @param min_length Minimum length of a file's compressed data, in bytes,
+ *                   for a pipeline to be used to extract it, or zero to
+ *                   never use a pipeline.
+ */
+
+void lha_reader_set_pipeline(LHAReader *reader, size_t min_length);
+
+/**
+ * Set whether extracted files are written as sparse files.
+ *
+ * If enabled, blocks of decompressed data that are entirely zero are
+ * not written; instead, holes are left in the output file, which take
+ * up no disk space on filesystems that support sparse files. This is
+ * useful for archived disk images, for example. By default, sparse
+ * files are not created.
+ *
+ * @param reader     The @ref LHAReader structure.
+ * @param sparse     Non-zero to write sparse files.
+ */
+
+void lha_reader_set_sparse(LHAReader *reader, int sparse);
+
 /**
  * Read the header of the next archived file from the input stream.
  *
@@ -160,6 +192,30 @@ LHAFileHeader *lha_reader_next_file(LHAReader *reader);
 
 size_t lha_reader_read(LHAReader *reader, void *buf, size_t buf_len);
 
+/**
+ * Decompress all of the data for the current archived file in a single
+ * call, and check that it was decompressed correctly. This is faster
+ * than reading the data in chunks with @ref lha_reader_read, as the
+ * decoder can decompress directly into the buffer (see
+ * @ref lha_decoder_read_linear).
+ *
+ * No data must already have been read from the current file with
+ * @ref lha_reader_read.
+ *
+ * @param reader     The @ref LHAReader structure.
+ * @param buf        Pointer to a buffer in which to store the data, which
+ *                   must be at least as large as the length in the file
+ *                   header, or NULL to allocate a buffer.
+ * @param len        Pointer to a variable in which to store the number of
+ *                   bytes of data.
+ * @return           Pointer to the data, or NULL if the file could not be
+ *                   decompressed, or the length or CRC of the data did not
+ *                   match the file header. If the buffer was allocated,
+ *                   it must be freed by the caller using free().
+ */
+
+void *lha_reader_read_all(LHAReader *reader, void *buf, size_t *len);
+
 /**
  * Decompress the contents of the current archived file, and check
  * that the checksum matches correctly.
@@ -209,6 +265,24 @@ int lha_reader_extract(LHAReader *reader,
 
 int lha_reader_current_is_fake(LHAReader *reader);
 
+/**
+ * Get the offset within the input stream of the header of the current
+ * file (last returned by @ref lha_reader_next_file).
+ *
+ * The file can then be decompressed independently of this reader, by
+ * creating a new @ref LHAReader on a stream that starts at this offset
+ * (for example, using @ref lha_input_stream_from_memory). This allows
+ * several files to be decompressed in parallel.
+ *
+ * @param reader         The @ref LHAReader structure.
+ * @return               Offset of the header in bytes, from the start
+ *                       of the input stream. The result is meaningless
+ *                       if the current file is a "fake" (see
+ *                       @ref lha_reader_current_is_fake).
+ */
+
+uint64_t lha_reader_curr_file_offset(LHAReader *reader);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,144 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+
+#ifndef LHASA_PUBLIC_LHA_SEEK_INDEX_H
+#define LHASA_PUBLIC_LHA_SEEK_INDEX_H
+
+#include "lha_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_seek_index.h
+ *
+ * @brief Index of positions within a compressed file.
+ *
+ * This file defines the functions relating to the @ref LHASeekIndex
+ * structure, which allows reading to start part way through a
+ * compressed file, without decompressing all of the data before it.
+ *
+ * While a file is read, the state of the decoder is saved at regular
+ * intervals (checkpoints). To seek to a position within the file, the
+ * decoder state is restored from the nearest checkpoint before it, and
+ * only the data after the checkpoint is decompressed. A seek index can
+ * be saved to a separate file, and loaded again later to read the same
+ * file.
+ */
+
+/**
+ * Opaque structure, representing a seek index for a compressed file.
+ */
+
+typedef struct _LHASeekIndex LHASeekIndex;
+
+/**
+ * Create a new, empty seek index.
+ *
+ * @param interval     Interval between checkpoints, in bytes of
+ *                     decompressed data. Each checkpoint holds the
+ *                     decoder's history, so shorter intervals make
+ *                     seeking faster, but use more memory.
+ * @return             Pointer to a new @ref LHASeekIndex structure,
+ *                     or NULL for error.
+ */
+
+LHASeekIndex *lha_seek_index_new(size_t interval);
+
+/**
+ * Load a seek index previously saved with @ref lha_seek_index_save.
+ *
+ * @param filename     Path to the seek index file.
+ * @return             Pointer to a new @ref LHASeekIndex structure,
+ *                     or NULL if the file could not be loaded.
+ */
+
+LHASeekIndex *lha_seek_index_load(char *filename);
+
+/**
+ * Save a seek index to a file, so that it can be loaded again later
+ * with @ref lha_seek_index_load.
+ *
+ * @param index        The seek index.
+ * @param filename     Path to the seek index file to write.
+ * @return             Non-zero for success, or zero for failure.
+ */
+
+int lha_seek_index_save(LHASeekIndex *index, char *filename);
+
+/**
+ * Free an @ref LHASeekIndex structure.
+ *
+ * @param index        The seek index.
+ */
+
+void lha_seek_index_free(LHASeekIndex *index);
+
+/**
+ * Get the number of checkpoints recorded in a seek index.
+ *
+ * @param index        The seek index.
+ * @return             Number of checkpoints.
+ */
+
+unsigned int lha_seek_index_num_checkpoints(LHASeekIndex *index);
+
+/**
+ * Use a seek index for the current file of a reader. Checkpoints are
+ * added to the index as the file is read, and are used by
+ * @ref lha_reader_seek. The index stays in use until the next call to
+ * @ref lha_reader_next_file; it is not freed by the reader.
+ *
+ * An empty index can be used with any file. Once checkpoints have been
+ * added, the index can only be used with the same file.
+ *
+ * @param reader       The @ref LHAReader structure.
+ * @param index        The seek index.
+ * @return             Non-zero for success, or zero if the index was
+ *                     created for a different file, or the file's
+ *                     compression method is not supported.
+ */
+
+int lha_reader_set_seek_index(LHAReader *reader, LHASeekIndex *index);
+
+/**
+ * Seek to a position within the current file of a reader, so that the
+ * next call to @ref lha_reader_read returns the data from there. If a
+ * seek index is in use, decompression continues from the nearest
+ * checkpoint before the position; otherwise, all of the data up to it
+ * must be decompressed again.
+ *
+ * The input stream must support seeking backwards, unless the position
+ * is after the current position and no checkpoint is used.
+ *
+ * @param reader       The @ref LHAReader structure.
+ * @param offset       Position within the decompressed data, in bytes.
+ * @return             Non-zero for success, or zero for failure.
+ */
+
+int lha_reader_seek(LHAReader *reader, size_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_SEEK_INDEX_H */
@@ -21,9 +21,12 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #ifndef LHASA_PUBLIC_LHASA_H
 #define LHASA_PUBLIC_LHASA_H
 
+#include "lha_archive_index.h"
 #include "lha_decoder.h"
+#include "lha_encoder.h"
 #include "lha_file_header.h"
 #include "lha_input_stream.h"
 #include "lha_reader.h"
+#include "lha_seek_index.h"
 
 #endif /* #ifndef LHASA_PUBLIC_LHASA_H */
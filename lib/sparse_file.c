@@ -0,0 +1,146 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Sparse file output.
+//
+// Data is divided into blocks, and blocks of zeros are skipped over
+// instead of being written. Checking for zeros stops at the first
+// non-zero byte, which for most data is found within the first few
+// bytes of a block, so the cost is small for data that is not sparse.
+//
+
+#include <string.h>
+
+#include "lha_arch.h"
+#include "sparse_file.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Size of the blocks that are checked for zeros. This matches the
+// block size of most filesystems; smaller holes do not save space.
+
+#define SPARSE_BLOCK_SIZE 4096
+
+// Check if a buffer is entirely zero.
+
+static int is_zero(const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	i = 0;
+
+#if defined(__SSE2__)
+	{
+		__m128i acc;
+
+		for (; i + 64 <= len; i += 64) {
+			acc = _mm_or_si128(
+			    _mm_or_si128(
+			        _mm_loadu_si128((const __m128i *) (buf + i)),
+			        _mm_loadu_si128((const __m128i *) (buf + i
+			                                           + 16))),
+			    _mm_or_si128(
+			        _mm_loadu_si128((const __m128i *) (buf + i
+			                                           + 32)),
+			        _mm_loadu_si128((const __m128i *) (buf + i
+			                                           + 48))));
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(
+			        acc, _mm_setzero_si128())) != 0xffff) {
+				return 0;
+			}
+		}
+	}
+#else
+	{
+		uint64_t words[4];
+
+		for (; i + sizeof(words) <= len; i += sizeof(words)) {
+			memcpy(words, buf + i, sizeof(words));
+
+			if ((words[0] | words[1] | words[2] | words[3]) != 0) {
+				return 0;
+			}
+		}
+	}
+#endif
+
+	for (; i < len; ++i) {
+		if (buf[i] != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int sparse_file_write(FILE *fstream, const uint8_t *buf, size_t len)
+{
+	size_t start, pos, block_len;
+	int zero, run_zero;
+
+	// Find runs of blocks that are either all zero or not, and
+	// write or skip each run as a whole.
+
+	start = 0;
+	run_zero = 0;
+
+	for (pos = 0; pos < len; pos += block_len) {
+		block_len = len - pos;
+
+		if (block_len > SPARSE_BLOCK_SIZE) {
+			block_len = SPARSE_BLOCK_SIZE;
+		}
+
+		zero = is_zero(buf + pos, block_len);
+
+		if (pos > start && zero != run_zero) {
+			if (run_zero) {
+				if (!lha_arch_skip(fstream, pos - start)) {
+					return 0;
+				}
+			} else if (!lha_arch_write(fstream, buf + start,
+			                           pos - start)) {
+				return 0;
+			}
+
+			start = pos;
+		}
+
+		run_zero = zero;
+	}
+
+	if (start >= len) {
+		return 1;
+	} else if (run_zero) {
+		return lha_arch_skip(fstream, len - start);
+	} else {
+		return lha_arch_write(fstream, buf + start, len - start);
+	}
+}
+
+int sparse_file_finish(FILE *fstream)
+{
+	return lha_arch_truncate(fstream);
+}
+
@@ -0,0 +1,52 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_SPARSE_FILE_H
+#define LHASA_SPARSE_FILE_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/**
+ * Write data to an output file, creating holes in the file instead of
+ * writing blocks that are entirely zero. The data must start at a
+ * position in the file that is a multiple of the block size.
+ *
+ * After the last write, @ref sparse_file_finish must be called.
+ *
+ * @param fstream      File handle returned by @ref lha_arch_fopen.
+ * @param buf          Pointer to the data to write.
+ * @param len          Length of the data, in bytes.
+ * @return             Non-zero for success, or zero for failure.
+ */
+
+int sparse_file_write(FILE *fstream, const uint8_t *buf, size_t len);
+
+/**
+ * Finish writing a file written with @ref sparse_file_write, setting
+ * its length in case it ends with a hole.
+ *
+ * @param fstream      File handle.
+ * @return             Non-zero for success, or zero for failure.
+ */
+
+int sparse_file_finish(FILE *fstream);
+
+#endif /* #ifndef LHASA_SPARSE_FILE_H */
@@ -28,6 +28,11 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // This file is implemented as a "template" file to be #include-d by
 // other files. The typedef for TreeElement must be defined before
 // include.
+//
+// If TREE_LOOKUP_BITS is defined, functions are also included to build
+// a lookup table from a tree, indexed by the next TREE_LOOKUP_BITS
+// bits of the input stream. Most codes can then be decoded with a
+// single lookup, rather than by walking the tree a bit at a time.
 
 
 // Upper bit is set in a node value to indicate a leaf.
@@ -202,6 +207,31 @@ static void build_tree(TreeElement *tree, size_t tree_len,
 	                               num_code_lengths, code_len));
 }
 
+// Check a tree that was not built by build_tree(), such as one restored
+// from a saved decoder state. As when a tree is built, every node must
+// point forwards to a pair of elements within the tree, and every leaf
+// must be a code less than max_code. Returns zero if the tree is not
+// valid.
+
+static int check_tree(TreeElement *tree, unsigned int tree_len,
+                      unsigned int max_code)
+{
+	unsigned int i;
+
+	for (i = 0; i < tree_len; ++i) {
+		if ((tree[i] & TREE_NODE_LEAF) != 0) {
+			if ((unsigned int) (tree[i] & ~TREE_NODE_LEAF)
+			    >= max_code) {
+				return 0;
+			}
+		} else if (tree[i] <= i || tree[i] + 1U >= tree_len) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 /*
 static void display_tree(TreeElement *tree, unsigned int node, int offset)
 {
@@ -222,18 +252,14 @@ static void display_tree(TreeElement *tree, unsigned int node, int offset)
 */
 
 // Read bits from the input stream, traversing the specified tree
-// from the root node until we reach a leaf.  The leaf value is
+// from the given node until we reach a leaf.  The leaf value is
 // returned.
 
-static int read_from_tree(BitStreamReader *reader, TreeElement *tree)
+static int read_from_tree_node(BitStreamReader *reader, TreeElement *tree,
+                               TreeElement code)
 {
-	TreeElement code;
 	int bit;
 
-	// Start from root.
-
-	code = tree[0];
-
 	while ((code & TREE_NODE_LEAF) == 0) {
 
 		bit = read_bit(reader);
@@ -249,3 +275,94 @@ static int read_from_tree(BitStreamReader *reader, TreeElement *tree)
 
 	return (int) (code & ~TREE_NODE_LEAF);
 }
+
+// Read bits from the input stream, traversing the specified tree
+// from the root node until we reach a leaf.  The leaf value is
+// returned.
+
+static int read_from_tree(BitStreamReader *reader, TreeElement *tree)
+{
+	return read_from_tree_node(reader, tree, tree[0]);
+}
+
+#ifdef TREE_LOOKUP_BITS
+
+#define TREE_LOOKUP_SIZE  (1 << TREE_LOOKUP_BITS)
+
+// Entry in a lookup table. If the code has a length of TREE_LOOKUP_BITS
+// bits or less, node is the leaf value and bits is its length.
+// Otherwise, node is the tree node reached after TREE_LOOKUP_BITS
+// bits, from which the rest of the code must be read.
+
+typedef struct {
+	TreeElement node;
+	uint8_t bits;
+} TreeLookupEntry;
+
+// Fill in the lookup table entries for all codes that start with the
+// specified prefix, which leads to the specified node.
+
+static void fill_lookup_table(TreeLookupEntry *table, TreeElement *tree,
+                              TreeElement node, unsigned int depth,
+                              unsigned int prefix)
+{
+	unsigned int i, start, count;
+
+	if ((node & TREE_NODE_LEAF) != 0 || depth == TREE_LOOKUP_BITS) {
+		start = prefix << (TREE_LOOKUP_BITS - depth);
+		count = 1U << (TREE_LOOKUP_BITS - depth);
+
+		for (i = 0; i < count; ++i) {
+			table[start + i].node = node;
+			table[start + i].bits = (uint8_t) depth;
+		}
+
+		return;
+	}
+
+	fill_lookup_table(table, tree, tree[node], depth + 1, prefix << 1);
+	fill_lookup_table(table, tree, tree[node + 1], depth + 1,
+	                  (prefix << 1) | 1);
+}
+
+// Build a lookup table (of TREE_LOOKUP_SIZE entries) for decoding the
+// specified tree. This must be called whenever the tree changes.
+
+static void build_lookup_table(TreeLookupEntry *table, TreeElement *tree)
+{
+	fill_lookup_table(table, tree, tree[0], 0, 0);
+}
+
+// Read a code from the input stream using the lookup table for the
+// specified tree. The result is the same as read_from_tree().
+
+static int read_from_lookup_table(BitStreamReader *reader, TreeElement *tree,
+                                  TreeLookupEntry *table)
+{
+	TreeLookupEntry *entry;
+	int bits;
+
+	bits = peek_bits(reader, TREE_LOOKUP_BITS);
+
+	// Near the end of the stream, there may not be enough bits left
+	// to index the table; walk the tree instead.
+
+	if (bits < 0) {
+		return read_from_tree(reader, tree);
+	}
+
+	entry = &table[bits];
+	skip_bits(reader, entry->bits);
+
+	// Codes longer than TREE_LOOKUP_BITS are rare; read the remainder
+	// by walking the tree.
+
+	if ((entry->node & TREE_NODE_LEAF) == 0) {
+		return read_from_tree_node(reader, tree, entry->node);
+	}
+
+	return (int) (entry->node & ~TREE_NODE_LEAF);
+}
+
+#endif /* #ifdef TREE_LOOKUP_BITS */
+
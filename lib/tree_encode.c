@@ -0,0 +1,216 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Common tree encoding code.
+//
+// This builds the Huffman codes used to encode a set of symbols, given
+// the number of times that each symbol appears. The codes are the
+// inverse of those built by tree_decode.c: they are described entirely
+// by their lengths, and are assigned to the symbols in the same order
+// as build_tree() does when it reads them back.
+//
+// This file is implemented as a "template" file to be #include-d by
+// other files.
+
+// Maximum number of symbols in a set of codes.
+
+#define MAX_TREE_SYMBOLS  512
+
+// Maximum length of a code, in bits.
+
+#define MAX_CODE_LENGTH   16
+
+// Comparison function used to sort symbols by frequency. The values
+// being sorted are the frequency in the upper bits with the symbol in
+// the lower bits, so that symbols with the same frequency are sorted
+// in a consistent order.
+
+static int compare_freq(const void *a, const void *b)
+{
+	uint64_t x = *((const uint64_t *) a), y = *((const uint64_t *) b);
+
+	return (x > y) - (x < y);
+}
+
+// Calculate the code lengths for a set of symbols, given the frequency
+// of each symbol, limiting codes to MAX_CODE_LENGTH bits. Returns the
+// number of symbols that are used (have a non-zero frequency). If
+// fewer than two symbols are used, all the lengths are zero.
+
+static unsigned int build_code_lengths(const unsigned int *freq,
+                                       unsigned int num_symbols,
+                                       uint8_t *lengths)
+{
+	uint64_t leaves[MAX_TREE_SYMBOLS];
+	uint32_t weight[MAX_TREE_SYMBOLS * 2];
+	uint16_t parent[MAX_TREE_SYMBOLS * 2];
+	uint16_t depth[MAX_TREE_SYMBOLS * 2];
+	unsigned int count[MAX_CODE_LENGTH + 1];
+	unsigned int i, n, len, node, next_leaf, next_node, kraft;
+	unsigned int children[2];
+
+	n = 0;
+
+	for (i = 0; i < num_symbols; ++i) {
+		lengths[i] = 0;
+
+		if (freq[i] != 0) {
+			leaves[n] = ((uint64_t) freq[i] << 16) | i;
+			++n;
+		}
+	}
+
+	if (n < 2) {
+		return n;
+	}
+
+	qsort(leaves, n, sizeof(uint64_t), compare_freq);
+
+	// Build the Huffman tree. The leaves are nodes 0..n-1, in order
+	// of increasing frequency. Internal nodes are created in order
+	// of increasing weight too, so the two lightest nodes are always
+	// at the front of one of the two lists.
+
+	for (i = 0; i < n; ++i) {
+		weight[i] = (uint32_t) (leaves[i] >> 16);
+	}
+
+	next_leaf = 0;
+	next_node = n;
+
+	for (node = n; node < n * 2 - 1; ++node) {
+		for (i = 0; i < 2; ++i) {
+			if (next_leaf < n
+			 && (next_node >= node
+			  || weight[next_leaf] <= weight[next_node])) {
+				children[i] = next_leaf;
+				++next_leaf;
+			} else {
+				children[i] = next_node;
+				++next_node;
+			}
+		}
+
+		weight[node] = weight[children[0]] + weight[children[1]];
+		parent[children[0]] = (uint16_t) node;
+		parent[children[1]] = (uint16_t) node;
+	}
+
+	// Find the depth of each node. Parents always come after their
+	// children, so work backwards from the root.
+
+	depth[n * 2 - 2] = 0;
+
+	for (i = n * 2 - 2; i > 0; --i) {
+		depth[i - 1] = (uint16_t) (depth[parent[i - 1]] + 1);
+	}
+
+	// Count the number of codes of each length, with overlong codes
+	// shortened to the maximum length.
+
+	memset(count, 0, sizeof(count));
+
+	for (i = 0; i < n; ++i) {
+		len = depth[i];
+
+		if (len > MAX_CODE_LENGTH) {
+			len = MAX_CODE_LENGTH;
+		}
+
+		++count[len];
+	}
+
+	// Shortening the codes leaves the tree over-full. Fix it the same
+	// way as LHA does: repeatedly remove a code of the maximum length,
+	// and split the longest shorter code into two. Each step reduces
+	// the sum of 2^-length over all codes by 2^-MAX_CODE_LENGTH.
+
+	kraft = 0;
+
+	for (len = 1; len <= MAX_CODE_LENGTH; ++len) {
+		kraft += count[len] << (MAX_CODE_LENGTH - len);
+	}
+
+	while (kraft > (1U << MAX_CODE_LENGTH)) {
+		--count[MAX_CODE_LENGTH];
+
+		for (len = MAX_CODE_LENGTH - 1; len > 0; --len) {
+			if (count[len] != 0) {
+				--count[len];
+				count[len + 1] += 2;
+				break;
+			}
+		}
+
+		--kraft;
+	}
+
+	// Assign the lengths, with the longest codes going to the least
+	// frequent symbols.
+
+	i = 0;
+
+	for (len = MAX_CODE_LENGTH; len > 0; --len) {
+		for (node = 0; node < count[len]; ++node) {
+			lengths[leaves[i] & 0xffff] = (uint8_t) len;
+			++i;
+		}
+	}
+
+	return n;
+}
+
+// Assign codes to a set of symbols, given the length of each code.
+// Shorter codes come before longer ones, and codes of the same length
+// are in symbol order, matching build_tree().
+
+static void build_codes(const uint8_t *lengths, unsigned int num_symbols,
+                        uint16_t *codes)
+{
+	unsigned int count[MAX_CODE_LENGTH + 1];
+	unsigned int next[MAX_CODE_LENGTH + 1];
+	unsigned int i, len, code;
+
+	memset(count, 0, sizeof(count));
+
+	for (i = 0; i < num_symbols; ++i) {
+		++count[lengths[i]];
+	}
+
+	code = 0;
+	count[0] = 0;
+
+	for (len = 1; len <= MAX_CODE_LENGTH; ++len) {
+		code = (code + count[len - 1]) << 1;
+		next[len] = code;
+	}
+
+	for (i = 0; i < num_symbols; ++i) {
+		len = lengths[i];
+
+		if (len > 0) {
+			codes[i] = (uint16_t) next[len];
+			++next[len];
+		} else {
+			codes[i] = 0;
+		}
+	}
+}
+
@@ -0,0 +1,275 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Pool of worker threads, used by the command line tool to process
+// archived files in parallel, and by the encoder to compress chunks of
+// data in parallel.
+//
+// Jobs are started in the order in which they are submitted, and are
+// also collected in that order, so that the results can be reported
+// deterministically.
+//
+
+#include <stdlib.h>
+
+#include "lha_arch.h"
+#include "worker_pool.h"
+
+typedef struct _WorkerPoolJob WorkerPoolJob;
+
+struct _WorkerPoolJob {
+	void *job;
+	int done;
+	WorkerPoolJob *next;
+};
+
+struct _WorkerPool {
+	WorkerPoolFunc func;
+
+	// Outstanding jobs, in order of submission. Jobs from
+	// next_job onwards have not yet been started.
+
+	WorkerPoolJob *head, *tail, *next_job;
+	unsigned int pending;
+
+	// Monitor used to signal that a job has been added or has been
+	// completed. If this is NULL, threads are not available, and
+	// jobs are processed as soon as they are submitted.
+
+	LHAArchMonitor *monitor;
+	LHAArchThread **threads;
+	unsigned int num_threads;
+	int shutdown;
+};
+
+// Main function for worker threads: take jobs from the queue and
+// process them until the pool is shut down.
+
+static void worker_thread(void *data)
+{
+	WorkerPool *pool = data;
+	WorkerPoolJob *job;
+
+	lha_arch_monitor_lock(pool->monitor);
+
+	for (;;) {
+		while (pool->next_job == NULL && !pool->shutdown) {
+			lha_arch_monitor_wait(pool->monitor);
+		}
+
+		job = pool->next_job;
+
+		if (job == NULL) {
+			break;
+		}
+
+		pool->next_job = job->next;
+
+		lha_arch_monitor_unlock(pool->monitor);
+		pool->func(job->job);
+		lha_arch_monitor_lock(pool->monitor);
+
+		job->done = 1;
+		lha_arch_monitor_notify(pool->monitor);
+	}
+
+	lha_arch_monitor_unlock(pool->monitor);
+}
+
+// Stop all worker threads and free the monitor, leaving the pool to
+// process any further jobs in the calling thread.
+
+static void stop_threads(WorkerPool *pool)
+{
+	unsigned int i;
+
+	if (pool->monitor == NULL) {
+		return;
+	}
+
+	lha_arch_monitor_lock(pool->monitor);
+	pool->shutdown = 1;
+	lha_arch_monitor_notify(pool->monitor);
+	lha_arch_monitor_unlock(pool->monitor);
+
+	for (i = 0; i < pool->num_threads; ++i) {
+		lha_arch_thread_join(pool->threads[i]);
+	}
+
+	lha_arch_monitor_free(pool->monitor);
+	pool->monitor = NULL;
+	pool->num_threads = 0;
+}
+
+WorkerPool *worker_pool_new(unsigned int num_threads, WorkerPoolFunc func)
+{
+	WorkerPool *pool;
+
+	pool = calloc(1, sizeof(WorkerPool));
+
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->func = func;
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->next_job = NULL;
+	pool->pending = 0;
+	pool->shutdown = 0;
+	pool->num_threads = 0;
+
+	pool->threads = calloc(num_threads, sizeof(LHAArchThread *));
+
+	if (pool->threads == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	// If threads are not available, the pool still works, but
+	// without the monitor it processes jobs in the calling thread.
+
+	pool->monitor = lha_arch_monitor_new();
+
+	if (pool->monitor == NULL) {
+		return pool;
+	}
+
+	// If some threads fail to start, carry on with those that did.
+
+	for (pool->num_threads = 0; pool->num_threads < num_threads;
+	     ++pool->num_threads) {
+		pool->threads[pool->num_threads]
+		    = lha_arch_thread_start(worker_thread, pool);
+
+		if (pool->threads[pool->num_threads] == NULL) {
+			break;
+		}
+	}
+
+	if (pool->num_threads == 0) {
+		stop_threads(pool);
+	}
+
+	return pool;
+}
+
+void worker_pool_free(WorkerPool *pool)
+{
+	// Wait for any outstanding jobs to complete.
+
+	while (worker_pool_wait(pool, 1) != NULL);
+
+	stop_threads(pool);
+	free(pool->threads);
+	free(pool);
+}
+
+int worker_pool_submit(WorkerPool *pool, void *job)
+{
+	WorkerPoolJob *pool_job;
+
+	pool_job = malloc(sizeof(WorkerPoolJob));
+
+	if (pool_job == NULL) {
+		return 0;
+	}
+
+	pool_job->job = job;
+	pool_job->done = 0;
+	pool_job->next = NULL;
+
+	// Without threads, process the job immediately.
+
+	if (pool->monitor == NULL) {
+		pool->func(job);
+		pool_job->done = 1;
+	} else {
+		lha_arch_monitor_lock(pool->monitor);
+	}
+
+	if (pool->tail != NULL) {
+		pool->tail->next = pool_job;
+	} else {
+		pool->head = pool_job;
+	}
+
+	pool->tail = pool_job;
+	++pool->pending;
+
+	if (pool->monitor != NULL) {
+		if (pool->next_job == NULL) {
+			pool->next_job = pool_job;
+		}
+
+		lha_arch_monitor_notify(pool->monitor);
+		lha_arch_monitor_unlock(pool->monitor);
+	}
+
+	return 1;
+}
+
+unsigned int worker_pool_pending(WorkerPool *pool)
+{
+	return pool->pending;
+}
+
+void *worker_pool_wait(WorkerPool *pool, int block)
+{
+	WorkerPoolJob *pool_job;
+	void *result;
+
+	pool_job = pool->head;
+
+	if (pool_job == NULL) {
+		return NULL;
+	}
+
+	if (pool->monitor != NULL) {
+		lha_arch_monitor_lock(pool->monitor);
+
+		while (block && !pool_job->done) {
+			lha_arch_monitor_wait(pool->monitor);
+		}
+
+		if (!pool_job->done) {
+			lha_arch_monitor_unlock(pool->monitor);
+			return NULL;
+		}
+	}
+
+	pool->head = pool_job->next;
+
+	if (pool->head == NULL) {
+		pool->tail = NULL;
+	}
+
+	--pool->pending;
+
+	if (pool->monitor != NULL) {
+		lha_arch_monitor_unlock(pool->monitor);
+	}
+
+	result = pool_job->job;
+	free(pool_job);
+
+	return result;
+}
@@ -0,0 +1,91 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_WORKER_POOL_H
+#define LHASA_WORKER_POOL_H
+
+typedef struct _WorkerPool WorkerPool;
+
+/**
+ * Function invoked by a worker thread to process a job.
+ *
+ * @param job          Pointer to the job passed to
+ *                     @ref worker_pool_submit.
+ */
+
+typedef void (*WorkerPoolFunc)(void *job);
+
+/**
+ * Create a pool of worker threads.
+ *
+ * If threads are not supported, a pool is still created, but jobs are
+ * processed immediately when they are submitted.
+ *
+ * @param num_threads  Number of worker threads to create.
+ * @param func         Function to invoke to process each job.
+ * @return             Pointer to the new pool, or NULL for failure.
+ */
+
+WorkerPool *worker_pool_new(unsigned int num_threads, WorkerPoolFunc func);
+
+/**
+ * Shut down a pool of worker threads. Any jobs that are still
+ * outstanding are processed first.
+ *
+ * @param pool         The worker pool.
+ */
+
+void worker_pool_free(WorkerPool *pool);
+
+/**
+ * Submit a job to be processed by a worker thread.
+ *
+ * @param pool         The worker pool.
+ * @param job          Pointer to the job to process.
+ * @return             Non-zero for success, zero for failure.
+ */
+
+int worker_pool_submit(WorkerPool *pool, void *job);
+
+/**
+ * Get the number of jobs that have been submitted, but not yet
+ * collected with @ref worker_pool_wait.
+ *
+ * @param pool         The worker pool.
+ * @return             Number of outstanding jobs.
+ */
+
+unsigned int worker_pool_pending(WorkerPool *pool);
+
+/**
+ * Collect the oldest outstanding job. Jobs are always collected in the
+ * order in which they were submitted, regardless of the order in which
+ * they complete.
+ *
+ * @param pool         The worker pool.
+ * @param block        If non-zero, wait for the job to complete.
+ * @return             The oldest job, or NULL if there are no outstanding
+ *                     jobs, or if block is zero and the oldest job has
+ *                     not yet completed.
+ */
+
+void *worker_pool_wait(WorkerPool *pool, int block);
+
+#endif /* #ifndef LHASA_WORKER_POOL_H */
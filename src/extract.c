@@ -24,6 +24,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <ctype.h>
 
 #include "lib/lha_arch.h"
+#include "lib/worker_pool.h"
 
 #include "extract.h"
 #include "safe.h"
@@ -40,6 +41,55 @@ typedef struct {
 	char *operation;
 } ProgressCallbackData;
 
+// A file to be tested or extracted by a worker thread. Each job opens
+// its own reader on a memory-mapped view of the archive, positioned at
+// the file's header, so that jobs do not share any decoder state.
+
+typedef struct _DecodeJob DecodeJob;
+
+struct _DecodeJob {
+	// Archive contents, and offset of the file header within it.
+
+	const uint8_t *archive_data;
+	size_t archive_len;
+	uint64_t offset;
+
+	// Path of the file being processed. If extract is non-zero,
+	// the file is extracted to this path (as a sparse file, if
+	// sparse is non-zero); otherwise it is only tested.
+
+	char *filename;
+	int extract, sparse;
+
+	// Result, and the progress callbacks that were invoked during
+	// decoding. The callbacks are replayed by the main thread once
+	// the job is collected, so that the output is the same as when
+	// files are processed one at a time.
+
+	int success;
+	int progress_invoked;
+	unsigned int last_block, num_blocks;
+
+	DecodeJob *next;
+};
+
+// State for testing or extracting files in parallel.
+
+typedef struct {
+	WorkerPool *pool;
+	LHAOptions *options;
+	uint8_t *archive_data;
+	size_t archive_len;
+
+	// Jobs that have been submitted but not yet collected, in the
+	// order in which they were submitted.
+
+	DecodeJob *jobs, *jobs_tail;
+	unsigned int max_jobs;
+
+	int result;
+} ParallelState;
+
 // Given a file header structure, get the path to extract to.
 // Returns a newly allocated string that must be free()d.
 
@@ -501,12 +551,305 @@ static int extract_archived_file(LHAReader *reader,
 	return success;
 }
 
+// Callback function invoked by a worker thread during decompression
+// progress. The output is not printed yet; just record which callbacks
+// were made, so that they can be replayed when the job is collected.
+
+static void record_progress_callback(unsigned int block,
+                                     unsigned int num_blocks,
+                                     void *data)
+{
+	DecodeJob *job = data;
+
+	job->progress_invoked = 1;
+	job->last_block = block;
+	job->num_blocks = num_blocks;
+}
+
+// Test or extract a file. Invoked from a worker thread.
+
+static void decode_job(void *data)
+{
+	DecodeJob *job = data;
+	LHAInputStream *stream;
+	LHAReader *reader;
+
+	job->success = 0;
+
+	stream = lha_input_stream_from_memory(
+	    job->archive_data + job->offset,
+	    job->archive_len - (size_t) job->offset);
+
+	if (stream == NULL) {
+		return;
+	}
+
+	reader = lha_reader_new(stream);
+
+	if (reader != NULL) {
+		lha_reader_set_sparse(reader, job->sparse);
+
+		if (lha_reader_next_file(reader) != NULL) {
+			if (job->extract) {
+				job->success = lha_reader_extract(
+				    reader, job->filename,
+				    record_progress_callback, job);
+			} else {
+				job->success = lha_reader_check(
+				    reader, record_progress_callback, job);
+			}
+		}
+
+		lha_reader_free(reader);
+	}
+
+	lha_input_stream_free(stream);
+}
+
+// Collect a completed job: replay its progress output and print the
+// result, as if the file had just been processed by the main thread.
+
+static void finish_job(ParallelState *state, DecodeJob *job)
+{
+	ProgressCallbackData progress;
+	unsigned int block;
+
+	progress.invoked = 0;
+	progress.operation = job->extract ? "Melting  :" : "Testing  :";
+	progress.options = state->options;
+	progress.filename = job->filename;
+	progress.header = NULL;
+
+	if (job->progress_invoked) {
+		for (block = 0; block <= job->last_block; ++block) {
+			progress_callback(block, job->num_blocks, &progress);
+		}
+	}
+
+	if (progress.invoked && state->options->quiet < 2) {
+		if (job->success) {
+			print_filename(job->filename,
+			               job->extract ? "Melted" : "Tested");
+		} else {
+			print_filename(job->filename,
+			               job->extract ? "Failure" : "CRC error");
+		}
+		printf("\n");
+
+		fflush(stdout);
+	}
+
+	if (!job->success) {
+		state->result = 0;
+	}
+
+	free(job->filename);
+	free(job);
+}
+
+// Collect the oldest outstanding job, if it has completed. If block is
+// non-zero, wait for it to complete. Returns zero if there are no jobs
+// to collect.
+
+static int collect_job(ParallelState *state, int block)
+{
+	DecodeJob *job;
+
+	job = worker_pool_wait(state->pool, block);
+
+	if (job == NULL) {
+		return 0;
+	}
+
+	state->jobs = job->next;
+
+	if (state->jobs == NULL) {
+		state->jobs_tail = NULL;
+	}
+
+	finish_job(state, job);
+
+	return 1;
+}
+
+// Collect jobs that have completed, in the order that they were
+// submitted. If wait_all is non-zero, wait for all outstanding jobs.
+
+static void collect_jobs(ParallelState *state, int wait_all)
+{
+	while (collect_job(state, wait_all)) {
+		// Keep going.
+	}
+}
+
+// Check if a job is outstanding for the specified file.
+
+static int file_in_progress(ParallelState *state, char *filename)
+{
+	DecodeJob *job;
+
+	for (job = state->jobs; job != NULL; job = job->next) {
+		if (!strcmp(job->filename, filename)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Submit a job to test or extract the current file of the specified
+// reader. Ownership of the filename string passes to the job.
+
+static void submit_job(ParallelState *state, LHAReader *reader,
+                       char *filename, int extract)
+{
+	DecodeJob *job;
+
+	job = malloc(sizeof(DecodeJob));
+
+	if (job == NULL) {
+		exit(-1);
+	}
+
+	job->archive_data = state->archive_data;
+	job->archive_len = state->archive_len;
+	job->offset = lha_reader_curr_file_offset(reader);
+	job->filename = filename;
+	job->extract = extract;
+	job->sparse = state->options->sparse;
+	job->progress_invoked = 0;
+	job->next = NULL;
+
+	// The header was read by the main reader from the same file, so
+	// this should never happen.
+
+	if (job->offset >= state->archive_len) {
+		job->success = 0;
+		finish_job(state, job);
+		return;
+	}
+
+	if (state->jobs_tail != NULL) {
+		state->jobs_tail->next = job;
+	} else {
+		state->jobs = job;
+	}
+	state->jobs_tail = job;
+
+	if (!worker_pool_submit(state->pool, job)) {
+		exit(-1);
+	}
+
+	// Print results for any jobs that have completed. Limit the
+	// number of outstanding jobs, so that a slow file does not hold
+	// up an unbounded amount of output behind it.
+
+	collect_jobs(state, 0);
+
+	while (worker_pool_pending(state->pool) >= state->max_jobs) {
+		collect_job(state, 1);
+	}
+}
+
+// Set up to process files from the specified archive in parallel.
+// Returns zero if files should be processed one at a time instead.
+
+static int init_parallel(ParallelState *state, LHAOptions *options,
+                         char *filename)
+{
+	if (options->jobs <= 1 || options->dry_run
+	 || !strcmp(filename, "-")) {
+		return 0;
+	}
+
+	// Each job reads from a view of the mapped archive file.
+	// If the file cannot be mapped, fall back to doing one file at
+	// a time.
+
+	state->archive_data = lha_arch_map_file(filename,
+	                                        &state->archive_len);
+
+	if (state->archive_data == NULL) {
+		return 0;
+	}
+
+	state->pool = worker_pool_new(options->jobs, decode_job);
+
+	if (state->pool == NULL) {
+		lha_arch_unmap_file(state->archive_data, state->archive_len);
+		return 0;
+	}
+
+	state->options = options;
+	state->jobs = NULL;
+	state->jobs_tail = NULL;
+	state->max_jobs = options->jobs * 4;
+	state->result = 1;
+
+	return 1;
+}
+
+// Wait for all outstanding jobs, and free the parallel state.
+// Returns zero if any job failed.
+
+static int free_parallel(ParallelState *state)
+{
+	collect_jobs(state, 1);
+	worker_pool_free(state->pool);
+	lha_arch_unmap_file(state->archive_data, state->archive_len);
+
+	return state->result;
+}
+
+// lha -t command, testing files in parallel.
+
+static int test_file_crc_parallel(LHAFilter *filter, ParallelState *state)
+{
+	LHAFileHeader *header;
+
+	for (;;) {
+		header = lha_filter_next_file(filter);
+
+		if (header == NULL) {
+			break;
+		}
+
+		// Directories do not need to be tested. Anything that
+		// is not a real file in the archive is handled by the
+		// main thread, once all outstanding jobs are done.
+
+		if (!strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR)) {
+			continue;
+		}
+
+		if (lha_reader_current_is_fake(filter->reader)) {
+			collect_jobs(state, 1);
+
+			if (!test_archived_file_crc(filter->reader, header,
+			                            state->options)) {
+				state->result = 0;
+			}
+			continue;
+		}
+
+		submit_job(state, filter->reader,
+		           file_full_path(header, state->options), 0);
+	}
+
+	return free_parallel(state);
+}
+
 // lha -t command.
 
-int test_file_crc(LHAFilter *filter, LHAOptions *options)
+int test_file_crc(LHAFilter *filter, LHAOptions *options, char *filename)
 {
+	ParallelState parallel;
 	int result;
 
+	if (init_parallel(&parallel, options, filename)) {
+		return test_file_crc_parallel(filter, &parallel);
+	}
+
 	result = 1;
 
 	for (;;) {
@@ -575,16 +918,99 @@ static int extract_archive_dry_run(LHAFilter *filter, LHAOptions *options)
 	return result;
 }
 
+// lha -e / -x, extracting files in parallel.
+
+static int extract_archive_parallel(LHAFilter *filter, ParallelState *state)
+{
+	LHAFileHeader *header;
+	LHAOptions *options;
+	char *filename;
+
+	options = state->options;
+
+	for (;;) {
+		header = lha_filter_next_file(filter);
+
+		if (header == NULL) {
+			break;
+		}
+
+		// Only regular files are extracted by worker threads.
+		// Directories, symlinks and the directory metadata that
+		// the reader applies at the end of a directory must see
+		// the effects of everything before them in the archive,
+		// so wait for all outstanding jobs first.
+
+		if (lha_reader_current_is_fake(filter->reader)
+		 || header->symlink_target != NULL
+		 || !strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR)) {
+			collect_jobs(state, 1);
+
+			if (!extract_archived_file(filter->reader, header,
+			                           options)) {
+				state->result = 0;
+			}
+			continue;
+		}
+
+		filename = file_full_path(header, options);
+
+		// An archive can contain the same file more than once;
+		// the later copy must be the one that is left behind.
+
+		if (file_in_progress(state, filename)) {
+			collect_jobs(state, 1);
+		}
+
+		// If a file already exists with this name, confirm
+		// overwrite. The user may be prompted, so the output
+		// for all earlier files must be printed first.
+
+		if (file_exists(filename)
+		 && options->overwrite_policy != LHA_OVERWRITE_ALL) {
+			collect_jobs(state, 1);
+
+			if (!confirm_file_overwrite(filename, options)) {
+				if (options->overwrite_policy
+				    == LHA_OVERWRITE_SKIP) {
+					safe_printf("%s : Skipped...",
+					            filename);
+					printf("\n");
+				}
+				free(filename);
+				continue;
+			}
+		}
+
+		// Create parent directories for file:
+
+		if (!make_parent_directories(filename)) {
+			free(filename);
+			state->result = 0;
+			continue;
+		}
+
+		submit_job(state, filter->reader, filename, 1);
+	}
+
+	return free_parallel(state);
+}
+
 // lha -e / -x
 
-int extract_archive(LHAFilter *filter, LHAOptions *options)
+int extract_archive(LHAFilter *filter, LHAOptions *options, char *filename)
 {
+	ParallelState parallel;
 	int result;
 
 	if (options->dry_run) {
 		return extract_archive_dry_run(filter, options);
 	}
 
+	if (init_parallel(&parallel, options, filename)) {
+		return extract_archive_parallel(filter, &parallel);
+	}
+
 	result = 1;
 
 	for (;;) {
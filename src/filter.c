@@ -69,7 +69,7 @@ static int match_glob(char *glob, char *str)
 	return *glob == '\0';
 }
 
-static int matches_filter(LHAFilter *filter, LHAFileHeader *header)
+int lha_filter_matches(LHAFilter *filter, LHAFileHeader *header)
 {
 	size_t path_len;
 	char *path;
@@ -130,7 +130,7 @@ LHAFileHeader *lha_filter_next_file(LHAFilter *filter)
 
 	do {
 		header = lha_reader_next_file(filter->reader);
-	} while (header != NULL && !matches_filter(filter, header));
+	} while (header != NULL && !lha_filter_matches(filter, header));
 
 	return header;
 }
@@ -46,6 +46,16 @@ struct _LHAFilter {
 void lha_filter_init(LHAFilter *filter, LHAReader *reader,
                      char **filters, unsigned int num_filters);
 
+/**
+ * Check whether a file header matches the filters.
+ *
+ * @param filter       The filter structure.
+ * @param header       The file header to check.
+ * @return             Non-zero if the file matches the filters.
+ */
+
+int lha_filter_matches(LHAFilter *filter, LHAFileHeader *header);
+
 /**
  * Read the next file from the input stream.
  *
@@ -26,10 +26,16 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include <sys/stat.h>
 
+#include "lha_archive_index.h"
 #include "lha_reader.h"
 #include "list.h"
 #include "safe.h"
 
+// Extension added to the archive filename to give the name of the index
+// file that is saved with the 'k' option.
+
+#define INDEX_FILE_EXTENSION ".idx"
+
 typedef struct {
 	unsigned int num_files;
 	unsigned int compressed_length;
@@ -595,13 +601,133 @@ static unsigned int read_file_timestamp(FILE *fstream)
 	return (unsigned int) data.st_mtime;
 }
 
+// Load the index file for the specified archive, if there is one and
+// it is up to date. If not, and the 'k' option was given, save a new
+// index file. Returns NULL if the archive should be read as normal.
+
+static LHAArchiveIndex *open_index(char *filename, LHAOptions *options)
+{
+	LHAArchiveIndex *index;
+	LHAInputStream *stream;
+	char *index_filename;
+	int saved;
+
+	if (!strcmp(filename, "-")) {
+		return NULL;
+	}
+
+	index_filename = malloc(strlen(filename)
+	                        + strlen(INDEX_FILE_EXTENSION) + 1);
+
+	if (index_filename == NULL) {
+		return NULL;
+	}
+
+	sprintf(index_filename, "%s%s", filename, INDEX_FILE_EXTENSION);
+
+	index = lha_archive_index_load(NULL, filename, index_filename);
+
+	// Index the archive and save a new index file. The new file is
+	// then loaded like any other, so it is only used if it was
+	// written successfully.
+
+	if (index == NULL && options->keep_index) {
+		stream = lha_input_stream_from(filename);
+		saved = 0;
+
+		if (stream != NULL) {
+			index = lha_archive_index_new(stream);
+
+			if (index != NULL) {
+				saved = lha_archive_index_save(index, filename,
+				                               index_filename);
+				lha_archive_index_free(index);
+			}
+
+			lha_input_stream_free(stream);
+		}
+
+		if (saved) {
+			index = lha_archive_index_load(NULL, filename,
+			                               index_filename);
+		} else {
+			index = NULL;
+		}
+	}
+
+	free(index_filename);
+
+	return index;
+}
+
+// Fill in a file header structure from an index entry, with the fields
+// needed to list the file. The path is included in the filename, which
+// has the same effect when listing and filtering.
+
+static void header_from_index(LHAFileHeader *header,
+                              const LHAArchiveIndexEntry *entry)
+{
+	memset(header, 0, sizeof(LHAFileHeader));
+
+	header->filename = entry->name;
+	header->symlink_target = entry->symlink_target;
+	memcpy(header->compress_method, entry->compress_method,
+	       sizeof(header->compress_method));
+	header->compressed_length = entry->compressed_length;
+	header->length = entry->length;
+	header->header_level = entry->header_level;
+	header->os_type = entry->os_type;
+	header->crc = entry->crc;
+	header->timestamp = entry->timestamp;
+	header->extra_flags = entry->extra_flags;
+	header->unix_perms = entry->unix_perms;
+	header->unix_uid = entry->unix_uid;
+	header->unix_gid = entry->unix_gid;
+	header->os9_perms = entry->os9_perms;
+}
+
+// Get the next file to list, from the index if there is one, or
+// otherwise from the archive itself.
+
+static LHAFileHeader *next_file(LHAFilter *filter, LHAArchiveIndex *index,
+                                unsigned int *n, LHAFileHeader *buf)
+{
+	const LHAArchiveIndexEntry *entry;
+
+	if (index == NULL) {
+		return lha_filter_next_file(filter);
+	}
+
+	for (;;) {
+		entry = lha_archive_index_entry(index, *n);
+
+		if (entry == NULL) {
+			return NULL;
+		}
+
+		++*n;
+		header_from_index(buf, entry);
+
+		if (lha_filter_matches(filter, buf)) {
+			return buf;
+		}
+	}
+}
+
 // List contents of file, using the specified columns.
 // Different columns are provided for basic and verbose modes.
 
 static void list_file_contents(LHAFilter *filter, FILE *fstream,
-                               LHAOptions *options, ListColumn **columns)
+                               LHAOptions *options, ListColumn **columns,
+                               char *filename)
 {
 	FileStatistics stats;
+	LHAArchiveIndex *index;
+	LHAFileHeader index_header;
+	unsigned int n;
+
+	index = open_index(filename, options);
+	n = 0;
 
 	if (options->quiet < 2) {
 		print_list_headings(columns);
@@ -616,7 +742,7 @@ static void list_file_contents(LHAFilter *filter, FILE *fstream,
 	for (;;) {
 		LHAFileHeader *header;
 
-		header = lha_filter_next_file(filter);
+		header = next_file(filter, index, &n, &index_header);
 
 		if (header == NULL) {
 			break;
@@ -633,6 +759,10 @@ static void list_file_contents(LHAFilter *filter, FILE *fstream,
 		print_list_separators(columns);
 		print_footers(columns, &stats);
 	}
+
+	if (index != NULL) {
+		lha_archive_index_free(index);
+	}
 }
 
 // Used for lha -l:
@@ -662,7 +792,8 @@ static ListColumn *normal_column_headers_verbose[] = {
 
 // lha -l command.
 
-void list_file_basic(LHAFilter *filter, LHAOptions *options, FILE *fstream)
+void list_file_basic(LHAFilter *filter, LHAOptions *options, FILE *fstream,
+                     char *filename)
 {
 	ListColumn **headers;
 
@@ -672,7 +803,7 @@ void list_file_basic(LHAFilter *filter, LHAOptions *options, FILE *fstream)
 		headers = normal_column_headers;
 	}
 
-	list_file_contents(filter, fstream, options, headers);
+	list_file_contents(filter, fstream, options, headers, filename);
 }
 
 // Used for lha -v:
@@ -706,7 +837,8 @@ static ListColumn *verbose_column_headers_verbose[] = {
 
 // lha -v command.
 
-void list_file_verbose(LHAFilter *filter, LHAOptions *options, FILE *fstream)
+void list_file_verbose(LHAFilter *filter, LHAOptions *options, FILE *fstream,
+                       char *filename)
 {
 	ListColumn **headers;
 
@@ -716,5 +848,5 @@ void list_file_verbose(LHAFilter *filter, LHAOptions *options, FILE *fstream)
 		headers = verbose_column_headers;
 	}
 
-	list_file_contents(filter, fstream, options, headers);
+	list_file_contents(filter, fstream, options, headers, filename);
 }
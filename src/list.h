@@ -24,7 +24,9 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "filter.h"
 #include "options.h"
 
-void list_file_basic(LHAFilter *filter, LHAOptions *options, FILE *fstream);
-void list_file_verbose(LHAFilter *filter, LHAOptions *options, FILE *fstream);
+void list_file_basic(LHAFilter *filter, LHAOptions *options, FILE *fstream,
+                     char *filename);
+void list_file_verbose(LHAFilter *filter, LHAOptions *options, FILE *fstream,
+                       char *filename);
 
 #endif /* #ifndef LHASA_LIST_H */
@@ -44,12 +44,18 @@ static void help_page(char *progname)
 	printf(
 	PACKAGE_NAME " v" PACKAGE_VERSION " command line LHA tool  "
 		"- Copyright (C) 2011-2023 Simon Howard\n"
-	"usage: %s [-]{lvtxep[q{num}][finv]}[w=<dir>] archive_file [file...]\n"
+	"usage: %s [-]{lvtxep[q{num}][j{num}][b{num}][finksv]}[w=<dir>] "
+	"archive_file "
+	"[file...]\n"
 	"commands:                          options:\n"
 	" l,v List / Verbose List            f  Force overwrite (no prompt)\n"
 	" t   Test file CRC in archive       i  Ignore directory path\n"
 	" x,e Extract from archive           n  Perform dry run\n"
 	" p   Print to stdout from archive   q{num}  Quiet mode\n"
+	"                                    j{num}  Parallel jobs\n"
+	"                                    b{num}  Pipeline files >= num KB\n"
+	"                                    k  Keep index file for listing\n"
+	"                                    s  Create sparse files\n"
 	"                                    v  Verbose\n"
 	"                                    w=<dir> Specify extract directory\n"
 	, progname);
@@ -81,25 +87,28 @@ static int do_command(ProgramMode mode, char *filename,
 
 	stream = lha_input_stream_from_FILE(fstream);
 	reader = lha_reader_new(stream);
+	lha_reader_set_pipeline(reader, options->pipeline_size);
+	lha_reader_set_sparse(reader, options->sparse);
 	lha_filter_init(&filter, reader, filters, num_filters);
 
 	result = 1;
 
 	switch (mode) {
 		case MODE_LIST:
-			list_file_basic(&filter, options, fstream);
+			list_file_basic(&filter, options, fstream, filename);
 			break;
 
 		case MODE_LIST_VERBOSE:
-			list_file_verbose(&filter, options, fstream);
+			list_file_verbose(&filter, options, fstream,
+			                  filename);
 			break;
 
 		case MODE_CRC_CHECK:
-			result = test_file_crc(&filter, options);
+			result = test_file_crc(&filter, options, filename);
 			break;
 
 		case MODE_EXTRACT:
-			result = extract_archive(&filter, options);
+			result = extract_archive(&filter, options, filename);
 			break;
 
 		case MODE_PRINT:
@@ -126,6 +135,10 @@ static void init_options(LHAOptions *options)
 	options->dry_run = 0;
 	options->extract_path = NULL;
 	options->use_path = 1;
+	options->jobs = 1;
+	options->keep_index = 0;
+	options->pipeline_size = 0;
+	options->sparse = 0;
 }
 
 // Determine the program mode from the first character of the command
@@ -154,6 +167,8 @@ static ProgramMode mode_for_char(char c)
 
 static int parse_options(char *arg, LHAOptions *options)
 {
+	char *end;
+
 	for (; *arg != '\0'; ++arg) {
 		switch (*arg) {
 			// Force overwrite of existing files.
@@ -185,6 +200,50 @@ static int parse_options(char *arg, LHAOptions *options)
 				options->overwrite_policy = LHA_OVERWRITE_ALL;
 				break;
 
+			// Number of files to process in parallel.
+			// If the number is omitted, use one job per CPU.
+			case 'j':
+				if (arg[1] >= '0' && arg[1] <= '9') {
+					options->jobs = (unsigned int)
+					    strtoul(arg + 1, &end, 10);
+					arg = end - 1;
+				} else {
+					options->jobs = lha_arch_num_cpus();
+				}
+
+				if (options->jobs < 1) {
+					options->jobs = 1;
+				}
+				break;
+
+			// Extract large files using a pipeline, with reads
+			// and writes on separate threads. The minimum size
+			// can be specified in KB; the default is 1MB.
+			case 'b':
+				if (arg[1] >= '0' && arg[1] <= '9') {
+					options->pipeline_size = 1024 *
+					    strtoul(arg + 1, &end, 10);
+					arg = end - 1;
+				} else {
+					options->pipeline_size = 1024 * 1024;
+				}
+
+				if (options->pipeline_size < 1) {
+					options->pipeline_size = 1;
+				}
+				break;
+
+			// Create holes in extracted files instead of writing
+			// blocks of zeros.
+			case 's':
+				options->sparse = 1;
+				break;
+
+			// Save an index file when listing.
+			case 'k':
+				options->keep_index = 1;
+				break;
+
 			// Verbose mode.
 			case 'v':
 				options->verbose = 1;
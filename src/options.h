@@ -58,6 +58,24 @@ typedef struct {
 
 	int use_path;
 
+	// Number of files to test or extract in parallel.
+
+	unsigned int jobs;
+
+	// If true, save an index file when listing an archive, so that
+	// it can be listed more quickly next time.
+
+	int keep_index;
+
+	// Minimum compressed size of files to extract using a pipeline,
+	// in bytes, or zero to never use a pipeline.
+
+	size_t pipeline_size;
+
+	// If true, extract files as sparse files.
+
+	int sparse;
+
 } LHAOptions;
 
 #endif /* #ifndef LHASA_OPTIONS_H */
@@ -0,0 +1,458 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Benchmark program that measures decompression and compression
+// throughput.
+//
+// With no arguments, the raw streams in compressed/ are decoded
+// directly through the decoder interface. Otherwise, each argument
+// is an archive file; every file within it is decompressed using
+// the reader interface.
+//
+// With -x, every file in each archive is instead extracted to a
+// temporary file, and the number of system calls made per megabyte
+// of output is shown (on Linux, where /proc/self/io is available).
+//
+// With -c, the contents of each file (or compressed/lh0.bin if none
+// are given) are instead compressed with each of the encoders, at
+// several compression levels, and the compression ratio is also shown.
+//
+// Unlike the tests, this is linked against the optimized build of
+// the library so that the results are meaningful.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "lha_encoder.h"
+#include "lha_reader.h"
+
+// Minimum time to spend benchmarking each file, in seconds.
+
+#define MIN_BENCHMARK_TIME 1.0
+
+// Size of buffer used to read decompressed data.
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+// Temporary file used when benchmarking extraction.
+
+#define EXTRACT_FILENAME "benchmark.tmp"
+
+typedef struct {
+	char *filename;
+	char *algorithm;
+	size_t len;
+} BenchmarkFile;
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len;
+	size_t pos;
+} DecompressState;
+
+static const BenchmarkFile files[] = {
+	{ "compressed/lh0.bin", "-lh0-", 18092 },
+	{ "compressed/lh1.bin", "-lh1-", 18092 },
+	{ "compressed/lh5.bin", "-lh5-", 18092 },
+	{ "compressed/lh6.bin", "-lh6-", 18092 },
+	{ "compressed/lh7.bin", "-lh7-", 18092 },
+	{ "compressed/lzs.bin", "-lzs-", 18092 },
+	{ "compressed/lz5.bin", "-lz5-", 18092 },
+	{ "compressed/pm1.bin", "-pm1-", 25284 },
+	{ "compressed/pm2.bin", "-pm2-", 18176 },
+};
+
+static char *encoders[] = { "-lh5-", "-lh6-", "-lh7-" };
+
+static const int levels[] = {
+	LHA_ENCODER_MIN_LEVEL,
+	LHA_ENCODER_DEFAULT_LEVEL,
+	LHA_ENCODER_MAX_LEVEL,
+};
+
+static uint8_t read_buf[READ_BUFFER_SIZE];
+
+static void read_file_data(char *filename, uint8_t **data, size_t *len)
+{
+	FILE *fstream;
+
+	fstream = fopen(filename, "rb");
+
+	if (fstream == NULL) {
+		fprintf(stderr, "Failed to open '%s'\n", filename);
+		exit(-1);
+	}
+
+	fseek(fstream, 0, SEEK_END);
+	*len = (size_t) ftell(fstream);
+	fseek(fstream, 0, SEEK_SET);
+
+	*data = malloc(*len);
+	assert(*data != NULL);
+
+	assert(fread(*data, 1, *len, fstream) == *len);
+
+	fclose(fstream);
+}
+
+// Callback function to read data from memory, used to read compressed
+// data for decoders and uncompressed data for encoders.
+
+static size_t read_compressed_data(void *buf, size_t buf_len, void *user)
+{
+	DecompressState *state = user;
+	size_t result;
+
+	result = state->data_len - state->pos;
+
+	if (buf_len < result) {
+		result = buf_len;
+	}
+
+	memcpy(buf, state->data + state->pos, result);
+	state->pos += result;
+
+	return result;
+}
+
+// Decode a raw compressed stream once, returning the number of bytes
+// of output.
+
+static size_t decode_raw(const BenchmarkFile *file,
+                         uint8_t *data, size_t data_len)
+{
+	DecompressState state;
+	LHADecoderType *dtype;
+	LHADecoder *decoder;
+	size_t total, n;
+
+	state.data = data;
+	state.data_len = data_len;
+	state.pos = 0;
+
+	dtype = lha_decoder_for_name(file->algorithm);
+	assert(dtype != NULL);
+
+	decoder = lha_decoder_new(dtype, read_compressed_data, &state,
+	                          file->len);
+	assert(decoder != NULL);
+
+	total = 0;
+
+	do {
+		n = lha_decoder_read(decoder, read_buf, sizeof(read_buf));
+		total += n;
+	} while (n > 0);
+
+	lha_decoder_free(decoder);
+
+	return total;
+}
+
+// Compress a block of data once, returning the number of bytes of
+// input. The length of the compressed data is also returned.
+
+static size_t encode_raw(char *algorithm, int level,
+                         uint8_t *data, size_t data_len,
+                         size_t *compressed_len)
+{
+	DecompressState state;
+	LHAEncoderType *etype;
+	LHAEncoder *encoder;
+	size_t n;
+
+	state.data = data;
+	state.data_len = data_len;
+	state.pos = 0;
+
+	etype = lha_encoder_for_name(algorithm);
+	assert(etype != NULL);
+
+	encoder = lha_encoder_new(etype, level, read_compressed_data, &state);
+	assert(encoder != NULL);
+
+	*compressed_len = 0;
+
+	do {
+		n = lha_encoder_read(encoder, read_buf, sizeof(read_buf));
+		*compressed_len += n;
+	} while (n > 0);
+
+	lha_encoder_free(encoder);
+
+	return data_len;
+}
+
+// Decode every file within an archive once, returning the total
+// number of bytes of output.
+
+static size_t decode_archive(char *filename)
+{
+	LHAInputStream *stream;
+	LHAReader *reader;
+	LHAFileHeader *header;
+	size_t total, n;
+
+	stream = lha_input_stream_from(filename);
+
+	if (stream == NULL) {
+		fprintf(stderr, "Failed to open '%s'\n", filename);
+		exit(-1);
+	}
+
+	reader = lha_reader_new(stream);
+	total = 0;
+
+	for (;;) {
+		header = lha_reader_next_file(reader);
+
+		if (header == NULL) {
+			break;
+		}
+
+		if (!strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR)) {
+			continue;
+		}
+
+		do {
+			n = lha_reader_read(reader, read_buf,
+			                    sizeof(read_buf));
+			total += n;
+		} while (n > 0);
+	}
+
+	lha_reader_free(reader);
+	lha_input_stream_free(stream);
+
+	return total;
+}
+
+// Extract every file within an archive once, returning the total
+// number of bytes of output.
+
+static size_t extract_archive(char *filename)
+{
+	LHAInputStream *stream;
+	LHAReader *reader;
+	LHAFileHeader *header;
+	size_t total;
+
+	stream = lha_input_stream_from(filename);
+
+	if (stream == NULL) {
+		fprintf(stderr, "Failed to open '%s'\n", filename);
+		exit(-1);
+	}
+
+	reader = lha_reader_new(stream);
+	total = 0;
+
+	for (;;) {
+		header = lha_reader_next_file(reader);
+
+		if (header == NULL) {
+			break;
+		}
+
+		if (!strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR)
+		 || header->symlink_target != NULL) {
+			continue;
+		}
+
+		if (lha_reader_extract(reader, EXTRACT_FILENAME, NULL, NULL)) {
+			total += header->length;
+		}
+	}
+
+	remove(EXTRACT_FILENAME);
+
+	lha_reader_free(reader);
+	lha_input_stream_free(stream);
+
+	return total;
+}
+
+// Read the number of read and write system calls made so far by this
+// process. Returns zero if the counts are not available.
+
+static int read_syscall_counts(unsigned long *reads, unsigned long *writes)
+{
+	FILE *fstream;
+	char line[64];
+	int found;
+
+	fstream = fopen("/proc/self/io", "r");
+
+	if (fstream == NULL) {
+		return 0;
+	}
+
+	found = 0;
+
+	while (fgets(line, sizeof(line), fstream) != NULL) {
+		found += sscanf(line, "syscr: %lu", reads);
+		found += sscanf(line, "syscw: %lu", writes);
+	}
+
+	fclose(fstream);
+
+	return found == 2;
+}
+
+static void print_result(char *name, char *algorithm,
+                         size_t total, clock_t elapsed)
+{
+	double seconds;
+
+	seconds = (double) elapsed / CLOCKS_PER_SEC;
+
+	printf("%-32s %-6s %9.2f MB/s\n", name, algorithm,
+	       (double) total / seconds / (1024.0 * 1024.0));
+}
+
+static void benchmark_raw(const BenchmarkFile *file)
+{
+	uint8_t *data;
+	size_t data_len, total;
+	clock_t start, elapsed;
+
+	read_file_data(file->filename, &data, &data_len);
+
+	total = 0;
+	start = clock();
+
+	do {
+		total += decode_raw(file, data, data_len);
+		elapsed = clock() - start;
+	} while (elapsed < MIN_BENCHMARK_TIME * CLOCKS_PER_SEC);
+
+	print_result(file->filename, file->algorithm, total, elapsed);
+
+	free(data);
+}
+
+static void benchmark_compress(char *filename)
+{
+	uint8_t *data;
+	size_t data_len, total, compressed_len;
+	clock_t start, elapsed;
+	unsigned int i, j;
+
+	read_file_data(filename, &data, &data_len);
+
+	for (i = 0; i < sizeof(encoders) / sizeof(*encoders); ++i) {
+		for (j = 0; j < sizeof(levels) / sizeof(*levels); ++j) {
+			total = 0;
+			start = clock();
+
+			do {
+				total += encode_raw(encoders[i], levels[j],
+				                    data, data_len,
+				                    &compressed_len);
+				elapsed = clock() - start;
+			} while (elapsed < MIN_BENCHMARK_TIME * CLOCKS_PER_SEC);
+
+			printf("%-32s %-6s %d %9.2f MB/s %6.1f%%\n",
+			       filename, encoders[i], levels[j],
+			       (double) total * CLOCKS_PER_SEC
+			         / (double) elapsed / (1024.0 * 1024.0),
+			       data_len > 0 ? (double) compressed_len * 100.0
+			                        / (double) data_len : 0.0);
+		}
+	}
+
+	free(data);
+}
+
+static void benchmark_archive(char *filename)
+{
+	size_t total;
+	clock_t start, elapsed;
+
+	total = 0;
+	start = clock();
+
+	do {
+		total += decode_archive(filename);
+		elapsed = clock() - start;
+	} while (elapsed < MIN_BENCHMARK_TIME * CLOCKS_PER_SEC);
+
+	print_result(filename, "", total, elapsed);
+}
+
+static void benchmark_extract(char *filename)
+{
+	unsigned long reads_before, writes_before, reads, writes;
+	size_t total;
+	clock_t start, elapsed;
+	int have_counts;
+
+	have_counts = read_syscall_counts(&reads_before, &writes_before);
+
+	total = 0;
+	start = clock();
+
+	do {
+		total += extract_archive(filename);
+		elapsed = clock() - start;
+	} while (elapsed < MIN_BENCHMARK_TIME * CLOCKS_PER_SEC);
+
+	print_result(filename, "", total, elapsed);
+
+	if (have_counts && total > 0
+	 && read_syscall_counts(&reads, &writes)) {
+		printf("%-32s %-6s %9.1f reads/MB %9.1f writes/MB\n", "", "",
+		       (double) (reads - reads_before) * 1024.0 * 1024.0
+		         / (double) total,
+		       (double) (writes - writes_before) * 1024.0 * 1024.0
+		         / (double) total);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+
+	if (argc == 2 && !strcmp(argv[1], "-c")) {
+		benchmark_compress("compressed/lh0.bin");
+	} else if (argc > 2 && !strcmp(argv[1], "-c")) {
+		for (i = 2; i < (unsigned int) argc; ++i) {
+			benchmark_compress(argv[i]);
+		}
+	} else if (argc > 2 && !strcmp(argv[1], "-x")) {
+		for (i = 2; i < (unsigned int) argc; ++i) {
+			benchmark_extract(argv[i]);
+		}
+	} else if (argc < 2) {
+		for (i = 0; i < sizeof(files) / sizeof(*files); ++i) {
+			benchmark_raw(&files[i]);
+		}
+	} else {
+		for (i = 1; i < (unsigned int) argc; ++i) {
+			benchmark_archive(argv[i]);
+		}
+	}
+
+	return 0;
+}
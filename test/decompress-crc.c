@@ -21,6 +21,9 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // Simple program that reads an archive, decompresses the first file
 // it finds and prints the CRC and length of the decompressed data.
 // These can then be compared against known good values.
+//
+// With -a, the file is decompressed in a single call with
+// lha_reader_read_all, instead of being read in small chunks.
 
 #include <stdlib.h>
 #include <string.h>
@@ -48,14 +51,41 @@ static void decompress_file(LHAReader *reader)
 	printf("length: %i\n", (unsigned int) total);
 }
 
+static void decompress_file_all(LHAReader *reader)
+{
+	uint8_t *data;
+	size_t len;
+	uint32_t crc;
+
+	data = lha_reader_read_all(reader, NULL, &len);
+
+	if (data == NULL) {
+		printf("failed to decompress\n");
+		return;
+	}
+
+	crc = 0;
+	crc32_buf(&crc, data, len);
+
+	printf("crc: %08x\n", crc);
+	printf("length: %i\n", (unsigned int) len);
+
+	free(data);
+}
+
 int main(int argc, char *argv[])
 {
 	LHAInputStream *stream;
 	LHAReader *reader;
 	LHAFileHeader *header;
+	char *filename;
+	int read_all;
+
+	read_all = argc > 2 && !strcmp(argv[1], "-a");
+	filename = argv[argc - 1];
 
 	if (argc < 2) {
-		printf("Usage: %s <filename>\n", argv[0]);
+		printf("Usage: %s [-a] <filename>\n", argv[0]);
 		exit(-1);
 	}
 
@@ -64,10 +94,10 @@ int main(int argc, char *argv[])
 
 	lha_arch_set_binary(stdout);
 
-	stream = lha_input_stream_from(argv[1]);
+	stream = lha_input_stream_from(filename);
 
 	if (stream == NULL) {
-		fprintf(stderr, "Failed to open '%s'\n", argv[1]);
+		fprintf(stderr, "Failed to open '%s'\n", filename);
 		exit(-1);
 	}
 
@@ -84,7 +114,12 @@ int main(int argc, char *argv[])
 			continue;
 		}
 
-		decompress_file(reader);
+		if (read_all) {
+			decompress_file_all(reader);
+		} else {
+			decompress_file(reader);
+		}
+
 		break;
 	}
 
@@ -0,0 +1,253 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lha_archive_index.h"
+
+#define INDEX_FILENAME "test-archive-index.idx"
+
+// Check that every entry in the index can be found by name.
+
+static void check_find(LHAArchiveIndex *index)
+{
+	const LHAArchiveIndexEntry *entry, *found;
+	unsigned int i, n;
+
+	n = lha_archive_index_num_entries(index);
+	assert(n > 0);
+
+	for (i = 0; i < n; ++i) {
+		entry = lha_archive_index_entry(index, i);
+		assert(entry != NULL);
+		assert(entry->data_offset > entry->header_offset);
+
+		found = lha_archive_index_find(index, entry->name);
+		assert(found != NULL);
+		assert(!strcmp(found->name, entry->name));
+	}
+
+	assert(lha_archive_index_entry(index, n) == NULL);
+	assert(lha_archive_index_find(index, "no-such-file") == NULL);
+}
+
+// Open each file in the index, last file first, and check that the
+// expected file is read.
+
+static void check_open_members(LHAArchiveIndex *index)
+{
+	const LHAArchiveIndexEntry *entry;
+	LHAFileHeader *header;
+	LHAReader *reader;
+	unsigned int i;
+
+	for (i = lha_archive_index_num_entries(index); i > 0; --i) {
+		entry = lha_archive_index_entry(index, i - 1);
+
+		// Skip over earlier files with the same name.
+
+		if (lha_archive_index_find(index, entry->name) != entry) {
+			continue;
+		}
+
+		reader = lha_reader_open_member(index, entry->name);
+		assert(reader != NULL);
+
+		header = lha_reader_next_file(reader);
+		assert(header != NULL);
+		assert(header->crc == entry->crc);
+		assert(header->length == entry->length);
+		assert(!strcmp(header->compress_method,
+		               entry->compress_method));
+		assert(lha_reader_curr_file_offset(reader)
+		       == entry->header_offset);
+
+		if (strcmp(header->compress_method,
+		           LHA_COMPRESS_TYPE_DIR) != 0) {
+			assert(lha_reader_check(reader, NULL, NULL));
+		}
+
+		lha_reader_free(reader);
+	}
+
+	assert(lha_reader_open_member(index, "no-such-file") == NULL);
+}
+
+// Check that the index matches the files read by a sequential scan.
+
+static void check_sequential(LHAArchiveIndex *index, char *filename)
+{
+	const LHAArchiveIndexEntry *entry;
+	LHAInputStream *stream;
+	LHAReader *reader;
+	LHAFileHeader *header;
+	unsigned int i;
+
+	stream = lha_input_stream_from(filename);
+	assert(stream != NULL);
+	reader = lha_reader_new(stream);
+	assert(reader != NULL);
+	lha_reader_set_dir_policy(reader, LHA_READER_DIR_PLAIN);
+
+	for (i = 0;; ++i) {
+		header = lha_reader_next_file(reader);
+
+		if (header == NULL) {
+			break;
+		}
+
+		entry = lha_archive_index_entry(index, i);
+		assert(entry != NULL);
+		assert(entry->header_offset
+		       == lha_reader_curr_file_offset(reader));
+		assert(entry->compressed_length == header->compressed_length);
+	}
+
+	assert(i == lha_archive_index_num_entries(index));
+
+	lha_reader_free(reader);
+	lha_input_stream_free(stream);
+}
+
+// Check that two indexes contain the same entries.
+
+static void check_same(LHAArchiveIndex *index1, LHAArchiveIndex *index2)
+{
+	const LHAArchiveIndexEntry *entry1, *entry2;
+	unsigned int i;
+
+	assert(lha_archive_index_num_entries(index1)
+	       == lha_archive_index_num_entries(index2));
+
+	for (i = 0; i < lha_archive_index_num_entries(index1); ++i) {
+		entry1 = lha_archive_index_entry(index1, i);
+		entry2 = lha_archive_index_entry(index2, i);
+
+		assert(!strcmp(entry1->name, entry2->name));
+		assert(entry1->header_offset == entry2->header_offset);
+		assert(entry1->data_offset == entry2->data_offset);
+		assert(entry1->compressed_length
+		       == entry2->compressed_length);
+		assert(entry1->length == entry2->length);
+		assert(!strcmp(entry1->compress_method,
+		               entry2->compress_method));
+		assert(entry1->crc == entry2->crc);
+		assert(entry1->timestamp == entry2->timestamp);
+		assert(entry1->header_level == entry2->header_level);
+		assert(entry1->os_type == entry2->os_type);
+		assert(entry1->extra_flags == entry2->extra_flags);
+		assert(entry1->unix_perms == entry2->unix_perms);
+		assert(entry1->unix_uid == entry2->unix_uid);
+		assert(entry1->unix_gid == entry2->unix_gid);
+		assert(entry1->os9_perms == entry2->os9_perms);
+
+		if (entry1->symlink_target == NULL) {
+			assert(entry2->symlink_target == NULL);
+		} else {
+			assert(!strcmp(entry1->symlink_target,
+			               entry2->symlink_target));
+		}
+	}
+}
+
+// Save an index to an index file, and check that it can be loaded
+// again, but only for the same archive.
+
+static void check_save_load(LHAArchiveIndex *index, char *filename)
+{
+	LHAArchiveIndex *loaded;
+	LHAInputStream *stream;
+
+	assert(lha_archive_index_save(index, filename, INDEX_FILENAME));
+
+	stream = lha_input_stream_from(filename);
+	assert(stream != NULL);
+	loaded = lha_archive_index_load(stream, filename, INDEX_FILENAME);
+	assert(loaded != NULL);
+
+	check_same(index, loaded);
+	check_find(loaded);
+	check_open_members(loaded);
+
+	lha_archive_index_free(loaded);
+	lha_input_stream_free(stream);
+
+	// An index file for a different archive is rejected.
+
+	assert(lha_archive_index_load(NULL, "archives/lha213/lh0.lzh",
+	                              INDEX_FILENAME) == NULL);
+
+	remove(INDEX_FILENAME);
+}
+
+static void check_index_for(char *filename)
+{
+	LHAArchiveIndex *index;
+	LHAInputStream *stream;
+
+	// Reading from a file:
+
+	stream = lha_input_stream_from(filename);
+	assert(stream != NULL);
+	index = lha_archive_index_new(stream);
+	assert(index != NULL);
+
+	check_find(index);
+	check_sequential(index, filename);
+	check_open_members(index);
+	check_save_load(index, filename);
+
+	lha_archive_index_free(index);
+	lha_input_stream_free(stream);
+
+	// Reading from a memory-mapped file:
+
+	stream = lha_input_stream_from_mmap(filename);
+	assert(stream != NULL);
+	index = lha_archive_index_new(stream);
+	assert(index != NULL);
+
+	check_open_members(index);
+
+	lha_archive_index_free(index);
+	lha_input_stream_free(stream);
+}
+
+static void test_index(void)
+{
+	check_index_for("archives/lha213/lh5.lzh");
+	check_index_for("archives/lha213/subdir.lzh");
+	check_index_for("archives/lha213/sfx.exe");
+	check_index_for("archives/lha_unix114i/h2_subdir.lzh");
+	check_index_for("archives/lharc113/subdir.lzh");
+	check_index_for("archives/maclha_224/l2_subdir.lzh");
+	check_index_for("archives/pmarc2/comment.pma");
+	check_index_for("archives/larc333/subdir.lzs");
+}
+
+int main(int argc, char *argv[])
+{
+	test_index();
+
+	return 0;
+}
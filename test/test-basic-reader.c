@@ -18,6 +18,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -242,6 +243,95 @@ static void test_decode(void)
 	check_decode_for("archives/pmarc2/pm2.pma");
 }
 
+// Decode the first file in the specified stream, and check that the
+// decompressed data matches the CRC and length in the header.
+
+static void check_stream_decode(LHAInputStream *stream)
+{
+	LHABasicReader *reader;
+	LHAFileHeader *header;
+	LHADecoder *decoder;
+	uint8_t buf[64];
+	size_t count;
+
+	reader = lha_basic_reader_new(stream);
+	assert(reader != NULL);
+
+	header = lha_basic_reader_next_file(reader);
+	assert(header != NULL);
+
+	decoder = lha_basic_reader_decode(reader);
+	assert(decoder != NULL);
+
+	do {
+		count = lha_decoder_read(decoder, buf, sizeof(buf));
+	} while (count > 0);
+
+	assert(lha_decoder_get_length(decoder) == header->length);
+	assert(lha_decoder_get_crc(decoder) == header->crc);
+
+	lha_decoder_free(decoder);
+	lha_basic_reader_free(reader);
+}
+
+// Check that the first file in an archive can be decoded using the
+// memory-based input streams, which pass data to the decoder without
+// copying it.
+
+static void check_memory_decode_for(char *filename)
+{
+	LHAInputStream *stream;
+	FILE *fstream;
+	uint8_t *data;
+	size_t data_len;
+
+	stream = lha_input_stream_from_mmap(filename);
+	assert(stream != NULL);
+	check_stream_decode(stream);
+	lha_input_stream_free(stream);
+
+	// Read the whole file into memory:
+
+	fstream = fopen(filename, "rb");
+	assert(fstream != NULL);
+	fseek(fstream, 0, SEEK_END);
+	data_len = (size_t) ftell(fstream);
+	fseek(fstream, 0, SEEK_SET);
+	data = malloc(data_len);
+	assert(data != NULL);
+	assert(fread(data, 1, data_len, fstream) == data_len);
+	fclose(fstream);
+
+	stream = lha_input_stream_from_memory(data, data_len);
+	assert(stream != NULL);
+	check_stream_decode(stream);
+	lha_input_stream_free(stream);
+
+	free(data);
+}
+
+static void test_memory_decode(void)
+{
+	check_memory_decode_for("archives/larc333/lz4.lzs");
+	check_memory_decode_for("archives/larc333/lz5.lzs");
+	check_memory_decode_for("archives/larc333/sfx.com");
+
+	check_memory_decode_for("archives/lha213/lh0.lzh");
+	check_memory_decode_for("archives/lha213/lh5.lzh");
+	check_memory_decode_for("archives/lha213/sfx.exe");
+
+	check_memory_decode_for("archives/lha_amiga_122/lh1.lzh");
+	check_memory_decode_for("archives/lha_amiga_122/lh4.lzh");
+	check_memory_decode_for("archives/lha_amiga_212/lh6.lzh");
+	check_memory_decode_for("archives/lha_unix114i/h1_lh7.lzh");
+	check_memory_decode_for("archives/lhark04d/lh7.lzh");
+
+	check_memory_decode_for("archives/generated/lzs/lzs.lzs");
+	check_memory_decode_for("archives/pmarc124/pm1.pma");
+	check_memory_decode_for("archives/pmarc2/pm2.pma");
+	check_memory_decode_for("archives/pmarc2/sfx.com");
+}
+
 int main(int argc, char *argv[])
 {
 	test_create_free();
@@ -249,6 +339,7 @@ int main(int argc, char *argv[])
 	test_read_sfx();
 	test_read_compressed();
 	test_decode();
+	test_memory_decode();
 
 	return 0;
 }
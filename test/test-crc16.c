@@ -157,12 +157,58 @@ static void test_crc16_empty(void)
 	assert(crc == 0);
 }
 
+// Calculate CRC a bit at a time, for comparison.
+
+static uint16_t reference_crc16(uint16_t crc, uint8_t *buf, size_t buf_len)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < buf_len; ++i) {
+		crc ^= buf[i];
+
+		for (j = 0; j < 8; ++j) {
+			if (crc & 1) {
+				crc = (crc >> 1) ^ 0xa001;
+			} else {
+				crc >>= 1;
+			}
+		}
+	}
+
+	return crc;
+}
+
+// Test CRC of longer blocks, of varying lengths and alignments, so that
+// the multi-byte implementations are exercised.
+
+static void test_crc16_long(void)
+{
+	uint8_t data[1024];
+	unsigned int i, len, offset;
+	uint16_t crc, expected;
+
+	for (i = 0; i < sizeof(data); ++i) {
+		data[i] = (uint8_t) (i * 37 + (i >> 5));
+	}
+
+	for (len = 0; len < 600; ++len) {
+		for (offset = 0; offset < 4; ++offset) {
+			crc = (uint16_t) (len * 101);
+			expected = reference_crc16(crc, data + offset, len);
+
+			lha_crc16_buf(&crc, data + offset, len);
+			assert(crc == expected);
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	test_crc16_pass();
 	test_crc16_progressive();
 	test_crc16_fail();
 	test_crc16_empty();
+	test_crc16_long();
 
 	return 0;
 }
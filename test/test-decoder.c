@@ -62,6 +62,7 @@ static DecoderTestData files[] = {
 
 	// PMarc:
 	{ "compressed/lh0.bin", "-pm0-", 18092, 0x4e46f4a1 },
+	{ "compressed/pm1.bin", "-pm1-", 25284, 0xb7d0e42c },
 	{ "compressed/pm2.bin", "-pm2-", 18176, 0x8e2093a7 },
 };
 
@@ -222,6 +223,317 @@ static void test_decompress_truncated(void)
 	}
 }
 
+// Decompress part of a file, then reset the decoder and decompress the
+// whole file again; the result must be the same as with a new decoder.
+
+static void test_reset_for_file(DecoderTestData *file)
+{
+	LHADecoder *decoder;
+	DecompressState state;
+	uint8_t *data;
+	size_t data_len;
+	uint8_t buf[1000];
+	size_t len;
+	uint32_t crc;
+	unsigned int pass;
+
+	read_file_data(file->filename, &data, &data_len);
+
+	decoder = create_decoder(&state, data, data_len, file->algorithm,
+	                         file->len);
+
+	for (pass = 0; pass < 3; ++pass) {
+
+		// Read only some of the file on the first pass.
+
+		if (pass == 0) {
+			assert(lha_decoder_read(decoder, buf, sizeof(buf))
+			       == sizeof(buf));
+		} else {
+			crc = 0;
+
+			do {
+				len = lha_decoder_read(decoder, buf,
+				                       sizeof(buf));
+				crc32_buf(&crc, buf, len);
+			} while (len > 0);
+
+			assert(crc == file->crc);
+			assert(lha_decoder_get_length(decoder) == file->len);
+		}
+
+		state.pos = 0;
+		assert(lha_decoder_reset(decoder, read_compressed_data,
+		                         &state, file->len));
+	}
+
+	lha_decoder_free(decoder);
+	free(data);
+}
+
+static void test_reset(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(files) / sizeof(DecoderTestData); ++i) {
+		test_reset_for_file(&files[i]);
+	}
+}
+
+// Decompress a file with a push decoder, feeding the compressed data in
+// small chunks. If drain is non-zero, all the output is collected after
+// each chunk, as an event loop might, before feeding the next. Returns
+// the CRC of the decompressed data, or zero if the decoder reported an
+// error.
+
+static uint32_t feed_and_crc(DecoderTestData *file,
+                             uint8_t *data, size_t data_len, int drain)
+{
+	LHADecoderType *dtype;
+	LHADecoder *decoder;
+	uint8_t buf[100];
+	size_t pos, chunk, consumed, produced;
+	uint32_t crc;
+	int success;
+
+	dtype = lha_decoder_for_name(file->algorithm);
+	assert(dtype != NULL);
+
+	decoder = lha_decoder_new_push(dtype, file->len);
+	assert(decoder != NULL);
+
+	crc = 0;
+	pos = 0;
+
+	success = 1;
+
+	// Feed in chunks of an odd size, until all data has been consumed.
+
+	while (success && pos < data_len) {
+		chunk = data_len - pos;
+
+		if (chunk > 37) {
+			chunk = 37;
+		}
+
+		success = lha_decoder_feed(decoder, data + pos, chunk,
+		                           buf, sizeof(buf),
+		                           &consumed, &produced);
+		assert(consumed <= chunk);
+
+		pos += consumed;
+		crc32_buf(&crc, buf, produced);
+
+		// Feeding no data must not end the stream.
+
+		while (drain && success && produced > 0) {
+			success = lha_decoder_feed(decoder, NULL, 0,
+			                           buf, sizeof(buf),
+			                           &consumed, &produced);
+			assert(consumed == 0);
+			crc32_buf(&crc, buf, produced);
+		}
+	}
+
+	// Signal the end of the data, and collect the remaining output,
+	// until the decoder signals the end by producing nothing.
+
+	lha_decoder_feed_end(decoder);
+
+	while (success) {
+		success = lha_decoder_feed(decoder, NULL, 0, buf, sizeof(buf),
+		                           &consumed, &produced);
+		crc32_buf(&crc, buf, produced);
+
+		if (produced == 0) {
+			break;
+		}
+	}
+
+	if (success) {
+		assert(lha_decoder_get_length(decoder) == file->len);
+	}
+
+	lha_decoder_free(decoder);
+
+	return success ? crc : 0;
+}
+
+static void test_feed(void)
+{
+	uint8_t *data;
+	size_t data_len;
+	unsigned int i;
+	int drain;
+
+	for (i = 0; i < sizeof(files) / sizeof(DecoderTestData); ++i) {
+		read_file_data(files[i].filename, &data, &data_len);
+
+		for (drain = 0; drain <= 1; ++drain) {
+			assert(feed_and_crc(&files[i], data, data_len, drain)
+			       == files[i].crc);
+
+			// Truncated data must not give the right result.
+
+			assert(feed_and_crc(&files[i], data, data_len - 500,
+			                    drain) != files[i].crc);
+		}
+
+		free(data);
+	}
+}
+
+// Decompress a file into a single buffer with lha_decoder_read_linear,
+// after first reading the specified amount with lha_decoder_read.
+// Returns the CRC of the buffer contents.
+
+static uint32_t read_linear_and_crc(DecoderTestData *file,
+                                    uint8_t *data, size_t data_len,
+                                    size_t first_read)
+{
+	LHADecoder *decoder;
+	DecompressState state;
+	uint8_t *buf;
+	size_t len;
+	uint32_t crc;
+
+	buf = malloc(file->len);
+	assert(buf != NULL);
+	memset(buf, 0, file->len);
+
+	decoder = create_decoder(&state, data, data_len, file->algorithm,
+	                         file->len);
+
+	len = lha_decoder_read(decoder, buf, first_read);
+	len += lha_decoder_read_linear(decoder, buf, file->len);
+
+	assert(len == lha_decoder_get_length(decoder));
+
+	crc = 0;
+	crc32_buf(&crc, buf, file->len);
+
+	lha_decoder_free(decoder);
+	free(buf);
+
+	return crc;
+}
+
+static void test_read_linear(void)
+{
+	uint8_t *data;
+	size_t data_len;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(files) / sizeof(DecoderTestData); ++i) {
+		read_file_data(files[i].filename, &data, &data_len);
+
+		assert(read_linear_and_crc(&files[i], data, data_len, 0)
+		       == files[i].crc);
+		assert(read_linear_and_crc(&files[i], data, data_len, 1001)
+		       == files[i].crc);
+
+		// Truncated data must not give the right result.
+
+		assert(read_linear_and_crc(&files[i], data, data_len - 500, 0)
+		       != files[i].crc);
+
+		free(data);
+	}
+}
+
+// Decompress a file, saving the decoder state after each read. Then
+// restore each saved state into a new decoder, and check that the rest
+// of the file is decompressed from there.
+
+static void test_save_state_for_file(DecoderTestData *file)
+{
+	LHADecoder *decoder;
+	DecompressState state;
+	uint8_t *data, *expected, *states, *saved;
+	uint8_t buf[777];
+	size_t data_len, state_size, len, pos;
+	unsigned int num_states, i;
+	uint16_t crc;
+
+	read_file_data(file->filename, &data, &data_len);
+
+	state_size = lha_decoder_state_size(lha_decoder_for_name(
+	                                        file->algorithm));
+	assert(state_size > 0);
+
+	num_states = file->len / 1000 + 1;
+	states = malloc(state_size * num_states);
+	expected = malloc(file->len);
+	assert(states != NULL && expected != NULL);
+
+	decoder = create_decoder(&state, data, data_len, file->algorithm,
+	                         file->len);
+
+	for (i = 0; i < num_states; ++i) {
+		saved = states + i * state_size;
+		assert(lha_decoder_save_state(decoder, saved));
+
+		// The state is saved after any data that the decoder has
+		// already decoded but not yet returned.
+
+		assert(lha_decoder_state_position(saved) >= i * 1000);
+
+		lha_decoder_read(decoder, expected + i * 1000, 1000);
+	}
+
+	assert(lha_decoder_get_length(decoder) == file->len);
+	crc = lha_decoder_get_crc(decoder);
+	lha_decoder_free(decoder);
+
+	for (i = 0; i < num_states; ++i) {
+		saved = states + i * state_size;
+		decoder = create_decoder(&state, data, data_len,
+		                         file->algorithm, file->len);
+
+		state.pos = lha_decoder_state_input_position(saved);
+		assert(lha_decoder_restore_state(decoder, saved,
+		                                 read_compressed_data,
+		                                 &state));
+		pos = lha_decoder_state_position(saved);
+		assert(lha_decoder_get_length(decoder) == pos);
+
+		// Read the rest of the file.
+
+		for (; pos < file->len; pos += len) {
+			len = lha_decoder_read(decoder, buf, sizeof(buf));
+			assert(len > 0);
+			assert(!memcmp(buf, expected + pos, len));
+		}
+
+		assert(lha_decoder_read(decoder, buf, sizeof(buf)) == 0);
+		assert(lha_decoder_get_crc(decoder) == crc);
+
+		lha_decoder_free(decoder);
+	}
+
+	// A state beyond the end of the stream is rejected.
+
+	saved = states + (num_states - 1) * state_size;
+	decoder = create_decoder(&state, data, data_len, file->algorithm,
+	                         lha_decoder_state_position(saved) - 1);
+	assert(!lha_decoder_restore_state(decoder, saved,
+	                                  read_compressed_data, &state));
+	lha_decoder_free(decoder);
+
+	free(states);
+	free(expected);
+	free(data);
+}
+
+static void test_save_state(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(files) / sizeof(DecoderTestData); ++i) {
+		test_save_state_for_file(&files[i]);
+	}
+}
+
 static void progress_callback(unsigned int blocks, unsigned int total,
                               void *user)
 {
@@ -308,6 +620,10 @@ int main(int argc, char *argv[])
 {
 	test_decompress();
 	test_decompress_truncated();
+	test_reset();
+	test_feed();
+	test_read_linear();
+	test_save_state();
 	test_progress_feedback();
 	test_invalid_type();
 
@@ -0,0 +1,423 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "lib/lha_decoder.h"
+#include "lib/lha_encoder.h"
+
+// Size of each chunk of data passed to the encoder by the callback,
+// and size of the buffer used to read compressed data.
+
+#define INPUT_CHUNK_SIZE   1000
+#define OUTPUT_CHUNK_SIZE  3000
+
+typedef struct {
+	const uint8_t *data;
+	size_t data_len;
+	size_t pos;
+} ReadState;
+
+static char *algorithms[] = { "-lh5-", "-lh6-", "-lh7-" };
+
+static uint32_t rand_state;
+
+// Simple pseudo-random number generator, so that the test data is the
+// same every time.
+
+static unsigned int next_random(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+
+	return (rand_state >> 16) & 0x7fff;
+}
+
+static void read_file_data(char *filename, uint8_t **data, size_t *len)
+{
+	FILE *fstream;
+
+	fstream = fopen(filename, "rb");
+	assert(fstream != NULL);
+
+	// Read file size:
+
+	fseek(fstream, 0, SEEK_END);
+	*len = (size_t) ftell(fstream);
+	fseek(fstream, 0, SEEK_SET);
+
+	// Allocate buffer and read data:
+
+	*data = malloc(*len);
+	assert(*data != NULL);
+
+	assert(fread(*data, 1, *len, fstream) == *len);
+
+	fclose(fstream);
+}
+
+// Callback function used by both the encoder and decoder to read data
+// from a buffer. Data is returned in small chunks, to check that the
+// encoder copes with short reads.
+
+static size_t read_data(void *buf, size_t buf_len, void *user)
+{
+	ReadState *state = user;
+	size_t result;
+
+	result = state->data_len - state->pos;
+
+	if (result > buf_len) {
+		result = buf_len;
+	}
+
+	if (result > INPUT_CHUNK_SIZE) {
+		result = INPUT_CHUNK_SIZE;
+	}
+
+	memcpy(buf, state->data + state->pos, result);
+	state->pos += result;
+
+	return result;
+}
+
+// Compress some data, returning a newly-allocated buffer containing
+// the compressed data. If num_threads is non-zero, a parallel encoder
+// is used.
+
+static uint8_t *compress_data(char *algorithm, int level,
+                              unsigned int num_threads,
+                              const uint8_t *data, size_t data_len,
+                              size_t *compressed_len, uint16_t *crc)
+{
+	LHAEncoderType *etype;
+	LHAEncoder *encoder;
+	ReadState state;
+	uint8_t *result;
+	size_t result_size, n;
+
+	etype = lha_encoder_for_name(algorithm);
+	assert(etype != NULL);
+
+	state.data = data;
+	state.data_len = data_len;
+	state.pos = 0;
+
+	if (num_threads > 0) {
+		encoder = lha_encoder_new_parallel(etype, level, num_threads,
+		                                   read_data, &state);
+	} else {
+		encoder = lha_encoder_new(etype, level, read_data, &state);
+	}
+
+	assert(encoder != NULL);
+
+	result_size = OUTPUT_CHUNK_SIZE;
+	result = malloc(result_size);
+	assert(result != NULL);
+	*compressed_len = 0;
+
+	for (;;) {
+		if (*compressed_len + OUTPUT_CHUNK_SIZE > result_size) {
+			result_size *= 2;
+			result = realloc(result, result_size);
+			assert(result != NULL);
+		}
+
+		n = lha_encoder_read(encoder, result + *compressed_len,
+		                     OUTPUT_CHUNK_SIZE);
+		*compressed_len += n;
+
+		if (n < OUTPUT_CHUNK_SIZE) {
+			break;
+		}
+	}
+
+	// Once the end has been reached, there is no more data.
+
+	assert(lha_encoder_read(encoder, result, OUTPUT_CHUNK_SIZE) == 0);
+
+	// All the data was read, and the CRC is for all of it.
+
+	assert(!lha_encoder_failed(encoder));
+	assert(lha_encoder_get_length(encoder) == data_len);
+	*crc = lha_encoder_get_crc(encoder);
+
+	lha_encoder_free(encoder);
+
+	return result;
+}
+
+// Compress some data and decompress it again, checking that the result
+// is the same as the original data. Returns the compressed length.
+
+static size_t round_trip(char *algorithm, int level,
+                         unsigned int num_threads,
+                         const uint8_t *data, size_t data_len)
+{
+	LHADecoderType *dtype;
+	LHADecoder *decoder;
+	ReadState state;
+	uint8_t *compressed, *decompressed;
+	size_t compressed_len;
+	uint16_t crc;
+
+	compressed = compress_data(algorithm, level, num_threads,
+	                           data, data_len, &compressed_len, &crc);
+
+	dtype = lha_decoder_for_name(algorithm);
+	assert(dtype != NULL);
+
+	state.data = compressed;
+	state.data_len = compressed_len;
+	state.pos = 0;
+
+	decoder = lha_decoder_new(dtype, read_data, &state, data_len);
+	assert(decoder != NULL);
+
+	// Allocate an extra byte, to check that there is no more data.
+
+	decompressed = malloc(data_len + 1);
+	assert(decompressed != NULL);
+
+	assert(lha_decoder_read(decoder, decompressed, data_len + 1)
+	       == data_len);
+	assert(memcmp(decompressed, data, data_len) == 0);
+	assert(lha_decoder_get_crc(decoder) == crc);
+
+	// All of the compressed data was used.
+
+	assert(state.pos == compressed_len);
+
+	lha_decoder_free(decoder);
+	free(decompressed);
+	free(compressed);
+
+	return compressed_len;
+}
+
+// Check that some data can be compressed with every algorithm and
+// level. The compressed data must be no larger than the specified
+// fraction of the original data.
+
+static void test_round_trip_for(const uint8_t *data, size_t data_len,
+                                unsigned int max_percent)
+{
+	unsigned int i;
+	size_t compressed_len;
+	int level;
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		for (level = LHA_ENCODER_MIN_LEVEL;
+		     level <= LHA_ENCODER_MAX_LEVEL; ++level) {
+			compressed_len = round_trip(algorithms[i], level, 0,
+			                            data, data_len);
+
+			assert(compressed_len * 100
+			       <= data_len * max_percent + 100);
+		}
+	}
+}
+
+// Build some text that is larger than all of the dictionaries, by
+// repeating the specified text with random changes.
+
+static uint8_t *build_long_text(const uint8_t *text, size_t text_len,
+                                size_t len)
+{
+	uint8_t *result;
+	size_t i;
+
+	result = malloc(len);
+	assert(result != NULL);
+
+	for (i = 0; i < len; ++i) {
+		result[i] = text[i % text_len];
+
+		if (next_random() % 100 == 0) {
+			result[i] = (uint8_t) next_random();
+		}
+	}
+
+	return result;
+}
+
+static void test_round_trip(void)
+{
+	uint8_t *text, *data;
+	size_t text_len, len, i;
+
+	read_file_data("compressed/lh0.bin", &text, &text_len);
+	rand_state = 1;
+
+	// Plain text, and short inputs.
+
+	test_round_trip_for(text, text_len, 50);
+	test_round_trip_for(text, 0, 0);
+	test_round_trip_for(text, 1, 1000);
+	test_round_trip_for(text, 3, 1000);
+
+	// Long text, so that matches reach back the whole dictionary,
+	// and the window is moved back.
+
+	len = 300000;
+	data = build_long_text(text, text_len, len);
+	test_round_trip_for(data, len, 45);
+
+	// The same data repeated, that should compress well.
+
+	memset(data, 0, len);
+	test_round_trip_for(data, len, 1);
+
+	// Random data, that does not compress.
+
+	for (i = 0; i < len; ++i) {
+		data[i] = (uint8_t) next_random();
+	}
+
+	test_round_trip_for(data, 100000, 101);
+
+	// Text then random data then text again, so that the blocks
+	// have very different statistics.
+
+	memcpy(data, text, text_len);
+	memcpy(data + text_len * 2, text, text_len);
+	test_round_trip_for(data, text_len * 3, 70);
+
+	free(data);
+	free(text);
+}
+
+// Compress data larger than the chunks used by parallel encoders, and
+// check that the chunks join up and that little is lost by splitting
+// the data.
+
+static void test_parallel(void)
+{
+	uint8_t *text, *data;
+	size_t text_len, len, serial_len, parallel_len;
+	unsigned int i, num_threads;
+	int level;
+
+	read_file_data("compressed/lh0.bin", &text, &text_len);
+	rand_state = 2;
+
+	len = 2500000;
+	data = build_long_text(text, text_len, len);
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		for (level = LHA_ENCODER_MIN_LEVEL;
+		     level <= LHA_ENCODER_DEFAULT_LEVEL; level += 5) {
+			serial_len = round_trip(algorithms[i], level, 0,
+			                        data, len);
+
+			for (num_threads = 1; num_threads <= 4;
+			     num_threads += 3) {
+				parallel_len = round_trip(algorithms[i], level,
+				                          num_threads,
+				                          data, len);
+
+				assert(parallel_len * 100
+				       <= serial_len * 101);
+			}
+		}
+	}
+
+	// Short data, that fits in a single chunk.
+
+	assert(round_trip("-lh5-", 6, 2, text, text_len)
+	       == round_trip("-lh5-", 6, 0, text, text_len));
+	round_trip("-lh5-", 6, 2, text, 0);
+
+	free(data);
+	free(text);
+}
+
+// Initialization function for an encoder that always fails.
+
+static int failing_init(void *extra_data, int level,
+                        LHAEncoderCallback callback, void *callback_data)
+{
+	return 0;
+}
+
+// If a chunk cannot be compressed, the parallel encoder must report
+// it, rather than just ending the compressed data early.
+
+static void test_failed(void)
+{
+	LHAEncoderType etype;
+	LHAEncoder *encoder;
+	ReadState state;
+	uint8_t *data, buf[OUTPUT_CHUNK_SIZE];
+	size_t data_len;
+
+	read_file_data("compressed/lh0.bin", &data, &data_len);
+
+	etype = *lha_encoder_for_name("-lh5-");
+	etype.init = failing_init;
+
+	state.data = data;
+	state.data_len = data_len;
+	state.pos = 0;
+
+	encoder = lha_encoder_new_parallel(&etype, LHA_ENCODER_DEFAULT_LEVEL,
+	                                   2, read_data, &state);
+	assert(encoder != NULL);
+
+	while (lha_encoder_read(encoder, buf, sizeof(buf)) > 0);
+
+	assert(lha_encoder_failed(encoder));
+	assert(lha_encoder_get_length(encoder) == 0);
+
+	lha_encoder_free(encoder);
+	free(data);
+}
+
+static void test_invalid(void)
+{
+	LHAEncoderType *etype;
+
+	assert(lha_encoder_for_name("-lh1-") == NULL);
+	assert(lha_encoder_for_name("-foo-") == NULL);
+
+	etype = lha_encoder_for_name("-lh5-");
+	assert(etype != NULL);
+
+	assert(lha_encoder_new(etype, LHA_ENCODER_MIN_LEVEL - 1,
+	                       read_data, NULL) == NULL);
+	assert(lha_encoder_new(etype, LHA_ENCODER_MAX_LEVEL + 1,
+	                       read_data, NULL) == NULL);
+	assert(lha_encoder_new_parallel(etype, LHA_ENCODER_DEFAULT_LEVEL, 0,
+	                                read_data, NULL) == NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	test_round_trip();
+	test_parallel();
+	test_failed();
+	test_invalid();
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lha_reader.h"
+#include "lha_seek_index.h"
+
+#define INDEX_FILENAME "test-seek-index.idx"
+
+// Interval between checkpoints in the index.
+
+#define CHECKPOINT_INTERVAL (64 * 1024)
+
+// Number of bytes to compare after each seek.
+
+#define COMPARE_LENGTH 1000
+
+// Open the first file in an archive.
+
+static LHAReader *open_archive(char *filename, LHAInputStream **stream,
+                               size_t *len)
+{
+	LHAReader *reader;
+	LHAFileHeader *header;
+
+	*stream = lha_input_stream_from(filename);
+	assert(*stream != NULL);
+	reader = lha_reader_new(*stream);
+	assert(reader != NULL);
+	header = lha_reader_next_file(reader);
+	assert(header != NULL);
+	*len = header->length;
+
+	return reader;
+}
+
+// Read the whole of the first file in an archive, building the
+// checkpoints in the index as it is read.
+
+static uint8_t *read_with_index(char *filename, LHASeekIndex *index,
+                                size_t *len)
+{
+	LHAInputStream *stream;
+	LHAReader *reader;
+	uint8_t *data;
+	size_t pos, n;
+
+	reader = open_archive(filename, &stream, len);
+	assert(lha_reader_set_seek_index(reader, index));
+
+	data = malloc(*len);
+	assert(data != NULL);
+
+	// Read in odd-sized chunks, so that checkpoints are added at
+	// positions that are not aligned to the read size.
+
+	for (pos = 0; pos < *len; pos += n) {
+		n = lha_reader_read(reader, data + pos, 777);
+		assert(n > 0);
+	}
+
+	assert(lha_reader_read(reader, data, 1) == 0);
+
+	lha_reader_free(reader);
+	lha_input_stream_free(stream);
+
+	return data;
+}
+
+// Seek to the specified position and check the data read from there.
+
+static void check_seek(LHAReader *reader, uint8_t *data, size_t len,
+                       size_t offset)
+{
+	uint8_t buf[COMPARE_LENGTH];
+	size_t n;
+
+	assert(lha_reader_seek(reader, offset));
+
+	n = len - offset;
+
+	if (n > sizeof(buf)) {
+		n = sizeof(buf);
+	}
+
+	assert(lha_reader_read(reader, buf, n) == n);
+	assert(!memcmp(buf, data + offset, n));
+}
+
+// Seek to various positions, both forwards and backwards, using the
+// specified index (or no index).
+
+static void check_seeks(char *filename, LHASeekIndex *index,
+                        uint8_t *data, size_t len)
+{
+	LHAInputStream *stream;
+	LHAReader *reader;
+	size_t file_len;
+
+	reader = open_archive(filename, &stream, &file_len);
+	assert(file_len == len);
+
+	if (index != NULL) {
+		assert(lha_reader_set_seek_index(reader, index));
+	}
+
+	check_seek(reader, data, len, len / 2);
+	check_seek(reader, data, len, len / 3);
+	check_seek(reader, data, len, len - 10);
+	check_seek(reader, data, len, 0);
+	check_seek(reader, data, len, CHECKPOINT_INTERVAL * 3 + 1);
+	check_seek(reader, data, len, CHECKPOINT_INTERVAL * 3 + 2000);
+	check_seek(reader, data, len, CHECKPOINT_INTERVAL);
+	check_seek(reader, data, len, len);
+
+	// Seeking past the end of the file fails.
+
+	assert(!lha_reader_seek(reader, len + 1));
+
+	lha_reader_free(reader);
+	lha_input_stream_free(stream);
+}
+
+static void check_seek_index_for(char *filename)
+{
+	LHASeekIndex *index, *loaded;
+	LHAInputStream *stream;
+	LHAReader *reader;
+	uint8_t *data;
+	size_t len;
+
+	index = lha_seek_index_new(CHECKPOINT_INTERVAL);
+	assert(index != NULL);
+
+	data = read_with_index(filename, index, &len);
+	assert(len > CHECKPOINT_INTERVAL * 4);
+	assert(lha_seek_index_num_checkpoints(index) > 0);
+	assert(lha_seek_index_num_checkpoints(index)
+	       <= len / CHECKPOINT_INTERVAL);
+
+	check_seeks(filename, index, data, len);
+	check_seeks(filename, NULL, data, len);
+
+	// Save the index and load it again.
+
+	assert(lha_seek_index_save(index, INDEX_FILENAME));
+	loaded = lha_seek_index_load(INDEX_FILENAME);
+	assert(loaded != NULL);
+	assert(lha_seek_index_num_checkpoints(loaded)
+	       == lha_seek_index_num_checkpoints(index));
+
+	check_seeks(filename, loaded, data, len);
+
+	// The index cannot be used with a different file.
+
+	reader = open_archive("archives/lha_unix114i/lh6_long.lzh", &stream,
+	                      &len);
+	assert(!lha_reader_set_seek_index(reader, loaded));
+	lha_reader_free(reader);
+	lha_input_stream_free(stream);
+
+	lha_seek_index_free(loaded);
+	lha_seek_index_free(index);
+	remove(INDEX_FILENAME);
+	free(data);
+}
+
+static void test_seek_index(void)
+{
+	check_seek_index_for("archives/lha213/lh5_long.lzh");
+	check_seek_index_for("archives/lha_unix114i/lh7_long.lzh");
+	check_seek_index_for("archives/unlha32/lhx_long.lzh");
+	check_seek_index_for("archives/lhark04d/lh7_long.lzh");
+	check_seek_index_for("archives/lharc113/long.lzh");
+	check_seek_index_for("archives/larc333/long.lzs");
+	check_seek_index_for("archives/pmarc124/pm1_long.pma");
+	check_seek_index_for("archives/pmarc2/long.pma");
+}
+
+int main(int argc, char *argv[])
+{
+	test_seek_index();
+
+	return 0;
+}